@@ -1,19 +1,145 @@
-#include "raylib.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
-
-#define MAX_ENEMIES 1000
-#define MAX_PROJECTILES 1000
+#include <limits.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Mapeamento de arquivo na memoria, usado pelos mapas compilados, gravacao segura do placar e a thread de arquivos
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 // CONDITION_VARIABLE (Vista em diante)
+#endif
+#define NOGDI       // Rectangle do raylib
+#define NOUSER      // CloseWindow, DrawText, ShowCursor e LoadImage do raylib
+#include <windows.h>
+#include <io.h>
+#undef near
+#undef far
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(MAP_COMPILER) && !defined(HEADLESS)
+#define HEADLESS    // O compilador de mapas nao abre janela
+#endif
+
+#ifdef HEADLESS
+// Build sem janela (alvo Headless do test.cbp, compilado com -DHEADLESS): so os tipos e funcoes
+// do raylib que a simulacao usa, sem depender da biblioteca, de janela ou de placa de video
+#include <stdbool.h>
+
+typedef struct Vector2 {
+    float x;
+    float y;
+} Vector2;
+
+typedef struct Rectangle {
+    float x;
+    float y;
+    float width;
+    float height;
+} Rectangle;
+
+typedef struct Color {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+} Color;
+
+#define YELLOW (Color){ 253, 249, 0, 255 }
+#define BLUE (Color){ 0, 121, 241, 255 }
+
+// Mesma regra do raylib: bordas encostadas nao colidem
+bool CheckCollisionRecs(Rectangle rec1, Rectangle rec2) {
+    return (rec1.x < (rec2.x + rec2.width) && (rec1.x + rec1.width) > rec2.x) &&
+           (rec1.y < (rec2.y + rec2.height) && (rec1.y + rec1.height) > rec2.y);
+}
+#else
+#include "raylib.h"
+#endif
+
+// Mensagens de depuracao da simulacao (pontos, vida). So no jogo com janela: sem janela e no benchmark os ticks
+// rodam o mais rapido possivel e a escrita no terminal entraria na medida
+#if defined(HEADLESS) || defined(BENCHMARK)
+#define DEBUG_LOG(...)
+#else
+#define DEBUG_LOG(...) printf(__VA_ARGS__)
+#endif
+
+#ifndef MAX_ENEMIES
+#define MAX_ENEMIES 1000            // Capacidade padrao de inimigos (pode ser trocada com -DMAX_ENEMIES=...)
+#endif
+#ifndef MAX_PROJECTILES
+#define MAX_PROJECTILES 1000        // Capacidade padrao do pool de projeteis (pode ser trocada com -DMAX_PROJECTILES=...)
+#endif
 #define BLOCK_SIZE 16
-#define MAX_WIDTH 1000
-#define MAX_HEIGHT 100
+#define MAP_CHUNK_COLUMNS 256       // Colunas de cada pedaco do mapa lido do disco (multiplo de 64)
+#define MAP_CHUNK_WORDS (MAP_CHUNK_COLUMNS / 64)    // Palavras de 64 bits por linha do pedaco na grade de colisao
+#define MAX_MAP_ROWS 65536          // Linhas do mapa no maximo; mantem as contas de bits e bytes de um pedaco longe de estourar
+#define MAP_RESIDENT_CHUNKS 32      // Pedacos do mapa na memoria ao mesmo tempo (potencia de 2); limita a memoria do mapa
+#define COMPILED_MAP_MAGIC "INFM"   // Primeiros 4 bytes do mapa compilado
+#define COMPILED_MAP_VERSION 3      // Aumentar sempre que o formato do mapa compilado mudar
+#define QUICKSAVE_FILE "quicksave.bin"
+#define QUICKSAVE_MAGIC "INFQ"      // Primeiros 4 bytes do quicksave
+#define QUICKSAVE_VERSION 2         // Aumentar sempre que Player, Coin ou os campos gravados mudarem
+#define REPLAY_MAGIC "INFR"         // Primeiros 4 bytes da gravacao de entrada
+#define REPLAY_VERSION 1            // Aumentar sempre que o formato da gravacao ou a simulacao mudarem
+#define REPLAY_HASH_INTERVAL 30     // Ticks entre hashes do mundo guardados na gravacao
+#define LEADERBOARD_FILE "leaderboard.bin"      // Placar compactado, ordenado
+#define LEADERBOARD_LOG "leaderboard.log"       // Pontuacoes registradas depois da ultima compactacao
+#define LEADERBOARD_LEGACY_FILE "top_scores.bin" // Top 5 antigo, importado se ainda nao houver placar
+#define LEADERBOARD_MAGIC "INFL"    // Primeiros 4 bytes do placar compactado
+#define LEADERBOARD_VERSION 1       // Aumentar sempre que JogadorLeader ou o formato do placar mudarem
+#define LEADERBOARD_COMPACT_ENTRIES 4096        // Registros no log antes de compactar (e pelo menos 1/4 do placar)
+#define IO_QUEUE_CAPACITY 256       // Pedidos esperando a thread de arquivos (e conclusoes esperando o jogo)
+#define MAX_JOB_THREADS 16          // Threads do sistema de jobs, contando a do jogo
+#define JOB_QUEUE_CAPACITY 256      // Jobs na fila de cada thread
+#define JOB_WAITING_CAPACITY 64     // Jobs esperando o grupo de que dependem terminar
+#define JOB_CHUNKS_PER_THREAD 4     // Pedacos de cada parallel-for por thread: sobra trabalho para roubar
+#define ENEMY_JOB_GRAIN 4096        // Menor pedaco da patrulha dos inimigos num job (multiplo de 4, por causa do SSE)
+#define PROJECTILE_JOB_GRAIN 64     // Menor pedaco de projeteis num job (varredura ou alvo)
+#define SPATIAL_HASH_JOB_MIN 16384  // Entidades a partir das quais o hash espacial e montado em paralelo
+#define MAX_ASSETS 64               // Arquivos de imagem e som carregados ao mesmo tempo
+#define AUDIO_SAMPLE_RATE 44100     // Formato dos efeitos sonoros (16 bits, mono)
+#define MUSIC_BUFFER_FRAMES 8192    // Quadros de cada buffer da musica: maior aguenta mais tempo sem a thread de audio
+#define SFX_BUFFER_FRAMES 1024      // Quadros de cada buffer dos efeitos: menor toca mais perto do evento
+#define SFX_VOICES 8                // Efeitos tocando ao mesmo tempo; um novo interrompe o mais antigo
+#define AUDIO_THREAD_SLEEP_MS 4     // Pausa da thread de audio entre conferencias dos buffers
 #define SCREEN_WIDTH 1200
 #define SCREEN_HEIGHT 600
 #define MAX_NOME 20
-#define MAX_HISTORY_SIZE 180
+#define SIMULATION_HZ 120                       // Ticks de simulacao por segundo, independente do FPS
+#define SIMULATION_DT (1.0f / SIMULATION_HZ)
+#define MAX_FRAME_TIME 0.25f                    // Limite de tempo real simulado por frame, evita espiral apos travadas
+#define REWIND_SECONDS 5                        // Quanto tempo o historico de rewind guarda
+#define REWIND_TICKS (REWIND_SECONDS * SIMULATION_HZ)
+#define REWIND_KEYFRAME_INTERVAL 60             // Ticks entre estados completos no historico
+#define REWIND_BUFFER_BYTES (4 * 1024 * 1024)   // Memoria fixa dos estados gravados; com muita coisa mudando guarda menos tempo
+#define OBSTACLE_REWIND_SECONDS 3               // Quanto o mundo volta ao bater num obstaculo
+#define SPATIAL_CELL_SIZE 64        // Lado de cada celula do hash espacial (maior que qualquer entidade)
+#define SPATIAL_HASH_BUCKETS 4096   // Quantidade de baldes (potencia de 2)
+#define MAX_BACKGROUND_LAYERS 4
+#define TERRAIN_CHUNK_TILES 32      // Lado de cada pedaco de terreno pre-desenhado, em blocos
+#define TERRAIN_RESIDENT_CHUNKS 24 // Texturas de terreno guardadas; as que sairam da tela ha mais tempo sao reaproveitadas
+#define ATLAS_WIDTH 2048            // Largura fixa do atlas; a altura cresce conforme as prateleiras
+#define ATLAS_PADDING 1             // Espaco entre sprites para nao vazar cor entre vizinhos
+#define MAX_BATCH_SPRITES 8192      // Sprites acumulados antes de esvaziar o lote automaticamente
+#define PROFILER_FRAMES 240         // Frames guardados pelo profiler (alvo Debug, -DPROFILER)
+#define PROFILER_CSV "profiler_capture.csv"
+
+#if defined(HEADLESS) && defined(PROFILER)
+#undef PROFILER                     // O profiler mede com o relogio do raylib e desenha na tela; sem janela fica desligado
+#endif
 
 typedef struct {
     Vector2 position;   // Coordenadas (x, y)
@@ -26,29 +152,340 @@ typedef struct {
     int points;         // Pontos para o placar
     char nome[MAX_NOME];
     Vector2 spawnPoint;
+    Vector2 previousPosition; // Posicao no tick anterior, para interpolar o desenho
+    bool reachedGate;   // Chegou ao portao; a pontuacao e registrada fora da simulacao
+    bool rewindRequested;   // Bateu num obstaculo; o mundo volta no fim do tick
+    float shootTimer;   // Tempo da animacao de tiro em andamento
 } Player;
 
+// Entrada do jogador amostrada uma vez por frame e consumida pelos ticks de simulacao.
+// As teclas "pressionadas" ficam guardadas ate algum tick usar, para nao perder nem repetir toques.
+// E tudo o que a simulacao le de fora: a entrada de cada tick cabe num byte (PackPlayerInput) e e o que a replay grava
+typedef struct {
+    bool left, right;       // Teclas seguradas
+    bool jump;              // Espaco pressionado
+    bool shootHorizontal;   // Z pressionado
+    bool shootVertical;     // X pressionado
+    bool rewind;            // R segurado: o tick volta no historico em vez de simular
+} PlayerInput;
+
+// Bits da entrada de um tick gravada na replay
+typedef enum {
+    INPUT_LEFT = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_JUMP = 1 << 2,
+    INPUT_SHOOT_HORIZONTAL = 1 << 3,
+    INPUT_SHOOT_VERTICAL = 1 << 4,
+    INPUT_REWIND = 1 << 5
+} InputButton;
+
+// Relogio de passo fixo: acumula o tempo real e libera ticks de SIMULATION_DT
+typedef struct {
+    float accumulator;      // Tempo real ainda nao simulado
+    float alpha;            // Fracao do proximo tick ja decorrida (0..1), usada para interpolar o desenho
+    unsigned long tick;     // Ticks simulados
+} FixedClock;
+
+// Constantes de jogo compartilhadas pelo jogo, pelo modo sem janela e pelos benchmarks
+typedef struct {
+    float gravity;
+    float playerSpeed;
+    float jumpForce;
+    float enemySpeedX;
+    float enemyOffset;          // Distancia percorrida por cada inimigo na patrulha
+    float projectileWidth;
+    float projectileHeight;
+    float projectileSpeed;
+} GameSettings;
+
 typedef struct {
     char nome[MAX_NOME];
     int points;
 } JogadorLeader;
 
+// No da arvore AVL do placar; size conta os nos da subarvore, para achar a posicao de uma pontuacao em O(log n)
 typedef struct {
-    Vector2 position;   // coordenadas (x, y)
-    Vector2 velocity;   // velocidade (x, y)
-    Rectangle rect;     // Retangulo pra colisao
-    Vector2 minPosition; // posicao minima (x, y)
-    Vector2 maxPosition; // posicao maxima (x, y)
-    int health;         // pontos de vida
-    bool active;        // determina se o inimigo est ativo
-} Enemy;
+    int left, right;        // Filhos (-1 = nenhum)
+    int size;
+    int height;
+} LeaderboardNode;
+
+// Placar com todas as pontuacoes ja registradas. Na memoria, entries[i] e nodes[i] sao a mesma pontuacao e a
+// arvore as mantem em ordem (maior pontuacao primeiro). No disco, um arquivo compactado e ordenado e um log em
+// que cada pontuacao nova e acrescentada; quando o log cresce, os dois viram um arquivo compactado novo.
+// Os arquivos so sao lidos e gravados pela thread de arquivos; o jogo usa sempre a copia na memoria
+typedef struct {
+    JogadorLeader *entries;
+    LeaderboardNode *nodes;
+    int root;
+    int count, capacity;
+    long long sequence;         // Numero do ultimo registro feito no log
+    int logEntries;             // Registros no log desde a ultima compactacao
+    const char *filename, *logFilename;
+    bool loaded;                // Lido do disco; antes disso nao aceita pontuacoes
+} Leaderboard;
+
+// Cabecalho do placar compactado. Depois dele vem count JogadorLeader ja ordenados
+typedef struct {
+    char magic[4];              // LEADERBOARD_MAGIC
+    int version;                // LEADERBOARD_VERSION
+    int count;
+    long long sequence;         // Registros do log com numero ate este ja estao no arquivo
+} LeaderboardHeader;
+
+// Registro do log. checksum recusa o ultimo registro se o programa caiu no meio da gravacao
+typedef struct {
+    long long sequence;
+    JogadorLeader entry;
+    unsigned checksum;
+} LeaderboardLogRecord;
+
+#ifndef HEADLESS
+typedef enum {
+    ASSET_TEXTURE,          // Imagem decodificada na thread e enviada para a GPU
+    ASSET_IMAGE,            // Imagem que fica na memoria (as do atlas, que e montado a partir delas)
+    ASSET_SOUND,            // WAV decodificado na thread e enviado para o audio
+    ASSET_WAVE              // WAV que fica na memoria (efeitos, misturados pela thread de audio)
+} AssetType;
+
+typedef enum {
+    ASSET_FREE,
+    ASSET_LOADING,          // Com a thread: so ela mexe em image, wave e decodeSeconds ate a conclusao
+    ASSET_READY,
+    ASSET_FAILED
+} AssetState;
+
+// Arquivo carregado pelo AssetManager, compartilhado por todos que pediram o mesmo caminho
+typedef struct {
+    char path[256];
+    AssetType type;
+    AssetState state;
+    int refCount;
+    Image image;            // Decodificada; depois do envio so fica a do ASSET_IMAGE
+    Wave wave;              // Decodificado; liberado depois do envio
+    Texture2D texture;
+    Sound sound;
+    size_t bytes;           // Memoria do asset pronto (GPU na textura)
+    double decodeSeconds;   // Leitura e decodificacao, na thread
+    double uploadSeconds;   // Envio para a GPU ou para o audio, na thread principal
+} Asset;
+#endif
+
+// Pedidos atendidos pela thread de arquivos
+typedef enum {
+    IO_WRITE_FILE,          // Substitui o arquivo inteiro por data (arquivo novo ao lado, depois troca)
+    IO_APPEND_FILE,         // Acrescenta data no fim do arquivo
+    IO_READ_FILE,           // Le o arquivo inteiro para data
+    IO_LOAD_LEADERBOARD,    // LoadLeaderboard em leaderboard, que so volta para o jogo na conclusao
+    IO_DECODE_ASSET,        // Le e decodifica asset (PNG ou WAV), sem GPU nem audio
+    IO_READ_MAP_CHUNK       // Le um pedaco do mapa para data; o jogo troca pelo da memoria na conclusao
+} IoRequestType;
+
+// Quem pediu a leitura, para o jogo saber o que fazer com os dados quando ela terminar
+typedef enum {
+    IO_TAG_NONE,
+    IO_TAG_QUICKLOAD
+} IoTag;
+
+// Pedido e, depois de atendido, conclusao. data pertence ao pedido: e liberado por FinishIoRequest
+typedef struct {
+    IoRequestType type;
+    IoTag tag;
+    const char *filename;
+    char *data;
+    size_t size;
+    Leaderboard *leaderboard;   // IO_LOAD_LEADERBOARD
+    bool ok;
+#ifndef HEADLESS
+    Asset *asset;               // IO_DECODE_ASSET
+#endif
+    struct TileMap *map;        // IO_READ_MAP_CHUNK
+    int chunk;
+} IoRequest;
+
+// Thread unica de arquivos com duas filas circulares: pedidos (jogo -> thread) e conclusoes (thread -> jogo).
+// Os pedidos sao atendidos na ordem, entao uma gravacao seguida de outra no mesmo arquivo chega ao disco na
+// mesma ordem. Sem thread (falha ao criar ou threaded = false) os pedidos sao atendidos na hora
+typedef struct {
+    IoRequest requests[IO_QUEUE_CAPACITY];
+    IoRequest completions[IO_QUEUE_CAPACITY];
+    int firstRequest, requestCount;
+    int firstCompletion, completionCount;
+    bool busy;                  // Thread atendendo um pedido ja tirado da fila
+    bool stop;
+    bool threaded;
+    FILE *appendFile;           // Ultimo arquivo que recebeu IO_APPEND_FILE, mantido aberto pela thread
+    const char *appendFilename;
+#if defined(_WIN32)
+    HANDLE thread;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE workReady;   // Pedido novo ou stop
+    CONDITION_VARIABLE progress;    // Pedido atendido ou conclusao retirada
+#else
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t progress;
+#endif
+} IoQueue;
+
+// Parte [first, last) de um parallel-for
+typedef void (*JobFunction)(void *data, int first, int last);
+
+// Jobs de um grupo ainda nao terminados. Comeca zerado; quem depende do grupo espera chegar a 0
+typedef struct {
+    int pending;
+} JobCounter;
+
+typedef struct {
+    JobFunction function;
+    void *data;
+    int first, last;
+    JobCounter *dependency;     // So roda depois deste grupo terminar (NULL: sem dependencia)
+    JobCounter *done;           // Grupo do job (NULL: nenhum)
+} Job;
+
+// Fila de uma thread: a dona tira do fim (o job mais recente), as outras roubam do comeco
+typedef struct {
+    Job jobs[JOB_QUEUE_CAPACITY];
+    unsigned top, bottom;       // Jobs em [top, bottom), contadores que so crescem
+#if defined(_WIN32)
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} JobQueue;
+
+typedef struct {
+    struct JobSystem *system;
+    int index;                  // Fila da thread
+} JobWorker;
+
+// Pool de threads com roubo de trabalho. A thread do jogo (fila 0) cria os jobs, distribuidos em rodizio pelas
+// filas, e trabalha enquanto espera um grupo; cada thread auxiliar esvazia a propria fila e depois rouba das
+// outras. Jobs com dependencia ficam fora das filas ate o grupo dela terminar
+typedef struct JobSystem {
+    JobQueue queues[MAX_JOB_THREADS];
+    JobWorker workers[MAX_JOB_THREADS];
+    int threadCount;            // Contando a do jogo; 1 = tudo na thread do jogo
+    int nextQueue;              // Fila do proximo job
+    Job waiting[JOB_WAITING_CAPACITY];
+    int waitingCount;
+    int queued;                 // Jobs nas filas
+    bool stop;
+    long executed;              // Jobs rodados
+    long stolen;                // Jobs tirados da fila de outra thread
+#if defined(_WIN32)
+    HANDLE threads[MAX_JOB_THREADS];
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE workReady;   // Job novo nas filas ou stop
+    CONDITION_VARIABLE progress;    // Job terminado
+#else
+    pthread_t threads[MAX_JOB_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t progress;
+#endif
+} JobSystem;
+
+#ifndef HEADLESS
+// Imagens e sons carregados uma vez por caminho, com contagem de referencias. A decodificacao roda numa
+// thread so dela (IoQueue propria, para um PNG grande nao atrasar um quicksave); o envio para a GPU e para o
+// audio fica com a thread principal, em UpdateAssetManager
+typedef struct {
+    Asset assets[MAX_ASSETS];
+    IoQueue io;
+    int loads;                  // Arquivos decodificados
+    int hits;                   // Pedidos atendidos por um asset ja carregado
+    int failures;
+    double decodeSeconds, uploadSeconds;    // Somados de todos os carregamentos
+    double startTime;           // Criacao do gerenciador
+    double readyTime;           // Ultimo asset pronto, em segundos desde startTime
+    size_t cpuBytes, gpuBytes, peakBytes;
+} AssetManager;
+
+typedef enum {
+    SFX_SHOT,
+    SFX_COIN,
+    SFX_HIT,                // Projetil acertou um inimigo
+    SFX_HURT,               // Jogador perdeu vida
+    SFX_COUNT
+} SfxId;
+
+// Efeito ja convertido para AUDIO_SAMPLE_RATE, 16 bits, mono
+typedef struct {
+    short *samples;
+    int frameCount;
+    int gain;               // Volume em 1/256
+} SfxClip;
 
 typedef struct {
-    Rectangle rect;  // Propriedades de posio e tamanho
-    Vector2 speed;   // Velocidade do projtil
-    bool active;     // Indica se o projtil est ativo
-    Color color;
-} Projectile;
+    int clip;
+    int position;           // Proximo quadro a misturar
+    unsigned order;         // Ordem em que comecou a tocar, para interromper o mais antigo
+    bool active;
+} SfxVoice;
+
+// Musica e efeitos tocados por uma thread propria: ela reabastece o stream da musica e mistura as vozes dos
+// efeitos sempre que o audio consome um buffer, entao telas que prendem a thread principal (nome, fim de jogo)
+// e frames lentos nao deixam o som faltar. Depois de InitializeAudio so a thread chama o audio do raylib;
+// o jogo so mexe nas vozes e no volume, com lock
+typedef struct {
+    Music music;
+    bool musicLoaded;
+    float musicVolume;          // Pedido pelo jogo
+    float appliedMusicVolume;   // Ultimo enviado ao raylib, pela thread
+    AudioStream sfxStream;
+    int sfxBufferFrames;
+    int *mixAccumulator;        // Soma das vozes antes de limitar a 16 bits
+    short *mixBuffer;
+    SfxClip clips[SFX_COUNT];
+    SfxVoice voices[SFX_VOICES];
+    unsigned playOrder;
+    int played;                 // Efeitos tocados
+    int stolen;                 // Efeitos interrompidos por falta de voz
+    int refills;                // Buffers de efeitos misturados
+    bool stop;
+    bool threaded;
+#if defined(_WIN32)
+    HANDLE thread;
+    CRITICAL_SECTION lock;
+#else
+    pthread_t thread;
+    pthread_mutex_t lock;
+#endif
+} AudioSystem;
+#endif
+
+// Inimigos em estrutura de arrays. Os vivos ficam compactados em [0, activeCount) e servem de lista de ativos;
+// os mortos vao para [activeCount, count) e nao custam nada no movimento
+typedef struct {
+    float *x, *y;            // Posicao
+    float *previousX;        // Posicao x no tick anterior, para interpolar o desenho
+    float *speedX;           // Velocidade horizontal (troca de sinal nas bordas da patrulha)
+    float *minX, *maxX;      // Limites da patrulha
+    int *health;             // Pontos de vida
+    int *spawnId;            // Ordem em que o inimigo aparece no mapa, estavel mesmo depois das trocas
+    int count;               // Inimigos carregados
+    int activeCount;         // Inimigos vivos
+    int capacity;            // Maximo de inimigos
+    float width, height;     // Todos os inimigos tem o mesmo tamanho
+} EnemyStore;
+
+// Pool de projeteis em estrutura de arrays. Os projeteis vivos ficam sempre compactados em [0, count):
+// criar e o append no fim e remover troca com o ultimo, ambos O(1)
+typedef struct {
+    float *x, *y;            // Posicao
+    float *previousX, *previousY; // Posicao no tick anterior, para interpolar o desenho
+    float *width, *height;   // Tamanho
+    float *speedX, *speedY;  // Velocidade
+    float *travel;           // Fracao do movimento do frame ate bater num bloco (1 = livre)
+    bool *expired;           // Marcado para remocao no fim do MoveProjectiles
+    int *target;             // Inimigo que o projetil acerta, procurado em paralelo antes de aplicar os acertos
+    Color *color;
+    int count;               // Projeteis vivos
+    int capacity;            // Maximo de projeteis
+} ProjectilePool;
 
 typedef struct {
     Vector2 position;   // Coordenadas (x, y)
@@ -57,1055 +494,7025 @@ typedef struct {
     int points;         // Quantidade de pontos que a moeda d
 } Coin;
 
+// Camada de colisao de um pedaco, guardada logo depois dos blocos dele e carregada e descartada junto: um bit
+// por celula. Consultas de faixa, chao e linha de visada testam 64 celulas por operacao sem tocar nos caracteres
 typedef struct {
-    Vector2 positionHistory[MAX_HISTORY_SIZE]; // Coordenadas (x,y) ; [Array de posies possveis do jogador]
-    int currentIndex; // E o currentIndex indica qual dessas posies no array ele est
-} PlayerHistory;
+    unsigned long long *solid;          // Blocos (B), linha por linha: bit c % 64 da palavra c / 64 da linha (MAP_CHUNK_WORDS por linha)
+    unsigned long long *occupied;       // Blocos, obstaculos e portao (B, O, G), no mesmo formato
+    unsigned long long *solidColumns;   // Blocos coluna por coluna, sem sobra entre colunas: bit c * rows + y
+} CollisionGrid;
 
-// Le o mapa a partir de um arquivo
-void LoadMap(const char* filename, char map[MAX_HEIGHT][MAX_WIDTH], int* rows, int* cols) {
-    FILE* file = fopen(filename, "r");  // Le o arquivo
-    if (!file) {
-        perror("Failed to open file");
-        return;
-    }
+// Pedaco de MAP_CHUNK_COLUMNS colunas do mapa, com todas as linhas
+typedef struct {
+    char *tiles;            // rows x MAP_CHUNK_COLUMNS, linha por linha, seguido da grade de colisao
+    CollisionGrid collision;
+    int index;              // Pedaco guardado aqui (coluna / MAP_CHUNK_COLUMNS), -1 se livre
+    int requested;          // Pedaco pedido a thread de arquivos para esta posicao, -1 se nenhum
+    bool modified;          // Alterado por WriteMapTile
+} MapChunk;
+
+// Celula com entidade (P, M ou C), guardada ao carregar para nao reler o mapa inteiro a cada recomeco
+typedef struct {
+    int x, y;
+    char tile;
+} MapEntity;
+
+// Mapa lido do disco sob demanda. O pedaco i so pode ficar na posicao i % MAP_RESIDENT_CHUNKS, entao os
+// MAP_RESIDENT_CHUNKS pedacos em volta do jogador ficam na memoria e os outros sao lidos de novo quando alguem
+// consulta; a memoria nao cresce com a largura da fase. Acesse os blocos so por GetMapTile/WriteMapTile
+typedef struct TileMap {
+    FILE *file;
+    char *path;             // Arquivo do mapa, para a thread de arquivos abrir o dela
+    long *rowStart;         // Posicao de cada linha no arquivo
+    int *rowLength;         // Colunas de cada linha
+    int rows, cols;
+    int rowCapacity;
+    MapEntity *entities;    // Em ordem de linha, como no arquivo
+    int entityCount, entityCapacity;
+    int enemyCount, coinCount;
+    MapChunk chunks[MAP_RESIDENT_CHUNKS];
+    char *chunkMemory;      // Um bloco so para os tiles e as grades de todos os pedacos
+    char *mapping;          // Mapa compilado mapeado na memoria (NULL no mapa texto)
+    size_t mappingSize;
+    unsigned long chunkLoads;   // Pedacos lidos do disco
+    unsigned long chunkStalls;  // Pedacos lidos na hora, na thread do jogo, com um pedido a thread de arquivos ainda no caminho
+} TileMap;
+
+// Cabecalho do mapa compilado (map.bin). Depois dele vem a tabela de entidades e os pedacos, cada um com os
+// blocos e a grade de colisao no mesmo formato da memoria, para o jogo usar o arquivo mapeado sem converter nada
+typedef struct {
+    char magic[4];              // COMPILED_MAP_MAGIC
+    int version;                // COMPILED_MAP_VERSION
+    int rows, cols;
+    int chunkColumns;           // MAP_CHUNK_COLUMNS de quando foi compilado
+    int entityCount, enemyCount, coinCount;
+    long long entitiesOffset;   // Posicao da tabela de entidades no arquivo
+    long long tilesOffset;      // Posicao do primeiro pedaco
+} CompiledMapHeader;
 
-    // Inicia contagem das linhas e colunas em 0
-    *rows = 0;
-    *cols = 0;
+typedef struct {
+    int minX, minY;     // Primeira celula (coluna, linha) dentro da area
+    int maxX, maxY;     // Ultima celula (inclusiva); intervalo vazio se min > max
+} TileRange;
+
+// Face da celula por onde um retangulo em movimento entrou
+typedef enum {
+    FACE_NONE,          // Ja comecou sobrepondo a celula
+    FACE_LEFT,
+    FACE_RIGHT,
+    FACE_TOP,
+    FACE_BOTTOM
+} TileFace;
 
-    char line[MAX_WIDTH];  // buffer pra armazenar cada linha e coluna
-    while (fgets(line, sizeof(line), file)) { // Le linha por linha
-        size_t len = strlen(line);  // Recebe o comprimento da linha atual
-        if (line[len - 1] == '\n') line[len - 1] = '\0';  // Remove o caractere de nova linha
+typedef struct {
+    bool hit;           // Encontrou um bloco no caminho
+    int x, y;           // Celula atingida (coluna, linha)
+    TileFace face;      // Face da celula atingida
+    float time;         // Fracao do deslocamento percorrida ate o contato (0..1)
+} TileHit;
+
+// Tipos de entidade registradas no hash espacial
+typedef enum {
+    ENTITY_ENEMY,
+    ENTITY_COIN,
+    ENTITY_PROJECTILE,
+    ENTITY_TYPE_COUNT
+} EntityType;
+
+// Entidade registrada no hash: referencia (indice * ENTITY_TYPE_COUNT + tipo) e a celula dela. Celulas
+// diferentes podem cair no mesmo balde, entao a consulta confere a celula
+typedef struct {
+    int ref;
+    int cellX, cellY;
+} SpatialHashEntry;
 
-        // Copia linha pro array
-        strncpy(map[*rows], line, MAX_WIDTH);
+// Hash espacial uniforme reconstruido a cada frame. Cada entidade entra uma vez, na celula do
+// seu canto superior esquerdo; as entradas ficam ordenadas por balde (ordenacao por contagem).
+typedef struct {
+    int bucketStart[SPATIAL_HASH_BUCKETS + 1]; // Inicio de cada balde em entries
+    int *pendingBucket;  // Balde de cada entidade registrada neste frame
+    SpatialHashEntry *pending;  // Entidades na ordem em que foram registradas
+    SpatialHashEntry *entries;  // Entidades ordenadas por balde
+    int *chunkOffsets;   // Montagem em paralelo: posicao de escrita de cada pedaco em cada balde (MAX_JOB_THREADS x baldes)
+    int count;           // Entidades registradas
+    int capacity;        // Espaco reservado; cresce quando enche
+} SpatialHash;
+
+// Consulta em andamento: percorre as celulas da area uma a uma e devolve as entidades de cada uma. Nao ha
+// limite de resultados nem memoria extra, entao pode rodar em varias threads ao mesmo tempo
+typedef struct {
+    SpatialHash *hash;
+    EntityType type;
+    int minCellX, maxCellX, maxCellY;
+    int cellX, cellY;       // Celula atual
+    int entry, end;         // Proxima entrada e fim do balde da celula atual
+} SpatialHashQuery;
+
+// Estado do mundo num instante: jogador, inimigos, moedas e projeteis. Restaurado com copias em bloco
+// para recomecar a fase sem reler o mapa, e gravado em disco pelo quicksave
+typedef struct {
+    Player player;
+    EnemyStore enemies;
+    ProjectilePool projectiles;
+    Coin *coins;
+    int coinCount;
+    int coinCapacity;
+    bool captured;          // Ja guarda um estado
+} WorldSnapshot;
+
+// Cabecalho do quicksave. Depois dele vem o Player, os arrays dos inimigos, as moedas e os arrays dos projeteis
+typedef struct {
+    char magic[4];          // QUICKSAVE_MAGIC
+    int version;            // QUICKSAVE_VERSION
+    int rows, cols;         // Tamanho do mapa em que foi gravado
+    int enemyCount, enemyActiveCount;
+    int coinCount;
+    int projectileCount;
+} QuicksaveHeader;
+
+// Sessao gravada: a entrada de cada tick desde o comeco da fase e o hash acumulado do mundo a cada
+// REPLAY_HASH_INTERVAL ticks. Reproduzir as mesmas entradas a partir do mesmo mundo tem que dar os mesmos hashes
+typedef struct {
+    unsigned char *inputs;      // Bits de InputButton, um byte por tick
+    unsigned *checkpoints;      // Hash acumulado ao fim de cada REPLAY_HASH_INTERVAL ticks
+    int tickCount, tickCapacity;
+    int current;                // Proximo tick a reproduzir
+    unsigned hash;              // Hash acumulado dos ticks ja rodados
+    int divergedTick;           // Primeiro tick conferido que nao bateu com a gravacao (-1 se nenhum)
+    int extraEnemies;           // Inimigos extras do modo sem janela quando foi gravada
+    bool recording, playing;
+} InputReplay;
+
+// Cabecalho da gravacao. Depois dele vem as entradas em sequencias (bits, varint repeticoes - 1) e os hashes
+typedef struct {
+    char magic[4];              // REPLAY_MAGIC
+    int version;                // REPLAY_VERSION
+    int rows, cols;             // Tamanho do mapa em que foi gravada
+    int extraEnemies;
+    int tickCount;
+    int inputBytes;             // Bytes das entradas compactadas
+    int hashInterval;           // REPLAY_HASH_INTERVAL da gravacao
+} ReplayHeader;
+
+#ifndef HEADLESS
+// Camada de fundo repetida infinitamente; scrollFactor 1.0 acompanha o mundo, valores menores ficam mais ao fundo (parallax)
+typedef struct {
+    Texture2D texture;
+    float scrollFactor;
+    Color tint;
+} BackgroundLayer;
 
-        (*rows)++;  // Incrementa contagem da linha
-        if (len > *cols) *cols = len - 1;  // Atualiza contagem da coluna se a linha atual  maior do que a anterior
-    }
+// Textura com um pedaco de TERRAIN_CHUNK_TILES x TERRAIN_CHUNK_TILES blocos ja desenhado
+typedef struct {
+    RenderTexture2D target;
+    int chunkX, chunkY; // Pedaco desenhado nesta textura (chunkX -1 = livre)
+    bool loaded;        // target foi alocado
+    bool empty;         // Nao tem nenhum bloco para desenhar
+    unsigned long lastUse;  // Ultimo frame em que apareceu na tela
+} TerrainChunk;
+
+// Cache com TERRAIN_RESIDENT_CHUNKS texturas para os pedacos perto da camera
+typedef struct {
+    TerrainChunk chunks[TERRAIN_RESIDENT_CHUNKS];
+    int chunksX, chunksY;
+    unsigned long frame;
+} TerrainCache;
+
+// Sprites empacotados no atlas
+typedef enum {
+    SPRITE_BLOCK,
+    SPRITE_OBSTACLE,
+    SPRITE_GATE,
+    SPRITE_ENEMY,
+    SPRITE_HEART,
+    SPRITE_PLAYER,
+    SPRITE_WHITE,       // Pixel branco para desenhar retangulos coloridos sem trocar de textura
+    SPRITE_COUNT
+} SpriteId;
 
-    fclose(file);
+typedef struct {
+    Texture2D texture;
+    Rectangle sprites[SPRITE_COUNT];  // Regiao de cada sprite dentro da textura
+} TextureAtlas;
 
-    if (*rows <= 10 || *cols <= 200) {
-        printf("Mapa menor do que 200x10");
-        exit(1);
-    }
+typedef struct {
+    Rectangle source;   // Regiao dentro do atlas (largura negativa espelha)
+    Rectangle dest;     // Onde desenhar
+    Color tint;
+} SpriteDraw;
+
+// Lote de sprites que usam o mesmo atlas; tudo sai numa sequencia de desenhos sem troca de textura
+typedef struct {
+    TextureAtlas *atlas;
+    SpriteDraw *draws;
+    int count;
+    int flushes;        // Lotes enviados desde o ultimo ResetSpriteBatchStats
+    int submitted;      // Sprites enviados desde o ultimo ResetSpriteBatchStats
+} SpriteBatch;
+
+// Animacoes das folhas de sprites do jogador e dos inimigos
+typedef enum {
+    CLIP_PLAYER_IDLE,
+    CLIP_PLAYER_IDLE_SHOOT,
+    CLIP_PLAYER_RUN,
+    CLIP_PLAYER_RUN_SHOOT,
+    CLIP_PLAYER_JUMP,
+    CLIP_PLAYER_JUMP_SHOOT,
+    CLIP_ENEMY_WALK,
+    CLIP_COUNT
+} AnimationClipId;
+
+// Quadros [firstFrame, firstFrame + frameCount) da folha, cada um por frameDuration segundos, em loop
+typedef struct {
+    int firstFrame;
+    int frameCount;
+    float frameDuration;
+} AnimationClip;
+
+// Quadro de cada entidade calculado do clipe e do instante em que ele comecou, num passe so por frame e fora
+// do desenho. Nada e acumulado por entidade: o inicio do clipe dos inimigos sai do spawnId, e do jogador so
+// ficam o clipe atual e quando comecou
+typedef struct {
+    AnimationClip clips[CLIP_COUNT];
+    double time;                // Relogio das animacoes, em segundos
+    AnimationClipId playerClip;
+    double playerClipStart;
+    int playerFrame;
+    int *enemyFrames;           // Quadro de cada inimigo vivo, na ordem do EnemyStore
+    int enemyCapacity;
+} AnimationSystem;
+#endif
+
+// Um tick gravado no historico de rewind
+typedef struct {
+    int offset;             // Inicio dos bytes codificados em data
+    int size;               // Bytes codificados
+    int stateSize;          // Bytes do estado decodificado
+    bool keyframe;          // Codificado sozinho; os outros sao XOR com o tick anterior
+} RewindRecord;
+
+// Historico dos ultimos REWIND_TICKS ticks em memoria fixa. Cada tick guarda o estado do mundo como XOR com o
+// tick anterior, com as sequencias de zeros compactadas, e a cada REWIND_KEYFRAME_INTERVAL ticks um estado
+// completo, de onde a reconstrucao comeca. Os mais antigos sao descartados quando falta espaco
+typedef struct {
+    RewindRecord records[REWIND_TICKS];
+    int first, count;           // Registros do mais antigo (first) ao mais novo, circular
+    unsigned char *data;        // REWIND_BUFFER_BYTES usados em circulo
+    int writeOffset;
+    unsigned char *previous;    // Estado do registro mais novo, base do proximo XOR
+    int previousSize;
+    unsigned char *current;     // Rascunho do estado sendo gravado
+    unsigned char *delta;       // Rascunho do XOR entre os dois
+    unsigned char *encoded;     // Rascunho da codificacao
+    int maxStateSize;
+    int sinceKeyframe;          // Ticks desde o ultimo estado completo
+    long long recordedBytes;    // Total codificado, para a media por tick
+    long recordedTicks;
+} RewindBuffer;
+
+#ifdef PROFILER
+// Fases medidas pelo profiler. As de simulacao somam todos os ticks do frame; as de desenho medem
+// o tempo de CPU para montar e enviar os desenhos, nao o tempo da placa de video
+typedef enum {
+    PROFILE_SIMULATION,
+    PROFILE_MOVE_PLAYER,
+    PROFILE_MOVE_ENEMIES,
+    PROFILE_MOVE_PROJECTILES,
+    PROFILE_COLLISIONS,
+    PROFILE_REWIND,
+    PROFILE_ANIMATION,
+    PROFILE_TERRAIN_CACHE,
+    PROFILE_RENDER_BACKGROUND,
+    PROFILE_RENDER_PLAYER_COINS,
+    PROFILE_RENDER_MAP,
+    PROFILE_RENDER_PROJECTILES,
+    PROFILE_RENDER_ENEMIES,
+    PROFILE_HUD,
+    PROFILE_PHASE_COUNT
+} ProfilePhase;
+
+typedef struct {
+    double phaseTime[PROFILE_PHASE_COUNT];  // Segundos gastos em cada fase
+    double frameTime;                       // Do inicio deste frame ate o inicio do proximo
+    int ticks;                              // Ticks de simulacao rodados no frame
+} ProfileFrame;
+
+// Buffer circular com os ultimos PROFILER_FRAMES frames
+typedef struct {
+    ProfileFrame frames[PROFILER_FRAMES];
+    int current;            // Frame sendo medido
+    int count;              // Frames completos guardados (ate PROFILER_FRAMES - 1)
+    double frameStart;
+    bool visible;           // Overlay ligado (F3)
+} FrameProfiler;
+
+// Profiler unico do jogo, usado pelos marcadores de qualquer funcao
+FrameProfiler *GetFrameProfiler(void) {
+    static FrameProfiler profiler = {0};
+    return &profiler;
 }
 
-// Aplica calculo da gravidade
-void ApplyGravity(Player *player, float gravity, float dt) {
-    player->velocity.y += gravity * dt;
+void ProfilerAddTime(ProfilePhase phase, double seconds) {
+    FrameProfiler *profiler = GetFrameProfiler();
+    profiler->frames[profiler->current].phaseTime[phase] += seconds;
 }
 
-// Determina ou no se existe um spawnpoint para o jogador, caso sim, aplica as coordenadas encontradas no array x e y como ponto inicial do jogador
-bool FindPlayerSpawnPoint(char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, Player* player) {
-    for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            if (map[y][x] == 'P') { // letra P no mapa encontrada
-                player->spawnPoint = (Vector2){x * BLOCK_SIZE, y * BLOCK_SIZE};
-                player->position = player->spawnPoint;
-                player->rect.x = player->position.x;
-                player->rect.y = player->position.y;
+// Marcador de escopo: mede o bloco que vem depois e soma o tempo na fase. Sem -DPROFILER sobra so o bloco.
+// O tempo nao e somado se o bloco sair com return ou break
+#define PROFILE_SCOPE(phase) \
+    for (double profileStart = GetTime(), profileOnce = 1; profileOnce; profileOnce = 0, ProfilerAddTime(phase, GetTime() - profileStart))
 
+const char *GetProfilePhaseName(ProfilePhase phase) {
+    const char *names[PROFILE_PHASE_COUNT] = {
+        "Simulacao", "MovePlayer", "MoveEnemies", "MoveProjectiles", "HandleCollisions", "Rewind", "Animacao", "UpdateTerrainCache",
+        "RenderBackground", "Jogador e moedas", "RenderMap", "RenderProjectiles", "RenderEnemies", "Interface"
+    };
+    return names[phase];
+}
 
-                return true; // Existe spawnpoint
-            }
-        }
+// Fecha o frame anterior e comeca a medir um novo
+void ProfilerBeginFrame(FrameProfiler *profiler) {
+    double now = GetTime();
+    if (profiler->frameStart > 0) {
+        profiler->frames[profiler->current].frameTime = now - profiler->frameStart;
+        profiler->current = (profiler->current + 1) % PROFILER_FRAMES;
+        if (profiler->count < PROFILER_FRAMES - 1) profiler->count++;  // Uma posicao e sempre do frame em andamento
     }
-    return false; // Nenhuma letra P foi encontrada, nao existe spawnpoint
+    profiler->frameStart = now;
+    memset(&profiler->frames[profiler->current], 0, sizeof(ProfileFrame));
 }
 
-void UpdateEnemyAnimationState(Enemy *enemy, float *frameTimer, float frameSpeed, unsigned *currentFrame, Rectangle *frameRec, int frameWidth) {
-    *frameTimer += GetFrameTime();
-    if (*frameTimer >= frameSpeed) {
-        *frameTimer = 0.0f;
+// k-esimo frame completo, do mais antigo (0) ao mais recente (count - 1)
+ProfileFrame *GetProfileFrame(FrameProfiler *profiler, int k) {
+    return &profiler->frames[(profiler->current - profiler->count + k + PROFILER_FRAMES) % PROFILER_FRAMES];
+}
 
-        *currentFrame = (*currentFrame == 0) ? 1 : 0;
+// Frames guardados em CSV, do mais antigo ao mais recente, com os tempos em ms. Montado na memoria para a
+// thread de arquivos gravar; NULL se faltar memoria
+char *FormatProfilerCsv(FrameProfiler *profiler, size_t *size) {
+    size_t capacity = (size_t)(profiler->count + 1) * (PROFILE_PHASE_COUNT + 3) * 32;   // Sobra para qualquer campo
+    char *csv = malloc(capacity);
+    if (!csv) {
+        printf("Erro ao alocar o CSV do profiler!\n");
+        return NULL;
     }
 
-    frameRec->x = frameWidth * (*currentFrame);
-    frameRec->width = frameWidth;
-}
+    size_t length = snprintf(csv, capacity, "frame,frame_ms,ticks");
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+        length += snprintf(csv + length, capacity - length, ",%s", GetProfilePhaseName(phase));
+    }
+    length += snprintf(csv + length, capacity - length, "\n");
 
-void RenderBackground(Texture2D background, int rows, int cols) {
-    for (int i = 0; i < cols; i++) {
-        for (int j = 0; j < rows; j++) {
-            DrawTexture(background, i * background.width, j * background.height, BLUE);
+    for (int k = 0; k < profiler->count; k++) {
+        ProfileFrame *frame = GetProfileFrame(profiler, k);
+        length += snprintf(csv + length, capacity - length, "%d,%.4f,%d", k, frame->frameTime * 1000, frame->ticks);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+            length += snprintf(csv + length, capacity - length, ",%.4f", frame->phaseTime[phase] * 1000);
         }
+        length += snprintf(csv + length, capacity - length, "\n");
     }
-}
 
+    *size = length;
+    return csv;
+}
 
-// Renderiza moedas
-void RenderCoins(Coin coins[MAX_WIDTH], int coinCount) {
-    for (int i = 0; i < coinCount; i++) {
-        if (coins[i].active) {
-            DrawRectangleRec(coins[i].rect, YELLOW);  // Draw coin as a rectangle (yellow color)
+// Painel com media e pior tempo de cada fase e grafico do tempo de frame. Desenhado depois do EndMode2D
+void DrawProfilerOverlay(FrameProfiler *profiler) {
+    int lineHeight = 12;
+    int graphHeight = 60;
+    int panelWidth = PROFILER_FRAMES + 16;
+    int panelHeight = (PROFILE_PHASE_COUNT + 3) * lineHeight + graphHeight + 24;
+    int x = SCREEN_WIDTH - panelWidth - 10;
+    int y = 10;
+
+    double average[PROFILE_PHASE_COUNT] = {0};
+    double worst[PROFILE_PHASE_COUNT] = {0};
+    double averageFrame = 0;
+    double worstFrame = 0;
+    for (int k = 0; k < profiler->count; k++) {
+        ProfileFrame *frame = GetProfileFrame(profiler, k);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+            average[phase] += frame->phaseTime[phase] / profiler->count;
+            if (frame->phaseTime[phase] > worst[phase]) worst[phase] = frame->phaseTime[phase];
         }
+        averageFrame += frame->frameTime / profiler->count;
+        if (frame->frameTime > worstFrame) worstFrame = frame->frameTime;
     }
-}
 
-// Renderiza projeteis
-void RenderProjectiles(Projectile projectiles[MAX_PROJECTILES]) {
-    for (int i = 0; i < MAX_PROJECTILES; i++) {
-        if (projectiles[i].active) {
-            DrawRectangleRec(projectiles[i].rect, projectiles[i].color);
-        }
+    DrawRectangle(x, y, panelWidth, panelHeight, Fade(BLACK, 0.75f));
+    int textY = y + 6;
+    DrawText(TextFormat("Frame %.2f ms   pior %.2f ms   (%d frames)", averageFrame * 1000, worstFrame * 1000, profiler->count),
+             x + 8, textY, 10, WHITE);
+    textY += lineHeight + 4;
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+        DrawText(GetProfilePhaseName(phase), x + 8, textY, 10, LIGHTGRAY);
+        DrawText(TextFormat("%6.3f ms   pior %6.3f", average[phase] * 1000, worst[phase] * 1000), x + 130, textY, 10, WHITE);
+        textY += lineHeight;
     }
-}
 
-// Renderiza inimigos
-void RenderEnemies(Enemy enemies[MAX_ENEMIES], int enemyCount, float blockSize, Texture2D enemyTexture,
-                   Rectangle *enemyFrameRec, float *frameTimer, unsigned *currentFrame) {
-    for (int i = 0; i < enemyCount; i++) {
-        if (enemies[i].active) {
-            UpdateEnemyAnimationState(&enemies[i], frameTimer, 0.5f, currentFrame, enemyFrameRec, 16);
+    // Grafico do tempo de frame: uma barra por frame, escala ate 33 ms, linha em 16.7 ms (60 FPS)
+    int graphBottom = textY + 4 + graphHeight;
+    for (int k = 0; k < profiler->count; k++) {
+        double frameTime = GetProfileFrame(profiler, k)->frameTime;
+        int height = (int)(frameTime * 30.0 * graphHeight);
+        if (height > graphHeight) height = graphHeight;
+        Color color = frameTime <= 1.0 / 55 ? GREEN : (frameTime <= 1.0 / 30 ? YELLOW : RED);
+        DrawLine(x + 8 + k, graphBottom, x + 8 + k, graphBottom - height, color);
+    }
+    DrawLine(x + 8, graphBottom - graphHeight / 2, x + 8 + PROFILER_FRAMES, graphBottom - graphHeight / 2, Fade(WHITE, 0.5f));
 
-            Rectangle destRect = {enemies[i].position.x, enemies[i].position.y, enemyFrameRec->width, enemyFrameRec->height};
+    DrawText("F3 esconde   F4 exporta CSV", x + 8, graphBottom + 4, 10, LIGHTGRAY);
+}
+#else
+#define PROFILE_SCOPE(phase)
+#endif
+
+// Guarda o inicio e o tamanho de mais uma linha do arquivo
+bool AddMapRow(TileMap *map, long start, int length) {
+    if (map->rows == MAX_MAP_ROWS) {
+        printf("Erro: mapa com mais de %d linhas!\n", MAX_MAP_ROWS);
+        return false;
+    }
+    if (map->rows == map->rowCapacity) {
+        int capacity = map->rowCapacity ? map->rowCapacity * 2 : 64;
+        long *rowStart = realloc(map->rowStart, capacity * sizeof(long));
+        if (rowStart) map->rowStart = rowStart;
+        int *rowLength = realloc(map->rowLength, capacity * sizeof(int));
+        if (rowLength) map->rowLength = rowLength;
+        if (!rowStart || !rowLength) {
+            printf("Erro ao alocar as linhas do mapa!\n");
+            return false;
+        }
+        map->rowCapacity = capacity;
+    }
 
-            DrawTexturePro(
-                enemyTexture,
-                *enemyFrameRec,
-                destRect,
-                (Vector2){0, 0},
-                0.0f,
-                WHITE
-            );
+    map->rowStart[map->rows] = start;
+    map->rowLength[map->rows] = length;
+    map->rows++;
+    if (length > map->cols) map->cols = length;
+    return true;
+}
+
+bool AddMapEntity(TileMap *map, int x, int y, char tile) {
+    if (map->entityCount == map->entityCapacity) {
+        int capacity = map->entityCapacity ? map->entityCapacity * 2 : 256;
+        MapEntity *entities = realloc(map->entities, capacity * sizeof(MapEntity));
+        if (!entities) {
+            printf("Erro ao alocar as entidades do mapa!\n");
+            return false;
         }
+        map->entities = entities;
+        map->entityCapacity = capacity;
     }
+
+    map->entities[map->entityCount++] = (MapEntity){x, y, tile};
+    if (tile == 'M') map->enemyCount++;
+    if (tile == 'C') map->coinCount++;
+    return true;
 }
 
-// Renderiza mapa
-void RenderMap(char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, float blockSize, Texture2D blockTexture, Texture2D obstacleTexture, Texture2D gateTexture) {
-    for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            if (map[y][x] == 'B') {
-                Rectangle destRect = {x * blockSize, y * blockSize, blockSize, blockSize};
-                DrawTexturePro(blockTexture, (Rectangle){0, 0, blockTexture.width, blockTexture.height}, destRect, (Vector2){0, 0}, 0.0f, WHITE);
-            } else if (map[y][x] == 'O') {
-                Rectangle destRect = {x * blockSize, y * blockSize, blockSize, blockSize};
-                DrawTexturePro(obstacleTexture, (Rectangle){0, 0, obstacleTexture.width, obstacleTexture.height}, destRect, (Vector2){0, 0}, 0.0f, WHITE);
-            } else if (map[y][x] == 'G') {
-                Rectangle destRect = {x * blockSize, y * blockSize - 16, blockSize * 2, blockSize * 2};
-                DrawTexturePro(gateTexture, (Rectangle) {0, 0, gateTexture.width, gateTexture.height}, destRect, (Vector2){0, 0}, 0.0f, WHITE);
-            }
+// Mapeia o arquivo inteiro na memoria. As paginas sao lidas do disco so quando usadas e escritas ficam so
+// neste processo (copia ao escrever). NULL se falhar
+char *MapFileIntoMemory(const char *filename, size_t *size) {
+    char *memory = NULL;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping) {
+            memory = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);   // A visao continua valida ate o UnmapViewOfFile
         }
+        *size = (size_t)fileSize.QuadPart;
+    }
+    CloseHandle(file);
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0) return NULL;
+
+    struct stat info;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        memory = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        if (memory == MAP_FAILED) memory = NULL;
+        *size = info.st_size;
     }
+    close(file);    // O mapeamento continua valido ate o munmap
+#endif
+    return memory;
 }
 
-// Inicializacao do jogador
-Player InitializePlayer() {
-    Player player = {
-        {0, 0},
-        {0, 0},
-        {0, 0, 32, 32},
-        false,
-        true,
-        false,
-        3,
-        0,
-        " \n",
-        0
-    };
-    return player;
+void UnmapFileMemory(char *memory, size_t size) {
+#if defined(_WIN32)
+    UnmapViewOfFile(memory);
+#else
+    munmap(memory, size);
+#endif
 }
 
-// Inicializacao da camera
-Camera2D InitializeCamera(Player *player) {
-    Camera2D camera = {0};
-    camera.target = (Vector2) {
-        player->position.x + player->rect.width / 2, player->position.y + player->rect.height / 2
-    };
-    camera.offset = (Vector2) {
-        SCREEN_WIDTH / 2.0f, SCREEN_HEIGHT / 2.0f
-    };
-    camera.zoom = 2.0f;
-    return camera;
+// Palavras da grade de colisao de um pedaco com rows linhas (as tres camadas, MAP_CHUNK_WORDS * rows cada)
+size_t GetChunkCollisionWords(int rows) {
+    return 3 * (size_t)MAP_CHUNK_WORDS * rows;
 }
 
-// Inicializacao das texturas do jogador
-void InitializePlayerTextureAndAnimation(Texture2D *infmanTex, Rectangle *frameRec, int *frameWidth, Texture2D *enemyTex, Rectangle *enemyFrameRec, int *enemyFrameWidth) {
-    *infmanTex = LoadTexture("player-sheet.png");
-    *frameWidth = infmanTex->width / 12;
-    *frameRec = (Rectangle){0.0f, 0.0f, (float)(*frameWidth), (float)infmanTex->height};
+// Bytes de um pedaco: os blocos e, logo depois, a grade de colisao. Igual na memoria e no mapa compilado
+size_t GetMapChunkBytes(int rows) {
+    return (size_t)rows * MAP_CHUNK_COLUMNS + GetChunkCollisionWords(rows) * sizeof(unsigned long long);
+}
 
-    *enemyTex = LoadTexture("enemies.png");
-    *enemyFrameWidth = enemyTex->width / 2;
-    *enemyFrameRec = (Rectangle){0.0f, 0.0f, (float)(*enemyFrameWidth), (float)enemyTex->height};
+// Aponta os blocos e as camadas da grade do pedaco para payload, com GetMapChunkBytes bytes
+void SetMapChunkPayload(MapChunk *chunk, char *payload, int rows) {
+    size_t layerWords = (size_t)MAP_CHUNK_WORDS * rows;
+    chunk->tiles = payload;
+    chunk->collision.solid = (unsigned long long *)(payload + (size_t)rows * MAP_CHUNK_COLUMNS);
+    chunk->collision.occupied = chunk->collision.solid + layerWords;
+    chunk->collision.solidColumns = chunk->collision.occupied + layerWords;
 }
 
-// Inicializacao dos projeteis
-void InitializeProjectiles(Projectile projectiles[MAX_PROJECTILES]) {
-    for (int i = 0; i < MAX_PROJECTILES; i++) {
-        projectiles[i].active = false;
-    }
+// Atualiza os bits da celula (coluna c do pedaco, linha y) para o bloco tile
+void SetCollisionCell(CollisionGrid *grid, int rows, int c, int y, char tile) {
+    bool solid = (tile == 'B');
+    bool occupied = solid || tile == 'O' || tile == 'G';
+    unsigned long long rowBit = 1ULL << (c & 63);
+    size_t rowWord = (size_t)y * MAP_CHUNK_WORDS + (c >> 6);
+    size_t columnIndex = (size_t)c * rows + y;
+    unsigned long long columnBit = 1ULL << (columnIndex & 63);
+    size_t columnWord = columnIndex >> 6;
+
+    grid->solid[rowWord] = solid ? (grid->solid[rowWord] | rowBit) : (grid->solid[rowWord] & ~rowBit);
+    grid->occupied[rowWord] = occupied ? (grid->occupied[rowWord] | rowBit) : (grid->occupied[rowWord] & ~rowBit);
+    grid->solidColumns[columnWord] = solid ? (grid->solidColumns[columnWord] | columnBit) : (grid->solidColumns[columnWord] & ~columnBit);
 }
 
-// Encontra instancias da letra "M" no arquivo e criar inimigos pra cada uma delas
-int InitializeEnemies(char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, Enemy enemies[MAX_WIDTH], float blockSize, float enemySpeedX, float enemySpeedY, float offset) {
-    int enemyCount = 0;
+// Posicao do bit 1 mais baixo e do mais alto de word (word diferente de zero)
+int LowestSetBit(unsigned long long word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
 
+int HighestSetBit(unsigned long long word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+// Mascaras de ate 64 celulas a partir dos caracteres: bit i em solid se tiles[i] e bloco e em occupied se e
+// bloco, obstaculo ou portao. Com SSE2 compara 16 caracteres por instrucao
+void PackTileMasks(const char *tiles, int count, unsigned long long *solid, unsigned long long *occupied) {
+    unsigned long long solidMask = 0;
+    unsigned long long occupiedMask = 0;
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i block = _mm_set1_epi8('B');
+    __m128i obstacle = _mm_set1_epi8('O');
+    __m128i gate = _mm_set1_epi8('G');
+    for (; i + 16 <= count; i += 16) {
+        __m128i tile = _mm_loadu_si128((const __m128i *)(tiles + i));
+        __m128i isBlock = _mm_cmpeq_epi8(tile, block);
+        __m128i isOccupied = _mm_or_si128(isBlock, _mm_or_si128(_mm_cmpeq_epi8(tile, obstacle), _mm_cmpeq_epi8(tile, gate)));
+        solidMask |= (unsigned long long)(unsigned)_mm_movemask_epi8(isBlock) << i;
+        occupiedMask |= (unsigned long long)(unsigned)_mm_movemask_epi8(isOccupied) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        solidMask |= (unsigned long long)(tiles[i] == 'B') << i;
+        occupiedMask |= (unsigned long long)(tiles[i] == 'B' || tiles[i] == 'O' || tiles[i] == 'G') << i;
+    }
+    *solid = solidMask;
+    *occupied = occupiedMask;
+}
+
+// Monta a grade de colisao do pedaco a partir dos blocos dele: 64 caracteres viram uma palavra de cada camada
+// de linha, e cada bloco acende um bit na camada por coluna
+void BuildChunkCollision(const char *tiles, CollisionGrid *grid, int rows) {
+    memset(grid->solidColumns, 0, (size_t)MAP_CHUNK_WORDS * rows * sizeof(unsigned long long));
     for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            if (map[y][x] == 'M') {
-                enemies[enemyCount].position = (Vector2){x * blockSize, y * blockSize};
-                enemies[enemyCount].velocity = (Vector2){enemySpeedX, enemySpeedY}; // Velocidade do inimigo
-                //LINHA PARA MUDAR ABAIXO
-                enemies[enemyCount].rect = (Rectangle){enemies[enemyCount].position.x, enemies[enemyCount].position.y, blockSize, blockSize};
-                enemies[enemyCount].minPosition = enemies[enemyCount].position; // Posicao minimia  o spawnpoint
-                enemies[enemyCount].maxPosition = (Vector2){enemies[enemyCount].position.x + offset, enemies[enemyCount].position.y}; // Posicao maxima
-                enemies[enemyCount].health = 1; // Vida que comea
-                enemies[enemyCount].active = true; // Inimigo  ativado
-                enemyCount++;
+        for (int w = 0; w < MAP_CHUNK_WORDS; w++) {
+            size_t word = (size_t)y * MAP_CHUNK_WORDS + w;
+            PackTileMasks(&tiles[y * MAP_CHUNK_COLUMNS + w * 64], 64, &grid->solid[word], &grid->occupied[word]);
+            for (unsigned long long bits = grid->solid[word]; bits; bits &= bits - 1) {
+                size_t columnIndex = (size_t)((w << 6) + LowestSetBit(bits)) * rows + y;
+                grid->solidColumns[columnIndex >> 6] |= 1ULL << (columnIndex & 63);
             }
         }
     }
+}
 
-    return enemyCount;
+void UnloadMap(TileMap *map) {
+    if (map->file) fclose(map->file);
+    if (map->mapping) {
+        UnmapFileMemory(map->mapping, map->mappingSize);    // Entidades e pedacos estavam no arquivo mapeado
+    } else {
+        free(map->entities);
+    }
+    free(map->chunkMemory);
+    free(map->path);
+    free(map->rowStart);
+    free(map->rowLength);
+    memset(map, 0, sizeof(*map));
 }
 
-// Inicializa as moedas no mapa
-int InitializeCoins(char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, Coin coins[MAX_WIDTH], float blockSize) {
-    int coinCount = 0;
+// Abre o mapa texto: le o arquivo uma vez para achar onde comeca cada linha e onde estao as entidades. Os
+// blocos e a grade de colisao de cada pedaco so sao montados quando alguem consulta o pedaco
+bool LoadTextMap(const char* filename, TileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->file = fopen(filename, "rb");  // Binario: as posicoes de fseek precisam bater com os bytes do arquivo
+    if (!map->file) {
+        perror("Failed to open file");
+        return false;
+    }
 
-    for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            if (map[y][x] == 'C') { // Moeda no mapa
-                coins[coinCount].position = (Vector2)
-                {
-                    x * blockSize, y * blockSize
-                };
-                coins[coinCount].rect = (Rectangle)
-                {
-                    coins[coinCount].position.x, coins[coinCount].position.y, blockSize, blockSize
-                };
-                coins[coinCount].active = true; // Marca a moeda como ativa
-                coins[coinCount].points = 10; // A moeda d 10
-                coinCount++;
+    char buffer[65536];
+    long position = 0;  // Posicao no arquivo do caractere atual
+    long rowStart = 0;
+    int x = 0;          // Coluna atual
+    size_t bytes;
+    bool ok = true;
+    while (ok && (bytes = fread(buffer, 1, sizeof(buffer), map->file)) > 0) {
+        for (size_t i = 0; i < bytes && ok; i++, position++) {
+            if (buffer[i] == '\n') {
+                ok = AddMapRow(map, rowStart, x);
+                rowStart = position + 1;
+                x = 0;
+            } else if (buffer[i] != '\r') {  // '\r' so aparece no fim da linha (arquivo salvo no Windows)
+                if (buffer[i] == 'P' || buffer[i] == 'M' || buffer[i] == 'C') {
+                    ok = AddMapEntity(map, x, map->rows, buffer[i]);
+                }
+                x++;
             }
         }
     }
+    if (ok && x > 0) ok = AddMapRow(map, rowStart, x);  // Ultima linha sem '\n'
 
-    return coinCount;
+    if (ok) {
+        map->chunkMemory = malloc((size_t)MAP_RESIDENT_CHUNKS * GetMapChunkBytes(map->rows));
+        if (!map->chunkMemory) {
+            printf("Erro ao alocar os pedacos do mapa!\n");
+            ok = false;
+        }
+    }
+    for (int c = 0; c < MAP_RESIDENT_CHUNKS && ok; c++) {
+        map->chunks[c].index = -1;
+        map->chunks[c].requested = -1;
+        SetMapChunkPayload(&map->chunks[c], &map->chunkMemory[(size_t)c * GetMapChunkBytes(map->rows)], map->rows);
+    }
+    if (!ok) {
+        UnloadMap(map);
+        return false;
+    }
+    return true;
 }
 
-void HandleRespawn(Player *player, float screenHeight) {
-    if (player->position.y > screenHeight) {
-        player->position = player->spawnPoint;
-        player->velocity = (Vector2){0, 0};
-        player->health -= 1;
+// Confere o cabecalho e a tabela de entidades do mapa compilado mapeado em mapping: versao, tamanhos, secoes
+// depois do cabecalho e dentro do arquivo, e entidades dentro do mapa batendo com as contagens do cabecalho
+// (o jogo aloca inimigos e moedas por elas). Cada posicao e comparada com o tamanho antes de qualquer conta,
+// para um cabecalho forjado nao estourar as somas
+bool IsCompiledMapValid(const char *mapping, size_t mappingSize) {
+    long long size = mappingSize;
+    if (size < (long long)sizeof(CompiledMapHeader)) return false;
+
+    const CompiledMapHeader *header = (const CompiledMapHeader *)mapping;
+    long long minOffset = sizeof(CompiledMapHeader);
+    if (header->version != COMPILED_MAP_VERSION ||
+            header->chunkColumns != MAP_CHUNK_COLUMNS ||
+            header->rows <= 0 || header->rows > MAX_MAP_ROWS || header->cols <= 0 ||
+            header->entityCount < 0 || header->enemyCount < 0 || header->coinCount < 0 ||
+            header->entitiesOffset < minOffset || header->tilesOffset < minOffset ||
+            header->entitiesOffset % sizeof(int) != 0 ||
+            header->tilesOffset % sizeof(unsigned long long) != 0) {
+        return false;
     }
-}
 
-// Aplica movimento para o jogador conforme a tecla pressionada
-void CheckPressedKey(Player *player, float moveSpeed, float jumpForce) {
-    player->velocity.x = 0;
+    // rows <= MAX_MAP_ROWS e cols <= INT_MAX: chunkCount * GetMapChunkBytes(rows) cabe em long long
+    long long chunkCount = ((long long)header->cols + MAP_CHUNK_COLUMNS - 1) / MAP_CHUNK_COLUMNS;
+    if (header->entitiesOffset > size || header->entityCount > (size - header->entitiesOffset) / (long long)sizeof(MapEntity) ||
+            header->tilesOffset > size || chunkCount * (long long)GetMapChunkBytes(header->rows) > size - header->tilesOffset) {
+        return false;
+    }
 
-    if (IsKeyDown(KEY_RIGHT)) {
-        player->velocity.x = moveSpeed;
-        player->facingRight = true;
+    const MapEntity *entities = (const MapEntity *)(mapping + header->entitiesOffset);
+    int enemies = 0, coins = 0;
+    for (int i = 0; i < header->entityCount; i++) {
+        const MapEntity *entity = &entities[i];
+        if (entity->x < 0 || entity->y < 0 || entity->x >= header->cols || entity->y >= header->rows) return false;
+        if (entity->tile == 'M') enemies++;
+        else if (entity->tile == 'C') coins++;
+        else if (entity->tile != 'P') return false;
     }
-    if (IsKeyDown(KEY_LEFT)) {
-        player->velocity.x = -moveSpeed;
-        player->facingRight = false;
+    return enemies == header->enemyCount && coins == header->coinCount;
+}
+
+// Abre o mapa compilado: so confere o cabecalho e as entidades. Entidades e blocos sao usados direto do arquivo mapeado
+bool LoadCompiledMap(const char *filename, TileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->mapping = MapFileIntoMemory(filename, &map->mappingSize);
+    if (!map->mapping) {
+        printf("Erro ao mapear %s!\n", filename);
+        return false;
     }
-    if (IsKeyPressed(KEY_SPACE) && player->isGrounded) {
-        player->velocity.y = jumpForce;
-        player->isGrounded = false;
+    CompiledMapHeader *header = (CompiledMapHeader *)map->mapping;
+
+    if (!IsCompiledMapValid(map->mapping, map->mappingSize)) {
+        printf("Mapa compilado %s invalido ou de outra versao; compile de novo a partir do mapa texto\n", filename);
+        UnloadMap(map);
+        return false;
     }
+
+    map->rows = header->rows;
+    map->cols = header->cols;
+    map->entities = (MapEntity *)(map->mapping + header->entitiesOffset);
+    map->entityCount = header->entityCount;
+    map->entityCapacity = header->entityCount;
+    map->enemyCount = header->enemyCount;
+    map->coinCount = header->coinCount;
+    for (int c = 0; c < MAP_RESIDENT_CHUNKS; c++) {
+        map->chunks[c].index = -1;
+        map->chunks[c].requested = -1;
+    }
+    return true;
 }
 
-// Cria projetil com coordenadas baseadas na posio atual do jogador e aplica estado do jogador estar atirando durante 0.5 segundos
-void CreateProjectile(Player *player, Projectile projectiles[MAX_PROJECTILES], float projectileWidth, float projectileHeight, float projectileSpeed, float dt) {
-    static float shootTimer = 0.0f;
-    float animationDuration = 0.5;
+// Abre o mapa texto (map.txt) ou compilado (map.bin); o formato vem dos primeiros bytes do arquivo
+bool LoadMap(const char* filename, TileMap *map) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror("Failed to open file");
+        return false;
+    }
+    char magic[4] = {0};
+    bool compiled = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, COMPILED_MAP_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
 
-    if (IsKeyPressed(KEY_Z)) {
-        player->isShooting = true;
+    if (!(compiled ? LoadCompiledMap(filename, map) : LoadTextMap(filename, map))) {
+        return false;
+    }
+    map->path = malloc(strlen(filename) + 1);
+    if (!map->path) {
+        printf("Erro ao alocar o caminho do mapa!\n");
+        UnloadMap(map);
+        return false;
+    }
+    strcpy(map->path, filename);
 
-        for (int i = 0; i < MAX_PROJECTILES; i++) {
-            if (!projectiles[i].active) {
-
-                projectiles[i].rect = (Rectangle) {
-                    player->position.x + (player->facingRight ? player->rect.width : -projectileWidth),
-                    player->position.y + player->rect.height / 2 - projectileHeight / 2,
-                    projectileWidth,
-                    projectileHeight
-                };
-                projectiles[i].speed = (Vector2) {
-                    player->facingRight ? projectileSpeed : -projectileSpeed, 0
-                };
-                projectiles[i].color = YELLOW;
-                projectiles[i].active = true;
-                break;
-            }
-        }
+    if (map->rows <= 10 || map->cols <= 200) {
+        printf("Mapa menor do que 200x10");
+        exit(1);
     }
+    return true;
+}
 
-    if (IsKeyPressed(KEY_X)) {
-        player->isShooting = true;
+// Pedaco index do mapa compilado (blocos e grade), dentro do arquivo mapeado
+char *GetCompiledMapChunk(TileMap *map, int index) {
+    CompiledMapHeader *header = (CompiledMapHeader *)map->mapping;
+    return map->mapping + header->tilesOffset + (size_t)index * GetMapChunkBytes(map->rows);
+}
 
-        for (int i = 0; i < MAX_PROJECTILES; i++) {
-            if (!projectiles[i].active) {
-                projectiles[i].rect = (Rectangle){
-                    player->position.x + (player->facingRight ? player->rect.width : -projectileHeight),
-                    player->position.y + player->rect.height / 2 - projectileWidth / 2,
-                    projectileHeight,
-                    projectileWidth
-                };
-                if(player->isGrounded) {
-                    projectiles[i].speed = (Vector2){0,-400};
-                } else {
-                    projectiles[i].speed = (Vector2){0,400};
-                }
-                projectiles[i].active = true;
-                projectiles[i].color = BLUE; // Blue projectile
-                break;
-            }
+// Le de file as colunas do pedaco index do mapa texto, de todas as linhas, nos blocos de chunk e monta a grade
+// dele; o que passa do fim da linha fica vazio ('\0'). O jogo usa map->file e a thread de arquivos, um FILE so dela
+void ReadTextMapChunk(TileMap *map, FILE *file, int index, MapChunk *chunk) {
+    int firstColumn = index * MAP_CHUNK_COLUMNS;
+
+    memset(chunk->tiles, '\0', (size_t)map->rows * MAP_CHUNK_COLUMNS);
+    for (int y = 0; y < map->rows; y++) {
+        int count = map->rowLength[y] - firstColumn;
+        if (count > MAP_CHUNK_COLUMNS) count = MAP_CHUNK_COLUMNS;
+        if (count > 0) {
+            fseek(file, map->rowStart[y] + firstColumn, SEEK_SET);
+            fread(&chunk->tiles[y * MAP_CHUNK_COLUMNS], 1, count, file);
         }
     }
+    BuildChunkCollision(chunk->tiles, &chunk->collision, map->rows);
+}
 
-    if (player->isShooting) {
-        shootTimer += dt;
-        if (shootTimer >= animationDuration) {
-            player->isShooting = false;
-            shootTimer = 0.0f;
-        }
+// Le do disco as colunas do pedaco index, na hora, na thread de quem chamou
+void LoadMapChunk(TileMap *map, MapChunk *chunk, int index) {
+    if (map->mapping) {     // Mapa compilado: o pedaco ja esta pronto no arquivo mapeado
+        SetMapChunkPayload(chunk, GetCompiledMapChunk(map, index), map->rows);
+    } else {
+        ReadTextMapChunk(map, map->file, index, chunk);
+    }
+
+    chunk->index = index;
+    chunk->requested = -1;  // Um pedido ainda no caminho para esta posicao chega atrasado e e descartado
+    chunk->modified = false;
+    map->chunkLoads++;
+}
+
+// Tira o pedaco da posicao para outro entrar. No mapa texto as alteracoes (blocos e grade) se perdem
+void DiscardMapChunk(TileMap *map, MapChunk *chunk) {
+    if (chunk->modified && !map->mapping) {     // No arquivo mapeado a alteracao continua na memoria
+        printf("Aviso: alteracoes no pedaco %d do mapa descartadas\n", chunk->index);
     }
 }
 
-// Move camera de acordo com posio do jogador
-void MoveCamera(Camera2D *camera, Player *player) {
-    camera->target = (Vector2)
-    {
-        player->position.x + player->rect.width / 2, SCREEN_HEIGHT / 2 - 110
-    };
+// Le na hora o pedaco index para a posicao chunk, como ultimo recurso, no lugar do que estava nela
+void ReplaceMapChunk(TileMap *map, MapChunk *chunk, int index) {
+    if (chunk->requested == index) map->chunkStalls++;
+    DiscardMapChunk(map, chunk);
+    LoadMapChunk(map, chunk, index);
 }
 
-// Move jogador com base na velocidade multiplicada pelo frame atual
-void MovePlayer(Player *player, float moveSpeed, float jumpForce, float dt) {
-    CheckPressedKey(player, moveSpeed, jumpForce);
-    player->position.x += player->velocity.x * dt;
-    player->position.y += player->velocity.y * dt;
-    player->rect.x = player->position.x;
-    player->rect.y = player->position.y;
+// Pedaco index na memoria. Normalmente ja chegou pela thread de arquivos (QueueMapColumns); se nao, e lido
+// na hora. Curta de proposito: toda consulta a grade de colisao passa por aqui
+MapChunk *GetMapChunk(TileMap *map, int index) {
+    MapChunk *chunk = &map->chunks[index & (MAP_RESIDENT_CHUNKS - 1)];
+    if (chunk->index != index) ReplaceMapChunk(map, chunk, index);
+    return chunk;
 }
 
-// Move os inimigos com base na velocidade multiplicada pelo frame atual
-void MoveEnemies(Enemy* enemies, int enemyCount, float dt) {
-    for (int i = 0; i < enemyCount; i++) {
-        // Faz o inimigo ir e voltar
-        if (enemies[i].position.x <= enemies[i].minPosition.x || enemies[i].position.x >= enemies[i].maxPosition.x) {
-            enemies[i].velocity.x = -enemies[i].velocity.x; // Inverte direo
-        }
-        enemies[i].position.x += enemies[i].velocity.x * dt;
-        enemies[i].rect.x = enemies[i].position.x;
-        enemies[i].rect.y = enemies[i].position.y;
+// Pedaco index lido na thread de arquivos (IO_READ_MAP_CHUNK). Mapa texto: blocos e grade num buffer novo em
+// data, lidos por um FILE so da thread. Mapa compilado: so passa pelas paginas do pedaco, para o disco ser lido
+// aqui e nao na thread do jogo; data fica NULL
+bool ReadQueuedMapChunk(TileMap *map, int index, char **data, size_t *size) {
+    size_t bytes = GetMapChunkBytes(map->rows);
+    *data = NULL;
+    *size = 0;
+
+    if (map->mapping) {
+        volatile const char *tiles = GetCompiledMapChunk(map, index);
+        char touched = 0;
+        for (size_t i = 0; i < bytes; i += 4096) touched ^= tiles[i];
+        touched ^= tiles[bytes - 1];
+        (void)touched;
+        return true;
+    }
+
+    FILE *file = fopen(map->path, "rb");
+    char *payload = malloc(bytes);
+    if (!file || !payload) {
+        if (file) fclose(file);
+        free(payload);
+        return false;
     }
+    MapChunk chunk;
+    SetMapChunkPayload(&chunk, payload, map->rows);
+    ReadTextMapChunk(map, file, index, &chunk);
+    fclose(file);
+    *data = payload;
+    *size = bytes;
+    return true;
 }
 
-// Desativa projeteis quando batem em um bloco
-void CheckProjectileBlockCollision(Projectile *projectile, Rectangle block) {
-    if (CheckCollisionRecs(projectile->rect, block)) {
-        projectile->active = false;
+// Poe na posicao dele o pedaco que a thread de arquivos leu (payload com blocos e grade), na thread do jogo.
+// Descartado se a posicao foi pedida para outro pedaco depois ou se o pedaco ja foi lido na hora
+void InstallMapChunk(TileMap *map, int index, const char *payload) {
+    MapChunk *chunk = &map->chunks[index & (MAP_RESIDENT_CHUNKS - 1)];
+    if (chunk->requested != index) return;
+    chunk->requested = -1;
+    if (chunk->index == index) return;
+
+    DiscardMapChunk(map, chunk);
+    if (map->mapping) {
+        SetMapChunkPayload(chunk, GetCompiledMapChunk(map, index), map->rows);
+    } else {
+        memcpy(chunk->tiles, payload, GetMapChunkBytes(map->rows));    // Na posicao a grade vem logo depois dos blocos
     }
+    chunk->index = index;
+    chunk->modified = false;
+    map->chunkLoads++;
 }
 
-// Move projeteis quanndo disparados
-void MoveProjectiles(Projectile projectiles[MAX_PROJECTILES], float dt, Player* player, int screenWidth, char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, float blockSize) {
-    for (int i = 0; i < MAX_PROJECTILES; i++) {
-        if (projectiles[i].active) {
-            // Movimento do projetil
-            projectiles[i].rect.x += projectiles[i].speed.x * dt;
-            projectiles[i].rect.y += projectiles[i].speed.y * dt;
-
-            // Desativa se vai pra fora da tela
-            if (projectiles[i].rect.x < player->position.x - screenWidth ||
-                    projectiles[i].rect.x > player->position.x + screenWidth ||
-                    projectiles[i].rect.y < player->position.y - screenWidth ||
-                    projectiles[i].rect.y > player->position.y + screenWidth)
-            {
-                projectiles[i].active = false;
-            }
+// Bloco na coluna x, linha y; fora do mapa e vazio ('\0')
+char GetMapTile(TileMap *map, int x, int y) {
+    if (x < 0 || y < 0 || x >= map->cols || y >= map->rows) return '\0';
 
-            // Verifica colisao com blocos
-            for (int y = 0; y < rows; y++) {
-                for (int x = 0; x < cols; x++) {
-                    if (map[y][x] == 'B') {  // Verifica bloco a bloco ate achar um
-                        Rectangle block = {x * blockSize, y * blockSize, blockSize, blockSize};
-                        CheckProjectileBlockCollision(&projectiles[i], block);
-                    }
-                }
-            }
-        }
-    }
+    MapChunk *chunk = GetMapChunk(map, x / MAP_CHUNK_COLUMNS);
+    return chunk->tiles[y * MAP_CHUNK_COLUMNS + x % MAP_CHUNK_COLUMNS];
 }
 
+// Troca um bloco. A mudanca vale enquanto o pedaco estiver na memoria (ate o jogador se afastar MAP_RESIDENT_CHUNKS pedacos)
+void WriteMapTile(TileMap *map, int x, int y, char tile) {
+    if (x < 0 || y < 0 || x >= map->cols || y >= map->rows) return;
 
-// Colisao entre jogador e moeda
-void CheckPlayerCoinCollision(Player* player, Coin* coins, int* coinCount) {
-    for (int i = 0; i < *coinCount; i++) {
-        if (coins[i].active && CheckCollisionRecs(player->rect, coins[i].rect)) {
-            player->points += coins[i].points;
-            coins[i].active = false;
-            printf("Points: %d\n", player->points);
-        }
-    }
+    MapChunk *chunk = GetMapChunk(map, x / MAP_CHUNK_COLUMNS);
+    chunk->tiles[y * MAP_CHUNK_COLUMNS + x % MAP_CHUNK_COLUMNS] = tile;
+    chunk->modified = true;
+    SetCollisionCell(&chunk->collision, map->rows, x % MAP_CHUNK_COLUMNS, y, tile);
 }
 
-// Verifica coliso entre o projtil e inimigo
-void CheckProjectileEnemyCollision(Projectile* projectiles, int* enemyCount, Enemy* enemies, Player* player) {
-    for (int i = 0; i < MAX_PROJECTILES; i++) {
-        if (projectiles[i].active) {
-            for (int j = 0; j < *enemyCount; j++) {
-                if (enemies[j].active && CheckCollisionRecs(projectiles[i].rect, enemies[j].rect)) {
-                    // Coliso detectada reduz a vida do inimigo
-                    enemies[j].health -= 1;  // Diminui a vida
-                    player->points += 100;
-                    if (enemies[j].health <= 0)
-                    {
-                        enemies[j].health = 0;
-                        enemies[j].active = false; // Desativa o inimigo se a vida chegar a 0
-                    }
-                    projectiles[i].active = false;  // Desativa projetil aps coliso
-                    break;
-                }
-            }
-        }
+// Garante na memoria os pedacos das colunas [minX, maxX], lendo na hora os que faltarem. Para as threads de
+// jobs, que so podem ler o mapa; o jogo pede os pedacos adiantado com QueueMapColumns
+void PrefetchMapColumns(TileMap *map, int minX, int maxX) {
+    if (minX < 0) minX = 0;
+    if (maxX > map->cols - 1) maxX = map->cols - 1;
+    for (int index = minX / MAP_CHUNK_COLUMNS; index <= maxX / MAP_CHUNK_COLUMNS; index++) {
+        GetMapChunk(map, index);
     }
 }
 
-// Verifica colisao entre jogador e blocos
-bool CheckCollisionWithBlock(Rectangle player, Rectangle block, Vector2* correction) {
-    if (CheckCollisionRecs(player, block)) {
-        // TODO: Comentar o que fmin e fmax fazem e explicar cdigo
-        float overlapX = fmin(player.x + player.width, block.x + block.width) - fmax(player.x, block.x);
-        float overlapY = fmin(player.y + player.height, block.y + block.height) - fmax(player.y, block.y);
+// Bytes usados pelo mapa na memoria (indice de linhas, entidades e os pedacos com suas grades de colisao).
+// Os pedacos nao crescem com a largura da fase: sao MAP_RESIDENT_CHUNKS, cada um com a grade junto
+size_t GetMapMemoryUsage(TileMap *map) {
+    return map->rowCapacity * (sizeof(long) + sizeof(int)) +
+           map->entityCapacity * sizeof(MapEntity) +
+           (size_t)MAP_RESIDENT_CHUNKS * GetMapChunkBytes(map->rows);
+}
 
-        // Resolve com base na menor sobreposicao
-        if (overlapX < overlapY) {
-            correction->x = (player.x < block.x) ? -overlapX : overlapX;
-        } else {
-            correction->y = (player.y < block.y) ? -overlapY : overlapY;
-        }
+// Grava o mapa no formato compilado: cabecalho, tabela de entidades e os pedacos, cada um com os blocos (o
+// ultimo completado com '\0') seguidos da grade de colisao
+bool CompileMap(TileMap *map, const char *filename) {
+    int chunkCount = (map->cols + MAP_CHUNK_COLUMNS - 1) / MAP_CHUNK_COLUMNS;
+    long long entitiesOffset = sizeof(CompiledMapHeader);
+    long long tilesOffset = entitiesOffset + map->entityCount * (long long)sizeof(MapEntity);
+    tilesOffset = (tilesOffset + 4095) / 4096 * 4096;  // Pedacos comecam numa pagina nova
 
-        return true;
+    CompiledMapHeader header = {{0}, COMPILED_MAP_VERSION, map->rows, map->cols, MAP_CHUNK_COLUMNS,
+                                map->entityCount, map->enemyCount, map->coinCount, entitiesOffset, tilesOffset};
+    memcpy(header.magic, COMPILED_MAP_MAGIC, sizeof(header.magic));
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Erro ao criar %s!\n", filename);
+        return false;
     }
 
-    return false;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(map->entities, sizeof(MapEntity), map->entityCount, file);
+    for (long long position = ftell(file); position < tilesOffset; position++) {
+        fputc('\0', file);
+    }
+    for (int index = 0; index < chunkCount; index++) {
+        MapChunk *chunk = GetMapChunk(map, index);
+        fwrite(chunk->tiles, 1, (size_t)map->rows * MAP_CHUNK_COLUMNS, file);
+        fwrite(chunk->collision.solid, sizeof(unsigned long long), GetChunkCollisionWords(map->rows), file);
+    }
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        printf("Erro ao gravar %s!\n", filename);
+        remove(filename);
+    }
+    return ok;
 }
-// Dado um texto para preencher e uma coordenada, desenha um retngulo
-Rectangle CreateMenuButton(const char *text, int yOffset) {
-    return (Rectangle) {
-        SCREEN_WIDTH / 2 - MeasureText(text, 50) / 2,
-                     SCREEN_HEIGHT / 2 + yOffset,
-                     MeasureText(text, 50),
-                     50
-    };
+
+// Retorna o retangulo de colisao de uma celula do mapa
+Rectangle GetTileRect(int x, int y, float blockSize) {
+    return (Rectangle){x * blockSize, y * blockSize, blockSize, blockSize};
 }
 
-// Desenha boto com efeito de trocar de cor quando mouse passa por cima
-void DrawButton(Rectangle button, const char *text, Vector2 mouse, Color hoverColor, Color defaultColor) {
-    Color buttonColor = CheckCollisionPointRec(mouse, button) ? hoverColor : defaultColor;
-    DrawRectangleRec(button, buttonColor);
-    DrawText(text, button.x + button.width / 2 - MeasureText(text, 20) / 2, button.y + 15, 20, BLACK);
+// Retorna o intervalo de celulas do mapa que a area toca, limitado ao tamanho do mapa.
+// Bordas exatamente encostadas nao contam, igual ao CheckCollisionRecs.
+TileRange QueryTileRange(Rectangle area, int rows, int cols, float blockSize) {
+    TileRange range;
+    range.minX = (int)floorf(area.x / blockSize);
+    range.minY = (int)floorf(area.y / blockSize);
+    range.maxX = (int)ceilf((area.x + area.width) / blockSize) - 1;
+    range.maxY = (int)ceilf((area.y + area.height) / blockSize) - 1;
+
+    if (range.minX < 0) range.minX = 0;
+    if (range.minY < 0) range.minY = 0;
+    if (range.maxX > cols - 1) range.maxX = cols - 1;
+    if (range.maxY > rows - 1) range.maxY = rows - 1;
+
+    return range;
 }
 
-// Detecta se mouse clicou em cima do boto
-int HandleButtonClick(Rectangle button, Vector2 mouse) {
-    return CheckCollisionPointRec(mouse, button) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
+// Aplica calculo da gravidade
+void ApplyGravity(Player *player, float gravity, float dt) {
+    player->velocity.y += gravity * dt;
 }
 
-// Caso haja coliso entre jogador e o bloco, e bloco seja M, usa a diferena entre as duas posies, a variavel correction,  usada para manter o jogador na sua posio.
-void HandleBlockCollision(Player *player, Rectangle block) {
-    Vector2 correction = {0, 0};
+// Determina ou no se existe um spawnpoint para o jogador, caso sim, aplica as coordenadas da letra P como ponto inicial do jogador
+bool FindPlayerSpawnPoint(TileMap *map, Player* player) {
+    for (int i = 0; i < map->entityCount; i++) {
+        if (map->entities[i].tile == 'P') { // letra P no mapa encontrada
+            player->spawnPoint = (Vector2){map->entities[i].x * BLOCK_SIZE, map->entities[i].y * BLOCK_SIZE};
+            player->position = player->spawnPoint;
+            player->previousPosition = player->position;
+            player->rect.x = player->position.x;
+            player->rect.y = player->position.y;
 
-    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
-        if (correction.y != 0) {  // Correo vertical
-            player->velocity.y = 0;
-            player->position.y += correction.y;
 
-            if (correction.y < 0) {
-                player->isGrounded = true;
-            }
-        } else if (correction.x != 0) {     // Correo horizontal
-            player->velocity.x = 0;
-            player->position.x += correction.x;
+            return true; // Existe spawnpoint
         }
+    }
+    return false; // Nenhuma letra P foi encontrada, nao existe spawnpoint
+}
 
-        player->rect.x = player->position.x;
-        player->rect.y = player->position.y;
+// Leva o jogador de volta ao spawn parado, sem interpolar o desenho pelo caminho
+void ReturnPlayerToSpawn(Player *player) {
+    player->position = player->spawnPoint;
+    player->previousPosition = player->position;
+    player->velocity = (Vector2){0, 0};
+    player->rect.x = player->position.x;
+    player->rect.y = player->position.y;
+}
+
+#ifndef HEADLESS
+// Empacota as imagens (uma por SpriteId, ja decodificadas e ainda de quem chamou) num unico atlas usando
+// prateleiras ordenadas por altura
+bool LoadTextureAtlas(TextureAtlas *atlas, Image images[SPRITE_COUNT]) {
+    int order[SPRITE_COUNT];
+
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        if (images[i].data == NULL) {
+            printf("Erro: imagem %d do atlas nao carregada!\n", i);
+            return false;
+        }
+        order[i] = i;
+    }
+
+    // Mais altos primeiro, assim cada prateleira desperdica pouco espaco
+    for (int i = 1; i < SPRITE_COUNT; i++) {
+        int current = order[i];
+        int j = i - 1;
+        while (j >= 0 && images[order[j]].height < images[current].height) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = current;
+    }
+
+    int shelfX = ATLAS_PADDING;
+    int shelfY = ATLAS_PADDING;
+    int shelfHeight = 0;
+    for (int k = 0; k < SPRITE_COUNT; k++) {
+        int i = order[k];
+        if (shelfX + images[i].width + ATLAS_PADDING > ATLAS_WIDTH) {
+            shelfX = ATLAS_PADDING;
+            shelfY += shelfHeight + ATLAS_PADDING;
+            shelfHeight = 0;
+        }
+        atlas->sprites[i] = (Rectangle){shelfX, shelfY, images[i].width, images[i].height};
+        shelfX += images[i].width + ATLAS_PADDING;
+        if (images[i].height > shelfHeight) shelfHeight = images[i].height;
     }
+
+    Image packed = GenImageColor(ATLAS_WIDTH, shelfY + shelfHeight + ATLAS_PADDING, BLANK);
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        ImageDraw(&packed, images[i], (Rectangle){0, 0, images[i].width, images[i].height}, atlas->sprites[i], WHITE);
+    }
+
+    atlas->texture = LoadTextureFromImage(packed);
+    UnloadImage(packed);
+    return true;
 }
 
-int Menu(void) {
-    Texture2D initializeTexture = LoadTexture("inf_man.png");
+void UnloadTextureAtlas(TextureAtlas *atlas) {
+    UnloadTexture(atlas->texture);
+}
 
-    // Inicializao dos botes
-    Rectangle start = CreateMenuButton("Iniciar", 0);
-    Rectangle leaderboard = CreateMenuButton("Placar de pontos", 100);
-    Rectangle exit = CreateMenuButton("Sair", 200);
+bool InitializeSpriteBatch(SpriteBatch *batch, TextureAtlas *atlas) {
+    batch->atlas = atlas;
+    batch->draws = malloc(MAX_BATCH_SPRITES * sizeof(SpriteDraw));
+    batch->count = 0;
+    batch->flushes = 0;
+    batch->submitted = 0;
 
-    while (!WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
+    if (!batch->draws) {
+        printf("Erro ao alocar o lote de sprites!\n");
+        return false;
+    }
+    return true;
+}
 
-        Vector2 mouse = GetMousePosition();
+void UnloadSpriteBatch(SpriteBatch *batch) {
+    free(batch->draws);
+    batch->draws = NULL;
+    batch->count = 0;
+}
 
-        // Renderiza plano de fundo
-        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, DARKBLUE);
-        DrawTexture(initializeTexture, SCREEN_WIDTH / 2 - initializeTexture.width / 2, SCREEN_HEIGHT / 4, WHITE);
+// Envia tudo que foi acumulado. Como todos os desenhos usam a mesma textura, o raylib junta tudo em um unico lote
+void FlushSpriteBatch(SpriteBatch *batch) {
+    if (batch->count == 0) return;
 
-        // Renderiza botes
-        DrawButton(start, "Iniciar", mouse, YELLOW, LIGHTGRAY);
-        if (HandleButtonClick(start, mouse)) {
-            return 1;
+    for (int i = 0; i < batch->count; i++) {
+        DrawTexturePro(batch->atlas->texture, batch->draws[i].source, batch->draws[i].dest, (Vector2){0, 0}, 0.0f, batch->draws[i].tint);
+    }
+    batch->submitted += batch->count;
+    batch->flushes++;
+    batch->count = 0;
+}
+
+void ResetSpriteBatchStats(SpriteBatch *batch) {
+    batch->flushes = 0;
+    batch->submitted = 0;
+}
+
+// Desenha o quadro frame (relativo ao canto do sprite; largura negativa espelha) do sprite id
+void SubmitSpriteFrame(SpriteBatch *batch, SpriteId id, Rectangle frame, Rectangle dest, Color tint) {
+    if (batch->count >= MAX_BATCH_SPRITES) FlushSpriteBatch(batch);
+
+    Rectangle sprite = batch->atlas->sprites[id];
+    frame.x += sprite.x;
+    frame.y += sprite.y;
+    batch->draws[batch->count++] = (SpriteDraw){frame, dest, tint};
+}
+
+// Desenha o sprite inteiro esticado em dest
+void SubmitSprite(SpriteBatch *batch, SpriteId id, Rectangle dest, Color tint) {
+    Rectangle sprite = batch->atlas->sprites[id];
+    SubmitSpriteFrame(batch, id, (Rectangle){0, 0, sprite.width, sprite.height}, dest, tint);
+}
+
+// Desenha um retangulo de cor solida usando o pixel branco do atlas
+void SubmitRectangle(SpriteBatch *batch, Rectangle dest, Color color) {
+    SubmitSpriteFrame(batch, SPRITE_WHITE, (Rectangle){1, 1, 1, 1}, dest, color);
+}
+
+// Adiciona uma camada de fundo; a textura passa a repetir nas bordas para cobrir qualquer area com um unico desenho
+bool AddBackgroundLayer(BackgroundLayer layers[MAX_BACKGROUND_LAYERS], int *layerCount, Texture2D texture, float scrollFactor, Color tint) {
+    if (*layerCount >= MAX_BACKGROUND_LAYERS) return false;
+
+    SetTextureWrap(texture, TEXTURE_WRAP_REPEAT);
+    layers[*layerCount] = (BackgroundLayer){texture, scrollFactor, tint};
+    (*layerCount)++;
+    return true;
+}
+
+// Desenha cada camada como um unico retangulo cobrindo a area visivel, com UVs repetidas deslocadas pelo scrollFactor
+void RenderBackground(BackgroundLayer layers[MAX_BACKGROUND_LAYERS], int layerCount, Rectangle view) {
+    for (int i = 0; i < layerCount; i++) {
+        Rectangle source = {view.x * layers[i].scrollFactor, view.y * layers[i].scrollFactor, view.width, view.height};
+        DrawTexturePro(layers[i].texture, source, view, (Vector2){0, 0}, 0.0f, layers[i].tint);
+    }
+}
+#endif
+
+// Reserva memoria para capacity projeteis
+bool InitializeProjectilePool(ProjectilePool *pool, int capacity) {
+    pool->x = malloc(capacity * sizeof(float));
+    pool->y = malloc(capacity * sizeof(float));
+    pool->previousX = malloc(capacity * sizeof(float));
+    pool->previousY = malloc(capacity * sizeof(float));
+    pool->width = malloc(capacity * sizeof(float));
+    pool->height = malloc(capacity * sizeof(float));
+    pool->speedX = malloc(capacity * sizeof(float));
+    pool->speedY = malloc(capacity * sizeof(float));
+    pool->travel = malloc(capacity * sizeof(float));
+    pool->expired = malloc(capacity * sizeof(bool));
+    pool->target = malloc(capacity * sizeof(int));
+    pool->color = malloc(capacity * sizeof(Color));
+    pool->count = 0;
+    pool->capacity = capacity;
+
+    if (!pool->x || !pool->y || !pool->previousX || !pool->previousY || !pool->width || !pool->height || !pool->speedX || !pool->speedY ||
+            !pool->travel || !pool->expired || !pool->target || !pool->color) {
+        printf("Erro ao alocar o pool de projeteis!\n");
+        return false;
+    }
+    return true;
+}
+
+void UnloadProjectilePool(ProjectilePool *pool) {
+    free(pool->x);
+    free(pool->y);
+    free(pool->previousX);
+    free(pool->previousY);
+    free(pool->width);
+    free(pool->height);
+    free(pool->speedX);
+    free(pool->speedY);
+    free(pool->travel);
+    free(pool->expired);
+    free(pool->target);
+    free(pool->color);
+    pool->count = 0;
+    pool->capacity = 0;
+}
+
+// Cria um projetil no fim do pool; retorna o indice ou -1 se estiver cheio
+int SpawnProjectile(ProjectilePool *pool, Rectangle rect, Vector2 speed, Color color) {
+    if (pool->count >= pool->capacity) return -1;
+
+    int i = pool->count++;
+    pool->x[i] = rect.x;
+    pool->y[i] = rect.y;
+    pool->previousX[i] = rect.x;
+    pool->previousY[i] = rect.y;
+    pool->width[i] = rect.width;
+    pool->height[i] = rect.height;
+    pool->speedX[i] = speed.x;
+    pool->speedY[i] = speed.y;
+    pool->travel[i] = 1.0f;
+    pool->expired[i] = false;
+    pool->color[i] = color;
+    return i;
+}
+
+// Remove o projetil i trocando com o ultimo. Quem percorre o pool removendo deve ir do fim para o comeco
+void DespawnProjectile(ProjectilePool *pool, int i) {
+    int last = --pool->count;
+    pool->x[i] = pool->x[last];
+    pool->y[i] = pool->y[last];
+    pool->previousX[i] = pool->previousX[last];
+    pool->previousY[i] = pool->previousY[last];
+    pool->width[i] = pool->width[last];
+    pool->height[i] = pool->height[last];
+    pool->speedX[i] = pool->speedX[last];
+    pool->speedY[i] = pool->speedY[last];
+    pool->travel[i] = pool->travel[last];
+    pool->expired[i] = pool->expired[last];
+    pool->target[i] = pool->target[last];
+    pool->color[i] = pool->color[last];
+}
+
+Rectangle GetProjectileRect(ProjectilePool *pool, int i) {
+    return (Rectangle){pool->x[i], pool->y[i], pool->width[i], pool->height[i]};
+}
+
+#ifndef HEADLESS
+// Renderiza moedas
+void RenderCoins(SpriteBatch *batch, Coin *coins, int coinCount, Rectangle view) {
+    for (int i = 0; i < coinCount; i++) {
+        if (coins[i].active && CheckCollisionRecs(view, coins[i].rect)) {
+            SubmitRectangle(batch, coins[i].rect, YELLOW);  // Draw coin as a rectangle (yellow color)
         }
+    }
+}
 
-        DrawButton(leaderboard, "Placar de pontos", mouse, YELLOW, LIGHTGRAY);
-        if (HandleButtonClick(leaderboard, mouse)) {
-            return 2;
+// Renderiza projeteis
+void RenderProjectiles(SpriteBatch *batch, ProjectilePool *projectiles, Rectangle view, float alpha) {
+    for (int i = 0; i < projectiles->count; i++) {
+        Rectangle rect = GetProjectileRect(projectiles, i);
+        rect.x = projectiles->previousX[i] + (rect.x - projectiles->previousX[i]) * alpha;
+        rect.y = projectiles->previousY[i] + (rect.y - projectiles->previousY[i]) * alpha;
+        if (CheckCollisionRecs(view, rect)) {
+            SubmitRectangle(batch, rect, projectiles->color[i]);
         }
+    }
+}
 
-        DrawButton(exit, "Sair", mouse, YELLOW, LIGHTGRAY);
-        if (HandleButtonClick(exit, mouse)) {
-            return 3;
+// Renderiza inimigos, cada um no quadro calculado pelo AnimateEnemies (frames, na ordem do EnemyStore)
+void RenderEnemies(SpriteBatch *batch, EnemyStore *enemies, float blockSize,
+                   Rectangle enemyFrameRec, const int *frames, Rectangle view, float alpha) {
+    for (int i = 0; i < enemies->activeCount; i++) {
+        float x = enemies->previousX[i] + (enemies->x[i] - enemies->previousX[i]) * alpha;
+        Rectangle destRect = {x, enemies->y[i], enemyFrameRec.width, enemyFrameRec.height};
+        if (!CheckCollisionRecs(view, destRect)) continue; // Fora da camera
+
+        Rectangle source = enemyFrameRec;
+        source.x = frames[i] * enemyFrameRec.width;
+        SubmitSpriteFrame(batch, SPRITE_ENEMY, source, destRect, WHITE);
+    }
+}
+
+// Desenha os blocos do intervalo, deslocados por -origin (usado para desenhar dentro de um pedaco de terreno)
+void DrawMapTiles(SpriteBatch *batch, TileMap *map, TileRange range, float blockSize, Vector2 origin) {
+    for (int y = range.minY; y <= range.maxY; y++) {
+        for (int x = range.minX; x <= range.maxX; x++) {
+            char tile = GetMapTile(map, x, y);
+            if (tile == 'B') {
+                Rectangle destRect = {x * blockSize - origin.x, y * blockSize - origin.y, blockSize, blockSize};
+                SubmitSprite(batch, SPRITE_BLOCK, destRect, WHITE);
+            } else if (tile == 'O') {
+                Rectangle destRect = {x * blockSize - origin.x, y * blockSize - origin.y, blockSize, blockSize};
+                SubmitSprite(batch, SPRITE_OBSTACLE, destRect, WHITE);
+            } else if (tile == 'G') {
+                Rectangle destRect = {x * blockSize - origin.x, y * blockSize - 16 - origin.y, blockSize * 2, blockSize * 2};
+                SubmitSprite(batch, SPRITE_GATE, destRect, WHITE);
+            }
         }
+    }
+}
 
-        EndDrawing();
+// Intervalo de blocos que aparece dentro do pedaco (chunkX, chunkY). O portao ocupa 2x2 (uma coluna a direita e uma linha acima), entao inclui uma coluna a esquerda e uma linha abaixo
+TileRange GetTerrainChunkTiles(int chunkX, int chunkY, int rows, int cols) {
+    TileRange range = {
+        chunkX * TERRAIN_CHUNK_TILES - 1,
+        chunkY * TERRAIN_CHUNK_TILES,
+        (chunkX + 1) * TERRAIN_CHUNK_TILES - 1,
+        (chunkY + 1) * TERRAIN_CHUNK_TILES
+    };
+
+    if (range.minX < 0) range.minX = 0;
+    if (range.maxX > cols - 1) range.maxX = cols - 1;
+    if (range.maxY > rows - 1) range.maxY = rows - 1;
+    return range;
+}
+
+// Prepara o cache de terreno para um mapa rows x cols; nenhum pedaco desenhado ainda
+void InitializeTerrainCache(TerrainCache *cache, int rows, int cols) {
+    memset(cache, 0, sizeof(*cache));
+    cache->chunksX = (cols + TERRAIN_CHUNK_TILES - 1) / TERRAIN_CHUNK_TILES;
+    cache->chunksY = (rows + TERRAIN_CHUNK_TILES - 1) / TERRAIN_CHUNK_TILES;
+
+    for (int i = 0; i < TERRAIN_RESIDENT_CHUNKS; i++) {
+        cache->chunks[i].chunkX = -1;
     }
+}
 
-    return 0;
+// Textura que guarda o pedaco (chunkX, chunkY), ou NULL se ele nao esta desenhado
+TerrainChunk *FindTerrainChunk(TerrainCache *cache, int chunkX, int chunkY) {
+    for (int i = 0; i < TERRAIN_RESIDENT_CHUNKS; i++) {
+        if (cache->chunks[i].chunkX == chunkX && cache->chunks[i].chunkY == chunkY) {
+            return &cache->chunks[i];
+        }
+    }
+    return NULL;
 }
-// Desenha a tela final do jogo, retornando uma telaa de vitria ou derrota
-void DesenhaTelaFinal(void) {
-    while(!IsKeyPressed(KEY_ENTER)) {
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
-        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, RED);
-        DrawText("YOU FAILED!",(SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT - 30) / 2, 60, WHITE);
-        DrawText("Aperte enter para voltar ao menu", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT + 60) / 2, 40, WHITE);
-        // volta para o menu
-        EndDrawing();
+
+// Desenha o pedaco (chunkX, chunkY) na textura de chunk. Pedacos sem nenhum bloco nao desenham nada
+void BakeTerrainChunk(TerrainChunk *chunk, int chunkX, int chunkY, TileMap *map, float blockSize, SpriteBatch *batch) {
+    TileRange range = GetTerrainChunkTiles(chunkX, chunkY, map->rows, map->cols);
+
+    chunk->chunkX = chunkX;
+    chunk->chunkY = chunkY;
+    chunk->empty = true;
+    for (int y = range.minY; y <= range.maxY && chunk->empty; y++) {
+        for (int x = range.minX; x <= range.maxX; x++) {
+            char tile = GetMapTile(map, x, y);
+            if (tile == 'B' || tile == 'O' || tile == 'G') {
+                chunk->empty = false;
+                break;
+            }
+        }
     }
+    if (chunk->empty) return;
+
+    if (!chunk->loaded) {
+        chunk->target = LoadRenderTexture(TERRAIN_CHUNK_TILES * blockSize, TERRAIN_CHUNK_TILES * blockSize);
+        chunk->loaded = true;
+    }
+
+    Vector2 origin = {chunkX * TERRAIN_CHUNK_TILES * blockSize, chunkY * TERRAIN_CHUNK_TILES * blockSize};
+    BeginTextureMode(chunk->target);
+    ClearBackground(BLANK);
+    DrawMapTiles(batch, map, range, blockSize, origin);
+    FlushSpriteBatch(batch);
+    EndTextureMode();
 }
-// Colisao entre jogador e inimigo
-void HandlePlayerEnemyCollision(Player* player, Enemy* enemies, int enemyCount, int* currentFrame, float dt) {
-    for (int i = 0; i < enemyCount; i++) {
-        if (CheckCollisionRecs(player->rect, enemies[i].rect) && enemies[i].active) {
-            player->health -= 1;
-            *currentFrame = 11;
 
-            player->position = player->spawnPoint;
-            player->velocity = (Vector2){0, 0};
+// Descarta o desenho do pedaco que contem o bloco (x, y), se existir; ele e redesenhado quando aparecer na tela
+void MarkTerrainDirty(TerrainCache *cache, int x, int y) {
+    if (x < 0 || y < 0) return;
 
-            player->rect.x = player->position.x;
-            player->rect.y = player->position.y;
+    TerrainChunk *chunk = FindTerrainChunk(cache, x / TERRAIN_CHUNK_TILES, y / TERRAIN_CHUNK_TILES);
+    if (chunk) chunk->chunkX = -1;
+}
+
+// Troca um bloco do mapa e marca para redesenho so os pedacos que ele aparece
+void SetMapTile(TileMap *map, TerrainCache *cache, int x, int y, char tile) {
+    WriteMapTile(map, x, y, tile);
+    MarkTerrainDirty(cache, x, y);
+    MarkTerrainDirty(cache, x + 1, y);  // Metade direita do portao
+    MarkTerrainDirty(cache, x, y - 1);  // Metade de cima do portao
+    MarkTerrainDirty(cache, x + 1, y - 1);  // Canto de cima a direita do portao
+}
+
+// Pedacos de terreno que a area toca
+TileRange QueryTerrainChunkRange(TerrainCache *cache, Rectangle area, float blockSize) {
+    return QueryTileRange(area, cache->chunksY, cache->chunksX, TERRAIN_CHUNK_TILES * blockSize);
+}
+
+// Desenha os pedacos visiveis que ainda nao tem textura, reaproveitando as que sairam da tela ha mais tempo.
+// Deve ser chamado fora do BeginMode2D, porque usa BeginTextureMode
+void UpdateTerrainCache(TerrainCache *cache, Rectangle view, TileMap *map, float blockSize, SpriteBatch *batch) {
+    TileRange visible = QueryTerrainChunkRange(cache, view, blockSize);
+
+    cache->frame++;
+    for (int cy = visible.minY; cy <= visible.maxY; cy++) {
+        for (int cx = visible.minX; cx <= visible.maxX; cx++) {
+            TerrainChunk *chunk = FindTerrainChunk(cache, cx, cy);
+            if (!chunk) {
+                for (int i = 0; i < TERRAIN_RESIDENT_CHUNKS; i++) {
+                    TerrainChunk *candidate = &cache->chunks[i];
+                    if (candidate->chunkX < 0) {    // Livre
+                        chunk = candidate;
+                        break;
+                    }
+                    if (candidate->lastUse != cache->frame && (!chunk || candidate->lastUse < chunk->lastUse)) {
+                        chunk = candidate;
+                    }
+                }
+                if (!chunk) continue;   // Mais pedacos na tela do que texturas
+                BakeTerrainChunk(chunk, cx, cy, map, blockSize, batch);
+            }
+            chunk->lastUse = cache->frame;
         }
     }
 }
 
-// Caso haja coliso entre jogador e o bloco, e bloco seja O, empurra o jogador para trs de subtrai 1 de sua vida.
-void HandleObstacleCollision(Player *player, Rectangle block) {
-    Vector2 correction = {0, 0};
-    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
-        player->health -= 1;
+void UnloadTerrainCache(TerrainCache *cache) {
+    for (int i = 0; i < TERRAIN_RESIDENT_CHUNKS; i++) {
+        if (cache->chunks[i].loaded) UnloadRenderTexture(cache->chunks[i].target);
+        cache->chunks[i].loaded = false;
+        cache->chunks[i].chunkX = -1;
+    }
+}
 
+// Renderiza mapa: um desenho por pedaco de terreno visivel
+void RenderMap(TerrainCache *cache, float blockSize, Rectangle view) {
+    TileRange visible = QueryTerrainChunkRange(cache, view, blockSize);
+    float chunkSize = TERRAIN_CHUNK_TILES * blockSize;
 
-        // Reset player to position from 3 seconds ago
-        player->position = player->spawnPoint;
-        player->velocity = (Vector2) {0, 0};
+    for (int cy = visible.minY; cy <= visible.maxY; cy++) {
+        for (int cx = visible.minX; cx <= visible.maxX; cx++) {
+            TerrainChunk *chunk = FindTerrainChunk(cache, cx, cy);
+            if (!chunk || chunk->empty || !chunk->loaded) continue;
 
-        // Update player's rect position
-        player->rect.x = player->position.x;
-        player->rect.y = player->position.y;
+            // Texturas de render ficam de cabeca para baixo, por isso a altura negativa
+            Rectangle source = {0, 0, chunk->target.texture.width, -chunk->target.texture.height};
+            DrawTextureRec(chunk->target.texture, source, (Vector2){cx * chunkSize, cy * chunkSize}, WHITE);
+        }
+    }
+}
+#endif
+
+// Inicializacao do jogador
+Player InitializePlayer() {
+    Player player = {
+        {0, 0},
+        {0, 0},
+        {0, 0, 32, 32},
+        false,
+        true,
+        false,
+        3,
+        0,
+        " \n",
+        0
+    };
+    return player;
+}
+
+// Valores padrao das constantes de jogo
+GameSettings InitializeGameSettings() {
+    GameSettings settings = {
+        800.0f,     // gravity
+        200.0f,     // playerSpeed
+        -300.0f,    // jumpForce
+        150.0f,     // enemySpeedX
+        200.0f,     // enemyOffset
+        20.0f,      // projectileWidth
+        10.0f,      // projectileHeight
+        400.0f      // projectileSpeed
+    };
+    return settings;
+}
+
+#ifndef HEADLESS
+// Retangulo do mundo que a camera enxerga
+Rectangle GetCameraViewRect(Camera2D camera) {
+    return (Rectangle) {
+        camera.target.x - camera.offset.x / camera.zoom,
+        camera.target.y - camera.offset.y / camera.zoom,
+        SCREEN_WIDTH / camera.zoom,
+        SCREEN_HEIGHT / camera.zoom
+    };
+}
+
+// Inicializacao da camera
+Camera2D InitializeCamera(Player *player) {
+    Camera2D camera = {0};
+    camera.target = (Vector2) {
+        player->position.x + player->rect.width / 2, player->position.y + player->rect.height / 2
+    };
+    camera.offset = (Vector2) {
+        SCREEN_WIDTH / 2.0f, SCREEN_HEIGHT / 2.0f
+    };
+    camera.zoom = 2.0f;
+    return camera;
+}
+
+// Inicializacao dos quadros de animacao do jogador e dos inimigos a partir dos sprites do atlas
+void InitializePlayerTextureAndAnimation(TextureAtlas *atlas, Rectangle *frameRec, int *frameWidth, Rectangle *enemyFrameRec, int *enemyFrameWidth) {
+    Rectangle playerSprite = atlas->sprites[SPRITE_PLAYER];
+    *frameWidth = playerSprite.width / 12;
+    *frameRec = (Rectangle){0.0f, 0.0f, (float)(*frameWidth), playerSprite.height};
 
-        printf("Player health: %d\n", player->health);
+    Rectangle enemySprite = atlas->sprites[SPRITE_ENEMY];
+    *enemyFrameWidth = enemySprite.width / 2;
+    *enemyFrameRec = (Rectangle){0.0f, 0.0f, (float)(*enemyFrameWidth), enemySprite.height};
+}
+#endif
+
+// Reserva memoria para capacity inimigos de tamanho width x height
+bool InitializeEnemyStore(EnemyStore *enemies, int capacity, float width, float height) {
+    enemies->x = malloc(capacity * sizeof(float));
+    enemies->y = malloc(capacity * sizeof(float));
+    enemies->previousX = malloc(capacity * sizeof(float));
+    enemies->speedX = malloc(capacity * sizeof(float));
+    enemies->minX = malloc(capacity * sizeof(float));
+    enemies->maxX = malloc(capacity * sizeof(float));
+    enemies->health = malloc(capacity * sizeof(int));
+    enemies->spawnId = malloc(capacity * sizeof(int));
+    enemies->count = 0;
+    enemies->activeCount = 0;
+    enemies->capacity = capacity;
+    enemies->width = width;
+    enemies->height = height;
+
+    if (!enemies->x || !enemies->y || !enemies->previousX || !enemies->speedX || !enemies->minX || !enemies->maxX ||
+            !enemies->health || !enemies->spawnId) {
+        printf("Erro ao alocar os inimigos!\n");
+        return false;
     }
+    return true;
 }
 
-// Compara dois jogadores
-int ComparaJogadores(JogadorLeader PlayerA, JogadorLeader PlayerB) {
-    // Ordena por pontos de forma decrescente
-    if (PlayerA.points != PlayerB.points) {
-        return PlayerB.points - PlayerA.points; // Maior pontuao primeiro
+void UnloadEnemyStore(EnemyStore *enemies) {
+    free(enemies->x);
+    free(enemies->y);
+    free(enemies->previousX);
+    free(enemies->speedX);
+    free(enemies->minX);
+    free(enemies->maxX);
+    free(enemies->health);
+    free(enemies->spawnId);
+    enemies->count = 0;
+    enemies->activeCount = 0;
+    enemies->capacity = 0;
+}
+
+// Adiciona um inimigo vivo patrulhando de x ate x + offset; retorna o indice ou -1 se nao couber
+int AddEnemy(EnemyStore *enemies, float x, float y, float speedX, float offset) {
+    if (enemies->count >= enemies->capacity) return -1;
+
+    int i = enemies->count++;
+    enemies->x[i] = x;
+    enemies->y[i] = y;
+    enemies->previousX[i] = x;
+    enemies->speedX[i] = speedX;
+    enemies->minX[i] = x;            // Posicao minimia  o spawnpoint
+    enemies->maxX[i] = x + offset;   // Posicao maxima
+    enemies->health[i] = 1;          // Vida que comea
+    enemies->spawnId[i] = i;
+    enemies->activeCount = enemies->count;
+    return i;
+}
+
+void SwapEnemies(EnemyStore *enemies, int a, int b) {
+    float tempFloat;
+    int tempInt;
+    tempFloat = enemies->x[a]; enemies->x[a] = enemies->x[b]; enemies->x[b] = tempFloat;
+    tempFloat = enemies->y[a]; enemies->y[a] = enemies->y[b]; enemies->y[b] = tempFloat;
+    tempFloat = enemies->previousX[a]; enemies->previousX[a] = enemies->previousX[b]; enemies->previousX[b] = tempFloat;
+    tempFloat = enemies->speedX[a]; enemies->speedX[a] = enemies->speedX[b]; enemies->speedX[b] = tempFloat;
+    tempFloat = enemies->minX[a]; enemies->minX[a] = enemies->minX[b]; enemies->minX[b] = tempFloat;
+    tempFloat = enemies->maxX[a]; enemies->maxX[a] = enemies->maxX[b]; enemies->maxX[b] = tempFloat;
+    tempInt = enemies->health[a]; enemies->health[a] = enemies->health[b]; enemies->health[b] = tempInt;
+    tempInt = enemies->spawnId[a]; enemies->spawnId[a] = enemies->spawnId[b]; enemies->spawnId[b] = tempInt;
+}
+
+// Move os inimigos sem vida para depois de activeCount. Chamado depois das colisoes,
+// para os indices do hash espacial continuarem validos durante o frame
+void RemoveDeadEnemies(EnemyStore *enemies) {
+    for (int i = enemies->activeCount - 1; i >= 0; i--) {
+        if (enemies->health[i] <= 0) {
+            enemies->health[i] = 0;
+            SwapEnemies(enemies, i, --enemies->activeCount);
+        }
     }
+}
 
-    // Se as pontuaes forem iguais, ordena por nome em ordem alfabtica
-    return strcmp(PlayerA.nome, PlayerB.nome);
+Rectangle GetEnemyRect(EnemyStore *enemies, int i) {
+    return (Rectangle){enemies->x[i], enemies->y[i], enemies->width, enemies->height};
 }
 
-// Ordena os jogadores por pontuao (decrescente)
-void OrdenaPlayers(JogadorLeader jogadores[]) {
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4 - i; j++) {
-            if (ComparaJogadores(jogadores[j], jogadores[j + 1]) > 0) {
-                JogadorLeader temp = jogadores[j];
-                jogadores[j] = jogadores[j + 1];
-                jogadores[j + 1] = temp;
-            }
+// Encontra instancias da letra "M" no arquivo e criar inimigos pra cada uma delas
+int InitializeEnemies(TileMap *map, EnemyStore *enemies, float blockSize, float enemySpeedX, float offset) {
+    enemies->count = 0;
+    enemies->activeCount = 0;
+
+    for (int i = 0; i < map->entityCount; i++) {
+        if (map->entities[i].tile == 'M') {
+            AddEnemy(enemies, map->entities[i].x * blockSize, map->entities[i].y * blockSize, enemySpeedX, offset);
+        }
+    }
+
+    return enemies->count;
+}
+
+// Inicializa as moedas no mapa
+// coins precisa ter espaco para map->coinCount moedas
+int InitializeCoins(TileMap *map, Coin *coins, float blockSize) {
+    int coinCount = 0;
+
+    for (int i = 0; i < map->entityCount; i++) {
+        if (map->entities[i].tile == 'C') { // Moeda no mapa
+            coins[coinCount].position = (Vector2)
+            {
+                map->entities[i].x * blockSize, map->entities[i].y * blockSize
+            };
+            coins[coinCount].rect = (Rectangle)
+            {
+                coins[coinCount].position.x, coins[coinCount].position.y, blockSize, blockSize
+            };
+            coins[coinCount].active = true; // Marca a moeda como ativa
+            coins[coinCount].points = 10; // A moeda d 10
+            coinCount++;
         }
     }
-}
 
-// Cria o arquivo top_scores.bin com jogadores fictcios
-void CriaTop5Jogadores(void) {
-    FILE *arq;
-    JogadorLeader Players[5] = {
-        {"Junior", 50},
-        {"Alerrandro", 40},
-        {"Adalberto", 110},
-        {"Dalessandro", 120},
-        {"Fernandao", 150}
-    };
+    return coinCount;
+}
+
+void HandleRespawn(Player *player, float screenHeight) {
+    if (player->position.y > screenHeight) {
+        ReturnPlayerToSpawn(player);
+        player->health -= 1;
+    }
+}
+
+#ifndef HEADLESS
+// Le o teclado uma vez por frame. Teclas pressionadas acumulam ate um tick consumir
+void PollPlayerInput(PlayerInput *input) {
+    input->right = IsKeyDown(KEY_RIGHT);
+    input->left = IsKeyDown(KEY_LEFT);
+    input->jump = input->jump || IsKeyPressed(KEY_SPACE);
+    input->shootHorizontal = input->shootHorizontal || IsKeyPressed(KEY_Z);
+    input->shootVertical = input->shootVertical || IsKeyPressed(KEY_X);
+    input->rewind = IsKeyDown(KEY_R);
+}
+#endif
+
+// Descarta os toques ja usados por um tick
+void ConsumePressedInput(PlayerInput *input) {
+    input->jump = false;
+    input->shootHorizontal = false;
+    input->shootVertical = false;
+}
+
+unsigned char PackPlayerInput(PlayerInput *input) {
+    return (input->left ? INPUT_LEFT : 0) |
+           (input->right ? INPUT_RIGHT : 0) |
+           (input->jump ? INPUT_JUMP : 0) |
+           (input->shootHorizontal ? INPUT_SHOOT_HORIZONTAL : 0) |
+           (input->shootVertical ? INPUT_SHOOT_VERTICAL : 0) |
+           (input->rewind ? INPUT_REWIND : 0);
+}
+
+PlayerInput UnpackPlayerInput(unsigned char buttons) {
+    return (PlayerInput) {
+        (buttons & INPUT_LEFT) != 0,
+        (buttons & INPUT_RIGHT) != 0,
+        (buttons & INPUT_JUMP) != 0,
+        (buttons & INPUT_SHOOT_HORIZONTAL) != 0,
+        (buttons & INPUT_SHOOT_VERTICAL) != 0,
+        (buttons & INPUT_REWIND) != 0
+    };
+}
+
+// Aplica movimento para o jogador conforme a tecla pressionada
+void CheckPressedKey(Player *player, PlayerInput *input, float moveSpeed, float jumpForce) {
+    player->velocity.x = 0;
+
+    if (input->right) {
+        player->velocity.x = moveSpeed;
+        player->facingRight = true;
+    }
+    if (input->left) {
+        player->velocity.x = -moveSpeed;
+        player->facingRight = false;
+    }
+    if (input->jump && player->isGrounded) {
+        player->velocity.y = jumpForce;
+        player->isGrounded = false;
+    }
+}
+
+// Cria projetil com coordenadas baseadas na posio atual do jogador e aplica estado do jogador estar atirando durante 0.5 segundos
+void CreateProjectile(Player *player, PlayerInput *input, ProjectilePool *projectiles, float projectileWidth, float projectileHeight, float projectileSpeed, float dt) {
+    float animationDuration = 0.5;
+
+    if (input->shootHorizontal) {
+        player->isShooting = true;
+
+        Rectangle rect = {
+            player->position.x + (player->facingRight ? player->rect.width : -projectileWidth),
+            player->position.y + player->rect.height / 2 - projectileHeight / 2,
+            projectileWidth,
+            projectileHeight
+        };
+        Vector2 speed = {
+            player->facingRight ? projectileSpeed : -projectileSpeed, 0
+        };
+        SpawnProjectile(projectiles, rect, speed, YELLOW);
+    }
+
+    if (input->shootVertical) {
+        player->isShooting = true;
+
+        Rectangle rect = {
+            player->position.x + (player->facingRight ? player->rect.width : -projectileHeight),
+            player->position.y + player->rect.height / 2 - projectileWidth / 2,
+            projectileHeight,
+            projectileWidth
+        };
+        Vector2 speed;
+        if(player->isGrounded) {
+            speed = (Vector2){0,-400};
+        } else {
+            speed = (Vector2){0,400};
+        }
+        SpawnProjectile(projectiles, rect, speed, BLUE); // Blue projectile
+    }
+
+    if (player->isShooting) {
+        player->shootTimer += dt;
+        if (player->shootTimer >= animationDuration) {
+            player->isShooting = false;
+            player->shootTimer = 0.0f;
+        }
+    }
+}
+
+// Posicao do jogador entre o tick anterior e o atual (alpha de 0 a 1)
+Vector2 GetInterpolatedPlayerPosition(Player *player, float alpha) {
+    return (Vector2) {
+        player->previousPosition.x + (player->position.x - player->previousPosition.x) * alpha,
+        player->previousPosition.y + (player->position.y - player->previousPosition.y) * alpha
+    };
+}
+
+#ifndef HEADLESS
+// Move camera de acordo com posio do jogador
+void MoveCamera(Camera2D *camera, Player *player, float alpha) {
+    camera->target = (Vector2)
+    {
+        GetInterpolatedPlayerPosition(player, alpha).x + player->rect.width / 2, SCREEN_HEIGHT / 2 - 110
+    };
+}
+#endif
+
+// Move jogador com base na velocidade multiplicada pelo frame atual
+void MovePlayer(Player *player, PlayerInput *input, float moveSpeed, float jumpForce, float dt) {
+    CheckPressedKey(player, input, moveSpeed, jumpForce);
+    player->position.x += player->velocity.x * dt;
+    player->position.y += player->velocity.y * dt;
+    player->rect.x = player->position.x;
+    player->rect.y = player->position.y;
+}
+
+// Nucleos da maquina, para o numero padrao de threads de jobs
+int GetProcessorCount(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? count : 1;
+#endif
+}
+
+void LockJobs(JobSystem *jobs) {
+#if defined(_WIN32)
+    EnterCriticalSection(&jobs->lock);
+#else
+    pthread_mutex_lock(&jobs->lock);
+#endif
+}
+
+void UnlockJobs(JobSystem *jobs) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&jobs->lock);
+#else
+    pthread_mutex_unlock(&jobs->lock);
+#endif
+}
+
+// Espera um job novo (work) ou um job terminar. Chamado com jobs->lock
+void WaitJobSystem(JobSystem *jobs, bool work) {
+#if defined(_WIN32)
+    SleepConditionVariableCS(work ? &jobs->workReady : &jobs->progress, &jobs->lock, INFINITE);
+#else
+    pthread_cond_wait(work ? &jobs->workReady : &jobs->progress, &jobs->lock);
+#endif
+}
+
+void WakeJobSystem(JobSystem *jobs, bool work) {
+#if defined(_WIN32)
+    WakeAllConditionVariable(work ? &jobs->workReady : &jobs->progress);
+#else
+    pthread_cond_broadcast(work ? &jobs->workReady : &jobs->progress);
+#endif
+}
+
+void LockJobQueue(JobQueue *queue) {
+#if defined(_WIN32)
+    EnterCriticalSection(&queue->lock);
+#else
+    pthread_mutex_lock(&queue->lock);
+#endif
+}
+
+void UnlockJobQueue(JobQueue *queue) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&queue->lock);
+#else
+    pthread_mutex_unlock(&queue->lock);
+#endif
+}
+
+// Poe o job na proxima fila com espaco, em rodizio, e acorda as threads. Chamado com jobs->lock (a trava da
+// fila vem sempre depois desta). SubmitJob reserva espaco, mas se todas estiverem cheias retorna false e o job
+// fica com quem chamou
+bool PushJob(JobSystem *jobs, Job *job) {
+    for (int k = 0; k < jobs->threadCount; k++) {
+        JobQueue *queue = &jobs->queues[jobs->nextQueue];
+        jobs->nextQueue = (jobs->nextQueue + 1) % jobs->threadCount;
+
+        LockJobQueue(queue);
+        bool pushed = queue->bottom - queue->top < JOB_QUEUE_CAPACITY;
+        if (pushed) queue->jobs[queue->bottom++ % JOB_QUEUE_CAPACITY] = *job;
+        UnlockJobQueue(queue);
+
+        if (pushed) {
+            jobs->queued++;
+            WakeJobSystem(jobs, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tira um job para a thread index: do fim da propria fila ou, vazia, do comeco da fila de outra
+bool TakeJob(JobSystem *jobs, int index, Job *job) {
+    for (int k = 0; k < jobs->threadCount; k++) {
+        JobQueue *queue = &jobs->queues[(index + k) % jobs->threadCount];
+
+        LockJobQueue(queue);
+        bool found = queue->bottom != queue->top;
+        if (found && k == 0) *job = queue->jobs[--queue->bottom % JOB_QUEUE_CAPACITY];
+        else if (found) *job = queue->jobs[queue->top++ % JOB_QUEUE_CAPACITY];
+        UnlockJobQueue(queue);
+
+        if (found) {
+            LockJobs(jobs);
+            jobs->queued--;
+            if (k > 0) jobs->stolen++;
+            UnlockJobs(jobs);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Roda o job e desconta do grupo; o grupo que termina libera os jobs que dependiam dele
+void RunJob(JobSystem *jobs, Job *job) {
+    job->function(job->data, job->first, job->last);
+
+    LockJobs(jobs);
+    jobs->executed++;
+    if (job->done && --job->done->pending == 0) {
+        for (int i = 0; i < jobs->waitingCount; ) {
+            if (jobs->waiting[i].dependency == job->done) {
+                Job ready = jobs->waiting[i];
+                jobs->waiting[i] = jobs->waiting[--jobs->waitingCount];
+                if (!PushJob(jobs, &ready)) {   // Filas cheias: roda aqui, sem a trava, e recomeca a lista
+                    UnlockJobs(jobs);
+                    RunJob(jobs, &ready);
+                    LockJobs(jobs);
+                    i = 0;
+                }
+            } else {
+                i++;
+            }
+        }
+    }
+    WakeJobSystem(jobs, false);
+    UnlockJobs(jobs);
+}
+
+#if defined(_WIN32)
+DWORD WINAPI RunJobThread(LPVOID data) {
+#else
+void *RunJobThread(void *data) {
+#endif
+    JobWorker *worker = data;
+    JobSystem *jobs = worker->system;
+
+    while (true) {
+        LockJobs(jobs);
+        while (jobs->queued == 0 && !jobs->stop) {
+            WaitJobSystem(jobs, true);
+        }
+        bool stop = jobs->stop;
+        UnlockJobs(jobs);
+        if (stop) break;
+
+        Job job;
+        if (TakeJob(jobs, worker->index, &job)) RunJob(jobs, &job);
+    }
+    return 0;
+}
+
+// Cria as threads auxiliares: threadCount contando a do jogo, ou uma por nucleo se threadCount <= 0.
+// As que nao puderem ser criadas ficam de fora; com uma thread so, os jobs rodam na do jogo ao esperar
+void InitializeJobSystem(JobSystem *jobs, int threadCount) {
+    memset(jobs, 0, sizeof(*jobs));
+    if (threadCount <= 0) threadCount = GetProcessorCount();
+    if (threadCount > MAX_JOB_THREADS) threadCount = MAX_JOB_THREADS;
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&jobs->lock);
+    InitializeConditionVariable(&jobs->workReady);
+    InitializeConditionVariable(&jobs->progress);
+    for (int i = 0; i < MAX_JOB_THREADS; i++) InitializeCriticalSection(&jobs->queues[i].lock);
+#else
+    pthread_mutex_init(&jobs->lock, NULL);
+    pthread_cond_init(&jobs->workReady, NULL);
+    pthread_cond_init(&jobs->progress, NULL);
+    for (int i = 0; i < MAX_JOB_THREADS; i++) pthread_mutex_init(&jobs->queues[i].lock, NULL);
+#endif
+
+    // As threads so leem threadCount depois de achar um job, e nenhum e criado antes de terminar aqui
+    jobs->threadCount = 1;
+    for (int i = 1; i < threadCount; i++) {
+        jobs->workers[i] = (JobWorker){jobs, i};
+#if defined(_WIN32)
+        jobs->threads[i] = CreateThread(NULL, 0, RunJobThread, &jobs->workers[i], 0, NULL);
+        bool created = jobs->threads[i] != NULL;
+#else
+        bool created = pthread_create(&jobs->threads[i], NULL, RunJobThread, &jobs->workers[i]) == 0;
+#endif
+        if (!created) {
+            printf("Aviso: so %d de %d threads de jobs criadas\n", jobs->threadCount, threadCount);
+            break;
+        }
+        jobs->threadCount++;
+    }
+}
+
+// Cria um job que roda function(data, first, last) no grupo done, depois que o grupo dependency terminar.
+// dependency deve ser um grupo ja todo criado. Filas cheias: a thread do jogo trabalha ate abrir espaco
+void SubmitJob(JobSystem *jobs, JobFunction function, void *data, int first, int last, JobCounter *dependency, JobCounter *done) {
+    Job job = {function, data, first, last, dependency, done};
+
+    LockJobs(jobs);
+    while (jobs->queued + jobs->waitingCount >= jobs->threadCount * JOB_QUEUE_CAPACITY ||
+           (dependency && jobs->waitingCount >= JOB_WAITING_CAPACITY)) {
+        if (jobs->queued == 0) {
+            WaitJobSystem(jobs, false);
+            continue;
+        }
+        UnlockJobs(jobs);
+        Job other;
+        if (TakeJob(jobs, 0, &other)) RunJob(jobs, &other);
+        LockJobs(jobs);
+    }
+
+    if (done) done->pending++;
+    bool queued = true;
+    if (dependency && dependency->pending > 0) {
+        jobs->waiting[jobs->waitingCount++] = job;
+    } else {
+        queued = PushJob(jobs, &job);
+    }
+    UnlockJobs(jobs);
+
+    if (!queued) RunJob(jobs, &job);    // Filas cheias mesmo assim: o job roda na thread do jogo, nao se perde
+}
+
+// Divide [0, count) em pedacos de tamanho multiplo de grain e cria um job por pedaco no grupo done. Um pedaco
+// so (ou uma thread so) e sem dependencia pendente roda aqui mesmo, sem passar pelas filas
+void ParallelFor(JobSystem *jobs, JobFunction function, void *data, int count, int grain, JobCounter *dependency, JobCounter *done) {
+    if (count <= 0) return;
+
+    int chunk = (count + jobs->threadCount * JOB_CHUNKS_PER_THREAD - 1) / (jobs->threadCount * JOB_CHUNKS_PER_THREAD);
+    chunk = (chunk + grain - 1) / grain * grain;
+    if (chunk >= count || jobs->threadCount == 1) {
+        LockJobs(jobs);
+        bool ready = !dependency || dependency->pending == 0;
+        UnlockJobs(jobs);
+        if (ready) {
+            function(data, 0, count);
+            return;
+        }
+    }
+
+    for (int first = 0; first < count; first += chunk) {
+        int last = (first + chunk < count) ? first + chunk : count;
+        SubmitJob(jobs, function, data, first, last, dependency, done);
+    }
+}
+
+// Espera o grupo terminar rodando jobs (de qualquer grupo) enquanto houver
+void WaitForJobs(JobSystem *jobs, JobCounter *counter) {
+    while (true) {
+        Job job;
+        if (TakeJob(jobs, 0, &job)) {
+            RunJob(jobs, &job);
+            continue;
+        }
+
+        LockJobs(jobs);
+        while (counter->pending > 0 && jobs->queued == 0) {
+            WaitJobSystem(jobs, false);
+        }
+        bool finished = counter->pending == 0;
+        UnlockJobs(jobs);
+        if (finished) return;
+    }
+}
+
+// Parallel-for que so volta quando termina. Sem sistema de jobs (NULL), roda tudo aqui
+void RunParallelFor(JobSystem *jobs, JobFunction function, void *data, int count, int grain) {
+    if (!jobs) {
+        if (count > 0) function(data, 0, count);
+        return;
+    }
+    JobCounter done = {0};
+    ParallelFor(jobs, function, data, count, grain, NULL, &done);
+    WaitForJobs(jobs, &done);
+}
+
+// Para as threads. Nenhum job pode estar pendente
+void UnloadJobSystem(JobSystem *jobs) {
+    LockJobs(jobs);
+    jobs->stop = true;
+    WakeJobSystem(jobs, true);
+    UnlockJobs(jobs);
+
+    for (int i = 1; i < jobs->threadCount; i++) {
+#if defined(_WIN32)
+        WaitForSingleObject(jobs->threads[i], INFINITE);
+        CloseHandle(jobs->threads[i]);
+#else
+        pthread_join(jobs->threads[i], NULL);
+#endif
+    }
+#if defined(_WIN32)
+    for (int i = 0; i < MAX_JOB_THREADS; i++) DeleteCriticalSection(&jobs->queues[i].lock);
+    DeleteCriticalSection(&jobs->lock);
+#else
+    for (int i = 0; i < MAX_JOB_THREADS; i++) pthread_mutex_destroy(&jobs->queues[i].lock);
+    pthread_cond_destroy(&jobs->progress);
+    pthread_cond_destroy(&jobs->workReady);
+    pthread_mutex_destroy(&jobs->lock);
+#endif
+}
+
+// Patrulha: inverte a velocidade quem passou dos limites e integra a posicao. Roda 4 inimigos por vez com SSE quando disponivel
+void PatrolEnemies(float *restrict x, float *restrict speedX, const float *restrict minX, const float *restrict maxX, int count, float dt) {
+    int i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128 dtWide = _mm_set1_ps(dt);
+    __m128 signBit = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 position = _mm_loadu_ps(x + i);
+        __m128 speed = _mm_loadu_ps(speedX + i);
+        __m128 outside = _mm_or_ps(_mm_cmple_ps(position, _mm_loadu_ps(minX + i)),
+                                   _mm_cmpge_ps(position, _mm_loadu_ps(maxX + i)));
+        speed = _mm_xor_ps(speed, _mm_and_ps(outside, signBit));  // Inverte direo
+        position = _mm_add_ps(position, _mm_mul_ps(speed, dtWide));
+        _mm_storeu_ps(speedX + i, speed);
+        _mm_storeu_ps(x + i, position);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (x[i] <= minX[i] || x[i] >= maxX[i]) {
+            speedX[i] = -speedX[i]; // Inverte direo
+        }
+        x[i] += speedX[i] * dt;
+    }
+}
+
+typedef struct {
+    EnemyStore *enemies;
+    float dt;
+} EnemyMoveJob;
+
+// Patrulha dos inimigos [first, last), num job
+void PatrolEnemyRange(void *data, int first, int last) {
+    EnemyMoveJob *job = data;
+    EnemyStore *enemies = job->enemies;
+    PatrolEnemies(enemies->x + first, enemies->speedX + first, enemies->minX + first, enemies->maxX + first, last - first, job->dt);
+}
+
+// Move os inimigos vivos com base na velocidade multiplicada pelo frame atual, em pedacos pelas threads de jobs
+void MoveEnemies(EnemyStore *enemies, float dt, JobSystem *jobs) {
+    // Faz o inimigo ir e voltar
+    EnemyMoveJob job = {enemies, dt};
+    RunParallelFor(jobs, PatrolEnemyRange, &job, enemies->activeCount, ENEMY_JOB_GRAIN);
+}
+
+// Primeiro bit 1 em [first, last] de bits, testando uma palavra (64 celulas) por vez
+bool FindFirstBit(const unsigned long long *bits, int first, int last, int *hit) {
+    if (first > last) return false;
+
+    int firstWord = first >> 6;
+    int lastWord = last >> 6;
+    for (int w = firstWord; w <= lastWord; w++) {
+        unsigned long long word = bits[w];
+        if (w == firstWord) word &= ~0ULL << (first & 63);
+        if (w == lastWord) word &= ~0ULL >> (63 - (last & 63));
+        if (word) {
+            *hit = (w << 6) + LowestSetBit(word);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ultimo bit 1 em [first, last] de bits, de tras para frente
+bool FindLastBit(const unsigned long long *bits, int first, int last, int *hit) {
+    if (first > last) return false;
+
+    int firstWord = first >> 6;
+    int lastWord = last >> 6;
+    for (int w = lastWord; w >= firstWord; w--) {
+        unsigned long long word = bits[w];
+        if (w == firstWord) word &= ~0ULL << (first & 63);
+        if (w == lastWord) word &= ~0ULL >> (63 - (last & 63));
+        if (word) {
+            *hit = (w << 6) + HighestSetBit(word);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bloco solido na celula (x, y); fora do mapa e vazio
+bool IsSolidTile(TileMap *map, int x, int y) {
+    if (x < 0 || y < 0 || x >= map->cols || y >= map->rows) return false;
+
+    MapChunk *chunk = GetMapChunk(map, x / MAP_CHUNK_COLUMNS);
+    int c = x % MAP_CHUNK_COLUMNS;
+    return (chunk->collision.solid[(size_t)y * MAP_CHUNK_WORDS + (c >> 6)] >> (c & 63)) & 1;
+}
+
+// Primeiro bloco solido (menor y) nas linhas [minY, maxY] da coluna x, pela camada por coluna do pedaco, onde
+// as linhas da coluna sao bits seguidos
+bool FindSolidInColumn(TileMap *map, int x, int minY, int maxY, int *hitY) {
+    if (x < 0 || x >= map->cols) return false;
+    if (minY < 0) minY = 0;
+    if (maxY > map->rows - 1) maxY = map->rows - 1;
+
+    MapChunk *chunk = GetMapChunk(map, x / MAP_CHUNK_COLUMNS);
+    int firstBit = (x % MAP_CHUNK_COLUMNS) * map->rows;
+    if (!FindFirstBit(chunk->collision.solidColumns, firstBit + minY, firstBit + maxY, hitY)) return false;
+    *hitY -= firstBit;
+    return true;
+}
+
+// Ultimo bloco solido (maior y) nas linhas [minY, maxY] da coluna x
+bool FindLastSolidInColumn(TileMap *map, int x, int minY, int maxY, int *hitY) {
+    if (x < 0 || x >= map->cols) return false;
+    if (minY < 0) minY = 0;
+    if (maxY > map->rows - 1) maxY = map->rows - 1;
+
+    MapChunk *chunk = GetMapChunk(map, x / MAP_CHUNK_COLUMNS);
+    int firstBit = (x % MAP_CHUNK_COLUMNS) * map->rows;
+    if (!FindLastBit(chunk->collision.solidColumns, firstBit + minY, firstBit + maxY, hitY)) return false;
+    *hitY -= firstBit;
+    return true;
+}
+
+// Primeiro bloco solido (menor x) nas colunas [minX, maxX] da linha y, pedaco por pedaco
+bool FindSolidInRow(TileMap *map, int y, int minX, int maxX, int *hitX) {
+    if (y < 0 || y >= map->rows) return false;
+    if (minX < 0) minX = 0;
+    if (maxX > map->cols - 1) maxX = map->cols - 1;
+
+    for (int index = minX / MAP_CHUNK_COLUMNS; minX <= maxX; index++) {
+        MapChunk *chunk = GetMapChunk(map, index);
+        int firstColumn = index * MAP_CHUNK_COLUMNS;
+        int last = (maxX < firstColumn + MAP_CHUNK_COLUMNS) ? maxX - firstColumn : MAP_CHUNK_COLUMNS - 1;
+        if (FindFirstBit(&chunk->collision.solid[(size_t)y * MAP_CHUNK_WORDS], minX - firstColumn, last, hitX)) {
+            *hitX += firstColumn;
+            return true;
+        }
+        minX = firstColumn + MAP_CHUNK_COLUMNS;
+    }
+    return false;
+}
+
+// Ultimo bloco solido (maior x) nas colunas [minX, maxX] da linha y, de tras para frente
+bool FindLastSolidInRow(TileMap *map, int y, int minX, int maxX, int *hitX) {
+    if (y < 0 || y >= map->rows) return false;
+    if (minX < 0) minX = 0;
+    if (maxX > map->cols - 1) maxX = map->cols - 1;
+
+    for (int index = maxX / MAP_CHUNK_COLUMNS; minX <= maxX; index--) {
+        MapChunk *chunk = GetMapChunk(map, index);
+        int firstColumn = index * MAP_CHUNK_COLUMNS;
+        int first = (minX > firstColumn) ? minX - firstColumn : 0;
+        if (FindLastBit(&chunk->collision.solid[(size_t)y * MAP_CHUNK_WORDS], first, maxX - firstColumn, hitX)) {
+            *hitX += firstColumn;
+            return true;
+        }
+        maxX = firstColumn - 1;
+    }
+    return false;
+}
+
+// Ha bloco solido logo abaixo do retangulo, em alguma das colunas que ele ocupa
+bool IsGroundBelow(TileMap *map, Rectangle rect, float blockSize) {
+    TileRange range = QueryTileRange(rect, map->rows, map->cols, blockSize);
+    int hitX;
+    return FindSolidInRow(map, (int)floorf((rect.y + rect.height) / blockSize), range.minX, range.maxX, &hitX);
+}
+
+// Primeiro bloco solido no segmento from -> to. Na mesma linha a busca anda 64 colunas por palavra; nas outras
+// direcoes anda coluna por coluna e testa de uma vez as linhas que o segmento cruza em cada coluna. time e a
+// fracao do segmento ate o bloco e face, por onde entrou (FACE_NONE se from ja esta dentro dele)
+TileHit RaycastTiles(TileMap *map, Vector2 from, Vector2 to, float blockSize) {
+    TileHit result = {false, 0, 0, FACE_NONE, 1.0f};
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    int startColumn = (int)floorf(from.x / blockSize);
+    int endColumn = (int)floorf(to.x / blockSize);
+    int startRow = (int)floorf(from.y / blockSize);
+    int endRow = (int)floorf(to.y / blockSize);
+    int step = (endColumn >= startColumn) ? 1 : -1;
+
+    // Colunas fora do mapa nao tem blocos
+    int firstColumn = (step > 0) ? startColumn : endColumn;
+    int lastColumn = (step > 0) ? endColumn : startColumn;
+    if (lastColumn < 0 || firstColumn >= map->cols) return result;
+    if (firstColumn < 0) firstColumn = 0;
+    if (lastColumn > map->cols - 1) lastColumn = map->cols - 1;
+
+    if (startRow == endRow) {
+        int hitX;
+        if (!((step > 0) ? FindSolidInRow(map, startRow, firstColumn, lastColumn, &hitX) : FindLastSolidInRow(map, startRow, firstColumn, lastColumn, &hitX))) {
+            return result;
+        }
+        if (hitX == startColumn) return (TileHit){true, hitX, startRow, FACE_NONE, 0.0f};
+
+        float boundary = (step > 0) ? hitX * blockSize : (hitX + 1) * blockSize;
+        return (TileHit){true, hitX, startRow, (step > 0) ? FACE_LEFT : FACE_RIGHT, (boundary - from.x) / dx};
+    }
+
+    int column = (step > 0) ? firstColumn : lastColumn;
+    int stopColumn = (step > 0) ? lastColumn : firstColumn;
+    for (;; column += step) {
+        // Trecho [enter, exit] do segmento dentro da coluna e as linhas que ele cruza
+        float enter = 0.0f, exit = 1.0f;
+        if (dx != 0) {
+            float left = (column * blockSize - from.x) / dx;
+            float right = ((column + 1) * blockSize - from.x) / dx;
+            enter = fmaxf(fminf(left, right), 0.0f);
+            exit = fminf(fmaxf(left, right), 1.0f);
+        }
+        float enterY = from.y + dy * enter;
+        float exitY = from.y + dy * exit;
+        int minY = (int)floorf(fminf(enterY, exitY) / blockSize);
+        int maxY = (int)floorf(fmaxf(enterY, exitY) / blockSize);
+
+        // Descendo o primeiro bloco tocado e o de menor y, subindo o de maior
+        int hitY;
+        if ((dy > 0) ? FindSolidInColumn(map, column, minY, maxY, &hitY) : FindLastSolidInColumn(map, column, minY, maxY, &hitY)) {
+            float boundary = (dy > 0) ? hitY * blockSize : (hitY + 1) * blockSize;
+            float rowTime = (dy != 0) ? (boundary - from.y) / dy : 0.0f;
+            if (rowTime > enter) {
+                return (TileHit){true, column, hitY, (dy > 0) ? FACE_TOP : FACE_BOTTOM, rowTime};
+            }
+            if (enter > 0) {
+                return (TileHit){true, column, hitY, (step > 0) ? FACE_LEFT : FACE_RIGHT, enter};
+            }
+            return (TileHit){true, column, hitY, FACE_NONE, 0.0f};
+        }
+
+        if (column == stopColumn) break;
+    }
+    return result;
+}
+
+// Nenhum bloco solido entre from e to (inimigo enxergando o jogador, por exemplo)
+bool HasLineOfSight(TileMap *map, Vector2 from, Vector2 to, float blockSize) {
+    return !RaycastTiles(map, from, to, blockSize).hit;
+}
+
+// Varre o retangulo ao longo de delta pela grade do mapa (DDA), visitando so as celulas
+// que a borda da frente atravessa neste frame. Retorna o primeiro bloco solido tocado,
+// a face por onde entrou e a fracao do movimento ate o contato, entao nada atravessa blocos
+// mesmo com dt grande.
+TileHit SweepRectThroughTiles(Rectangle rect, Vector2 delta, TileMap *map, float blockSize) {
+    TileHit result = {false, 0, 0, FACE_NONE, 1.0f};
+
+    // Ja comeca dentro de um bloco
+    TileRange start = QueryTileRange(rect, map->rows, map->cols, blockSize);
+    for (int y = start.minY; y <= start.maxY; y++) {
+        int hitX;
+        if (FindSolidInRow(map, y, start.minX, start.maxX, &hitX)) {
+            result = (TileHit){true, hitX, y, FACE_NONE, 0.0f};
+            return result;
+        }
+    }
+
+    // Proxima coluna/linha que a borda da frente vai entrar e o tempo (0..1) ate chegar nela
+    int stepX = (delta.x > 0) ? 1 : -1;
+    int stepY = (delta.y > 0) ? 1 : -1;
+    int nextX = (delta.x > 0) ? (int)ceilf((rect.x + rect.width) / blockSize) : (int)floorf(rect.x / blockSize) - 1;
+    int nextY = (delta.y > 0) ? (int)ceilf((rect.y + rect.height) / blockSize) : (int)floorf(rect.y / blockSize) - 1;
+    float timeX = INFINITY;
+    float timeY = INFINITY;
+    float timeStepX = INFINITY;
+    float timeStepY = INFINITY;
+
+    if (delta.x != 0) {
+        float edge = (delta.x > 0) ? rect.x + rect.width : rect.x;
+        float boundary = (delta.x > 0) ? nextX * blockSize : (nextX + 1) * blockSize;
+        timeX = (boundary - edge) / delta.x;
+        timeStepX = blockSize / fabsf(delta.x);
+    }
+    if (delta.y != 0) {
+        float edge = (delta.y > 0) ? rect.y + rect.height : rect.y;
+        float boundary = (delta.y > 0) ? nextY * blockSize : (nextY + 1) * blockSize;
+        timeY = (boundary - edge) / delta.y;
+        timeStepY = blockSize / fabsf(delta.y);
+    }
+
+    while (timeX <= 1.0f || timeY <= 1.0f) {
+        if (timeX <= timeY) {
+            // Sai do mapa nesse eixo, nao ha mais blocos para bater
+            if (nextX < 0 || nextX >= map->cols) {
+                timeX = INFINITY;
+                continue;
+            }
+
+            // Linhas que o retangulo ocupa no instante em que entra na coluna nextX
+            Rectangle swept = {rect.x, rect.y + delta.y * timeX, rect.width, rect.height};
+            TileRange span = QueryTileRange(swept, map->rows, map->cols, blockSize);
+            int hitY;
+            if (FindSolidInColumn(map, nextX, span.minY, span.maxY, &hitY)) {
+                result = (TileHit){true, nextX, hitY, (stepX > 0) ? FACE_LEFT : FACE_RIGHT, timeX};
+                return result;
+            }
+
+            nextX += stepX;
+            timeX += timeStepX;
+        } else {
+            if (nextY < 0 || nextY >= map->rows) {
+                timeY = INFINITY;
+                continue;
+            }
+
+            Rectangle swept = {rect.x + delta.x * timeY, rect.y, rect.width, rect.height};
+            TileRange span = QueryTileRange(swept, map->rows, map->cols, blockSize);
+            int hitX;
+            if (FindSolidInRow(map, nextY, span.minX, span.maxX, &hitX)) {
+                result = (TileHit){true, hitX, nextY, (stepY > 0) ? FACE_TOP : FACE_BOTTOM, timeY};
+                return result;
+            }
+
+            nextY += stepY;
+            timeY += timeStepY;
+        }
+    }
+
+    return result;
+}
+
+// Integra a posicao dos projeteis; travel limita o movimento ate o ponto de contato com blocos
+void IntegrateProjectiles(float *restrict x, float *restrict y, const float *restrict speedX, const float *restrict speedY, const float *restrict travel, int count, float dt) {
+    for (int i = 0; i < count; i++) {
+        x[i] += speedX[i] * dt * travel[i];
+        y[i] += speedY[i] * dt * travel[i];
+    }
+}
+
+typedef struct {
+    ProjectilePool *projectiles;
+    TileMap *map;
+    float blockSize;
+    float dt;
+} ProjectileMoveJob;
+
+// Varredura e movimento dos projeteis [first, last), num job. Cada projetil so le o proprio estado e o mapa
+void SweepProjectileRange(void *data, int first, int last) {
+    ProjectileMoveJob *job = data;
+    ProjectilePool *projectiles = job->projectiles;
+
+    // Varre o caminho de cada projetil neste frame e guarda ate onde ele pode andar
+    for (int i = first; i < last; i++) {
+        Vector2 delta = {projectiles->speedX[i] * job->dt, projectiles->speedY[i] * job->dt};
+        TileHit hit = SweepRectThroughTiles(GetProjectileRect(projectiles, i), delta, job->map, job->blockSize);
+        projectiles->travel[i] = hit.time;
+        projectiles->expired[i] = hit.hit;  // Desativa projeteis quando batem em um bloco
+    }
+
+    // Movimento do projetil (ate o ponto de contato, se bateu)
+    IntegrateProjectiles(projectiles->x + first, projectiles->y + first, projectiles->speedX + first, projectiles->speedY + first,
+                         projectiles->travel + first, last - first, job->dt);
+}
+
+// Move projeteis quanndo disparados
+void MoveProjectiles(ProjectilePool *projectiles, float dt, Player* player, int screenWidth, TileMap *map, float blockSize, JobSystem *jobs) {
+    // Em paralelo o mapa so pode ser lido: os pedacos que as varreduras alcancam sao carregados antes, aqui.
+    // Espalhados por mais pedacos do que cabem na memoria, os projeteis sao varridos nesta thread
+    if (jobs && projectiles->count > 0) {
+        float minX = projectiles->x[0], maxX = minX;
+        for (int i = 0; i < projectiles->count; i++) {
+            float reach = fabsf(projectiles->speedX[i] * dt) + projectiles->width[i];
+            minX = fminf(minX, projectiles->x[i] - reach);
+            maxX = fmaxf(maxX, projectiles->x[i] + reach);
+        }
+        int minColumn = (int)floorf(minX / blockSize) - 1;
+        int maxColumn = (int)floorf(maxX / blockSize) + 1;
+        if (maxColumn / MAP_CHUNK_COLUMNS - minColumn / MAP_CHUNK_COLUMNS < MAP_RESIDENT_CHUNKS) {
+            PrefetchMapColumns(map, minColumn, maxColumn);
+        } else {
+            jobs = NULL;
+        }
+    }
+    ProjectileMoveJob job = {projectiles, map, blockSize, dt};
+    RunParallelFor(jobs, SweepProjectileRange, &job, projectiles->count, PROJECTILE_JOB_GRAIN);
+
+    // Remove os que bateram ou foram pra fora da tela, do fim para o comeco por causa da troca com o ultimo
+    for (int i = projectiles->count - 1; i >= 0; i--) {
+        if (projectiles->expired[i] ||
+                projectiles->x[i] < player->position.x - screenWidth ||
+                projectiles->x[i] > player->position.x + screenWidth ||
+                projectiles->y[i] < player->position.y - screenWidth ||
+                projectiles->y[i] > player->position.y + screenWidth)
+        {
+            DespawnProjectile(projectiles, i);
+        }
+    }
+}
+
+
+// Reserva memoria para o hash espacial com espaco para capacity entidades
+bool InitializeSpatialHash(SpatialHash *hash, int capacity) {
+    hash->pendingBucket = malloc(capacity * sizeof(int));
+    hash->pending = malloc(capacity * sizeof(SpatialHashEntry));
+    hash->entries = malloc(capacity * sizeof(SpatialHashEntry));
+    hash->chunkOffsets = malloc(MAX_JOB_THREADS * SPATIAL_HASH_BUCKETS * sizeof(int));
+    hash->count = 0;
+    hash->capacity = capacity;
+
+    if (!hash->pendingBucket || !hash->pending || !hash->entries || !hash->chunkOffsets) {
+        printf("Erro ao alocar o hash espacial!\n");
+        return false;
+    }
+    return true;
+}
+
+void UnloadSpatialHash(SpatialHash *hash) {
+    free(hash->pendingBucket);
+    free(hash->pending);
+    free(hash->entries);
+    free(hash->chunkOffsets);
+    hash->count = 0;
+    hash->capacity = 0;
+}
+
+// Balde da celula (cellX, cellY)
+int SpatialHashBucket(int cellX, int cellY) {
+    unsigned h = ((unsigned)cellX * 73856093u) ^ ((unsigned)cellY * 19349663u);
+    return (int)(h & (SPATIAL_HASH_BUCKETS - 1));
+}
+
+// Limpa o hash para o proximo frame
+void ClearSpatialHash(SpatialHash *hash) {
+    hash->count = 0;
+}
+
+// Entrada da entidade, na celula do canto superior esquerdo do retangulo
+SpatialHashEntry MakeSpatialHashEntry(EntityType type, int index, Rectangle rect) {
+    return (SpatialHashEntry){index * ENTITY_TYPE_COUNT + type,
+                              (int)floorf(rect.x / SPATIAL_CELL_SIZE), (int)floorf(rect.y / SPATIAL_CELL_SIZE)};
+}
+
+// Aumenta o espaco do hash para capacity entidades, mantendo as ja registradas. false se faltar memoria
+bool GrowSpatialHash(SpatialHash *hash, int capacity) {
+    int *pendingBucket = realloc(hash->pendingBucket, capacity * sizeof(int));
+    if (pendingBucket) hash->pendingBucket = pendingBucket;
+    SpatialHashEntry *pending = realloc(hash->pending, capacity * sizeof(SpatialHashEntry));
+    if (pending) hash->pending = pending;
+    SpatialHashEntry *entries = realloc(hash->entries, capacity * sizeof(SpatialHashEntry));
+    if (entries) hash->entries = entries;
+    if (!pendingBucket || !pending || !entries) {
+        printf("Erro ao aumentar o hash espacial para %d entidades!\n", capacity);
+        return false;
+    }
+    hash->capacity = capacity;
+    return true;
+}
+
+// Registra uma entidade pelo canto superior esquerdo do seu retangulo. Sem memoria para crescer o jogo para:
+// uma entidade fora do hash deixaria de colidir sem aviso
+void InsertSpatialHash(SpatialHash *hash, EntityType type, int index, Rectangle rect) {
+    if (hash->count == hash->capacity && !GrowSpatialHash(hash, hash->capacity * 2 + 64)) {
+        exit(1);
+    }
+
+    SpatialHashEntry entry = MakeSpatialHashEntry(type, index, rect);
+    hash->pendingBucket[hash->count] = SpatialHashBucket(entry.cellX, entry.cellY);
+    hash->pending[hash->count] = entry;
+    hash->count++;
+}
+
+// Agrupa as entidades registradas por balde, mantendo a ordem de insercao dentro de cada um
+void FinishSpatialHash(SpatialHash *hash) {
+    memset(hash->bucketStart, 0, sizeof(hash->bucketStart));
+
+    for (int i = 0; i < hash->count; i++) {
+        hash->bucketStart[hash->pendingBucket[i] + 1]++;
+    }
+    for (int b = 0; b < SPATIAL_HASH_BUCKETS; b++) {
+        hash->bucketStart[b + 1] += hash->bucketStart[b];
+    }
+
+    // bucketStart vira cursor de escrita e depois e deslocado de volta
+    for (int i = 0; i < hash->count; i++) {
+        int bucket = hash->pendingBucket[i];
+        int slot = hash->bucketStart[bucket];
+        hash->entries[slot] = hash->pending[i];
+        hash->bucketStart[bucket]++;
+    }
+    for (int b = SPATIAL_HASH_BUCKETS; b > 0; b--) {
+        hash->bucketStart[b] = hash->bucketStart[b - 1];
+    }
+    hash->bucketStart[0] = 0;
+}
+
+// Comeca a consulta das entidades do tipo pedido que podem tocar a area. O teste exato fica por conta de quem
+// chama; cada entidade aparece uma vez so, porque so conta no balde quando a celula dela e a celula visitada
+SpatialHashQuery BeginSpatialHashQuery(SpatialHash *hash, Rectangle area, EntityType type) {
+    SpatialHashQuery query;
+    query.hash = hash;
+    query.type = type;
+
+    // Como as entidades entram pelo canto superior esquerdo, a busca comeca uma celula antes
+    query.minCellX = (int)floorf((area.x - SPATIAL_CELL_SIZE) / SPATIAL_CELL_SIZE);
+    query.maxCellX = (int)floorf((area.x + area.width) / SPATIAL_CELL_SIZE);
+    query.maxCellY = (int)floorf((area.y + area.height) / SPATIAL_CELL_SIZE);
+    query.cellX = query.minCellX - 1;   // O primeiro NextSpatialHashResult avanca para a primeira celula
+    query.cellY = (int)floorf((area.y - SPATIAL_CELL_SIZE) / SPATIAL_CELL_SIZE);
+    query.entry = 0;
+    query.end = 0;
+    return query;
+}
+
+// Proxima entidade da consulta em index; false quando acabaram as celulas da area
+bool NextSpatialHashResult(SpatialHashQuery *query, int *index) {
+    SpatialHash *hash = query->hash;
+
+    for (;;) {
+        while (query->entry < query->end) {
+            SpatialHashEntry *entry = &hash->entries[query->entry++];
+            if (entry->cellX == query->cellX && entry->cellY == query->cellY && entry->ref % ENTITY_TYPE_COUNT == query->type) {
+                *index = entry->ref / ENTITY_TYPE_COUNT;
+                return true;
+            }
+        }
+
+        // Proxima celula da area, linha por linha
+        if (++query->cellX > query->maxCellX) {
+            query->cellX = query->minCellX;
+            if (++query->cellY > query->maxCellY) return false;
+        }
+        int bucket = SpatialHashBucket(query->cellX, query->cellY);
+        query->entry = hash->bucketStart[bucket];
+        query->end = hash->bucketStart[bucket + 1];
+    }
+}
+
+// Montagem do hash em paralelo. As entidades ocupam posicoes fixas (inimigos, moedas, projeteis, na ordem de
+// BuildEntitySpatialHash; moeda inativa fica com balde -1) divididas em chunkCount pedacos iguais
+typedef struct {
+    SpatialHash *hash;
+    EnemyStore *enemies;
+    Coin *coins;
+    int coinCount;
+    ProjectilePool *projectiles;
+    int chunkCount, chunkSize;
+} SpatialHashBuild;
+
+// Balde e referencia das entidades dos pedacos [first, last), e quantas de cada pedaco caem em cada balde
+void CountSpatialHashChunks(void *data, int first, int last) {
+    SpatialHashBuild *build = data;
+    SpatialHash *hash = build->hash;
+    int enemyCount = build->enemies->activeCount;
+
+    for (int chunk = first; chunk < last; chunk++) {
+        int *counts = hash->chunkOffsets + chunk * SPATIAL_HASH_BUCKETS;
+        memset(counts, 0, SPATIAL_HASH_BUCKETS * sizeof(int));
+
+        int end = (chunk + 1) * build->chunkSize;
+        if (end > hash->count) end = hash->count;
+        for (int slot = chunk * build->chunkSize; slot < end; slot++) {
+            SpatialHashEntry entry;
+            bool active = true;
+            if (slot < enemyCount) {
+                entry = MakeSpatialHashEntry(ENTITY_ENEMY, slot, GetEnemyRect(build->enemies, slot));
+            } else if (slot < enemyCount + build->coinCount) {
+                int i = slot - enemyCount;
+                entry = MakeSpatialHashEntry(ENTITY_COIN, i, build->coins[i].rect);
+                active = build->coins[i].active;
+            } else {
+                int i = slot - enemyCount - build->coinCount;
+                entry = MakeSpatialHashEntry(ENTITY_PROJECTILE, i, GetProjectileRect(build->projectiles, i));
+            }
+            int bucket = active ? SpatialHashBucket(entry.cellX, entry.cellY) : -1;
+            hash->pendingBucket[slot] = bucket;
+            hash->pending[slot] = entry;
+            if (bucket >= 0) counts[bucket]++;
+        }
+    }
+}
+
+// Inicio dos baldes e posicao de escrita de cada pedaco em cada balde: dentro de um balde os pedacos ficam na
+// ordem, entao as entradas saem na mesma ordem da montagem sem threads. Um job so, depois da contagem
+void OffsetSpatialHashChunks(void *data, int first, int last) {
+    SpatialHashBuild *build = data;
+    SpatialHash *hash = build->hash;
+
+    int total = 0;
+    for (int bucket = 0; bucket < SPATIAL_HASH_BUCKETS; bucket++) {
+        hash->bucketStart[bucket] = total;
+        for (int chunk = 0; chunk < build->chunkCount; chunk++) {
+            int *slot = &hash->chunkOffsets[chunk * SPATIAL_HASH_BUCKETS + bucket];
+            int count = *slot;
+            *slot = total;
+            total += count;
+        }
+    }
+    hash->bucketStart[SPATIAL_HASH_BUCKETS] = total;
+}
+
+// Copia as referencias dos pedacos [first, last) para os baldes, depois das posicoes calculadas
+void ScatterSpatialHashChunks(void *data, int first, int last) {
+    SpatialHashBuild *build = data;
+    SpatialHash *hash = build->hash;
+
+    for (int chunk = first; chunk < last; chunk++) {
+        int *offsets = hash->chunkOffsets + chunk * SPATIAL_HASH_BUCKETS;
+        int end = (chunk + 1) * build->chunkSize;
+        if (end > hash->count) end = hash->count;
+        for (int slot = chunk * build->chunkSize; slot < end; slot++) {
+            int bucket = hash->pendingBucket[slot];
+            if (bucket >= 0) hash->entries[offsets[bucket]++] = hash->pending[slot];
+        }
+    }
+}
+
+// Reconstroi o hash com os inimigos, moedas e projeteis ativos. Com muitas entidades e threads de jobs, a
+// montagem e dividida em contagem, posicoes e copia, cada etapa dependente da anterior
+void BuildEntitySpatialHash(SpatialHash *hash, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles, JobSystem *jobs) {
+    int total = enemies->activeCount + coinCount + projectiles->count;
+    if (total > hash->capacity && !GrowSpatialHash(hash, total)) {
+        exit(1);    // Ver InsertSpatialHash
+    }
+    if (jobs && jobs->threadCount > 1 && total >= SPATIAL_HASH_JOB_MIN) {
+        SpatialHashBuild build = {hash, enemies, coins, coinCount, projectiles, jobs->threadCount, 0};
+        build.chunkSize = (total + build.chunkCount - 1) / build.chunkCount;
+        hash->count = total;
+
+        JobCounter counted = {0}, offset = {0}, scattered = {0};
+        ParallelFor(jobs, CountSpatialHashChunks, &build, build.chunkCount, 1, NULL, &counted);
+        SubmitJob(jobs, OffsetSpatialHashChunks, &build, 0, 1, &counted, &offset);
+        ParallelFor(jobs, ScatterSpatialHashChunks, &build, build.chunkCount, 1, &offset, &scattered);
+        WaitForJobs(jobs, &scattered);
+        return;
+    }
+
+    ClearSpatialHash(hash);
+
+    for (int i = 0; i < enemies->activeCount; i++) {
+        InsertSpatialHash(hash, ENTITY_ENEMY, i, GetEnemyRect(enemies, i));
+    }
+    for (int i = 0; i < coinCount; i++) {
+        if (coins[i].active) InsertSpatialHash(hash, ENTITY_COIN, i, coins[i].rect);
+    }
+    for (int i = 0; i < projectiles->count; i++) {
+        InsertSpatialHash(hash, ENTITY_PROJECTILE, i, GetProjectileRect(projectiles, i));
+    }
+
+    FinishSpatialHash(hash);
+}
+
+// Colisao entre jogador e moeda
+void CheckPlayerCoinCollision(Player* player, Coin* coins, int* coinCount, SpatialHash *hash) {
+    SpatialHashQuery query = BeginSpatialHashQuery(hash, player->rect, ENTITY_COIN);
+    int i;
+    while (NextSpatialHashResult(&query, &i)) {
+        if (coins[i].active && CheckCollisionRecs(player->rect, coins[i].rect)) {
+            player->points += coins[i].points;
+            coins[i].active = false;
+            DEBUG_LOG("Points: %d\n", player->points);
+        }
+    }
+}
+
+// Inimigo vivo que o projetil i acerta, ou -1. Mesmo criterio da busca linear: o de menor indice
+int FindProjectileTarget(ProjectilePool *projectiles, EnemyStore *enemies, SpatialHash *hash, int i) {
+    Rectangle rect = GetProjectileRect(projectiles, i);
+    SpatialHashQuery query = BeginSpatialHashQuery(hash, rect, ENTITY_ENEMY);
+
+    int target = -1;
+    int j;
+    while (NextSpatialHashResult(&query, &j)) {
+        if (enemies->health[j] > 0 && CheckCollisionRecs(rect, GetEnemyRect(enemies, j)) && (target < 0 || j < target)) {
+            target = j;
+        }
+    }
+    return target;
+}
+
+typedef struct {
+    ProjectilePool *projectiles;
+    EnemyStore *enemies;
+    SpatialHash *hash;
+} ProjectileTargetJob;
+
+// Alvo dos projeteis [first, last) com as vidas do comeco do teste, num job. So le inimigos e hash
+void FindProjectileTargetRange(void *data, int first, int last) {
+    ProjectileTargetJob *job = data;
+    for (int i = first; i < last; i++) {
+        job->projectiles->target[i] = FindProjectileTarget(job->projectiles, job->enemies, job->hash, i);
+    }
+}
+
+// Verifica coliso entre o projtil e inimigo. Os alvos sao procurados em paralelo e os acertos aplicados
+// depois, em ordem, nesta thread: o resultado e o mesmo de procurar e aplicar um projetil por vez
+void CheckProjectileEnemyCollision(ProjectilePool* projectiles, EnemyStore *enemies, Player* player, SpatialHash *hash, JobSystem *jobs) {
+    ProjectileTargetJob job = {projectiles, enemies, hash};
+    RunParallelFor(jobs, FindProjectileTargetRange, &job, projectiles->count, PROJECTILE_JOB_GRAIN);
+
+    // Do fim para o comeco, porque remover um projetil traz o ultimo (ja aplicado) para o lugar dele
+    for (int i = projectiles->count - 1; i >= 0; i--) {
+        // Vidas so diminuem: se o alvo ainda esta vivo, continua sendo o de menor indice. Se um projetil
+        // anterior o matou, procura de novo com as vidas de agora
+        int target = projectiles->target[i];
+        if (target >= 0 && enemies->health[target] <= 0) {
+            target = FindProjectileTarget(projectiles, enemies, hash, i);
+        }
+
+        if (target >= 0) {
+            // Coliso detectada reduz a vida do inimigo
+            enemies->health[target] -= 1;  // Diminui a vida; RemoveDeadEnemies desativa quem chegar a 0
+            player->points += 100;
+            DespawnProjectile(projectiles, i);  // Desativa projetil aps coliso
+        }
+    }
+}
+
+// Verifica colisao entre jogador e blocos
+bool CheckCollisionWithBlock(Rectangle player, Rectangle block, Vector2* correction) {
+    if (CheckCollisionRecs(player, block)) {
+        // TODO: Comentar o que fmin e fmax fazem e explicar cdigo
+        float overlapX = fmin(player.x + player.width, block.x + block.width) - fmax(player.x, block.x);
+        float overlapY = fmin(player.y + player.height, block.y + block.height) - fmax(player.y, block.y);
+
+        // Resolve com base na menor sobreposicao
+        if (overlapX < overlapY) {
+            correction->x = (player.x < block.x) ? -overlapX : overlapX;
+        } else {
+            correction->y = (player.y < block.y) ? -overlapY : overlapY;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// Caso haja coliso entre jogador e o bloco, e bloco seja M, usa a diferena entre as duas posies, a variavel correction,  usada para manter o jogador na sua posio.
+void HandleBlockCollision(Player *player, Rectangle block) {
+    Vector2 correction = {0, 0};
+
+    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
+        if (correction.y != 0) {  // Correo vertical
+            player->velocity.y = 0;
+            player->position.y += correction.y;
+
+            if (correction.y < 0) {
+                player->isGrounded = true;
+            }
+        } else if (correction.x != 0) {     // Correo horizontal
+            player->velocity.x = 0;
+            player->position.x += correction.x;
+        }
+
+        player->rect.x = player->position.x;
+        player->rect.y = player->position.y;
+    }
+}
+
+#ifndef HEADLESS
+// Dado um texto para preencher e uma coordenada, desenha um retngulo
+Rectangle CreateMenuButton(const char *text, int yOffset) {
+    return (Rectangle) {
+        SCREEN_WIDTH / 2 - MeasureText(text, 50) / 2,
+                     SCREEN_HEIGHT / 2 + yOffset,
+                     MeasureText(text, 50),
+                     50
+    };
+}
+
+// Desenha boto com efeito de trocar de cor quando mouse passa por cima
+void DrawButton(Rectangle button, const char *text, Vector2 mouse, Color hoverColor, Color defaultColor) {
+    Color buttonColor = CheckCollisionPointRec(mouse, button) ? hoverColor : defaultColor;
+    DrawRectangleRec(button, buttonColor);
+    DrawText(text, button.x + button.width / 2 - MeasureText(text, 20) / 2, button.y + 15, 20, BLACK);
+}
+
+// Detecta se mouse clicou em cima do boto
+int HandleButtonClick(Rectangle button, Vector2 mouse) {
+    return CheckCollisionPointRec(mouse, button) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
+}
+
+// logo vem do AssetManager, carregado uma vez so para todas as visitas ao menu
+int Menu(Texture2D logo) {
+    // Inicializao dos botes
+    Rectangle start = CreateMenuButton("Iniciar", 0);
+    Rectangle leaderboard = CreateMenuButton("Placar de pontos", 100);
+    Rectangle exit = CreateMenuButton("Sair", 200);
+
+    while (!WindowShouldClose()) {
+        BeginDrawing();
+        ClearBackground(RAYWHITE);
+
+        Vector2 mouse = GetMousePosition();
+
+        // Renderiza plano de fundo
+        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, DARKBLUE);
+        DrawTexture(logo, SCREEN_WIDTH / 2 - logo.width / 2, SCREEN_HEIGHT / 4, WHITE);
+
+        // Renderiza botes
+        DrawButton(start, "Iniciar", mouse, YELLOW, LIGHTGRAY);
+        if (HandleButtonClick(start, mouse)) {
+            return 1;
+        }
+
+        DrawButton(leaderboard, "Placar de pontos", mouse, YELLOW, LIGHTGRAY);
+        if (HandleButtonClick(leaderboard, mouse)) {
+            return 2;
+        }
+
+        DrawButton(exit, "Sair", mouse, YELLOW, LIGHTGRAY);
+        if (HandleButtonClick(exit, mouse)) {
+            return 3;
+        }
+
+        EndDrawing();
+    }
+
+    return 0;
+}
+// Desenha a tela final do jogo, retornando uma telaa de vitria ou derrota
+void DesenhaTelaFinal(void) {
+    while(!IsKeyPressed(KEY_ENTER)) {
+        BeginDrawing();
+        ClearBackground(RAYWHITE);
+        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, RED);
+        DrawText("YOU FAILED!",(SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT - 30) / 2, 60, WHITE);
+        DrawText("Aperte enter para voltar ao menu", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT + 60) / 2, 40, WHITE);
+        // volta para o menu
+        EndDrawing();
+    }
+}
+#endif
+
+// Colisao entre jogador e inimigo
+void HandlePlayerEnemyCollision(Player* player, EnemyStore *enemies, int* currentFrame, float dt, SpatialHash *hash) {
+    SpatialHashQuery query = BeginSpatialHashQuery(hash, player->rect, ENTITY_ENEMY);
+    int i;
+    while (NextSpatialHashResult(&query, &i)) {
+        if (CheckCollisionRecs(player->rect, GetEnemyRect(enemies, i)) && enemies->health[i] > 0) {
+            player->health -= 1;
+            *currentFrame = 11;
+
+            ReturnPlayerToSpawn(player);
+        }
+    }
+}
+
+// Caso haja coliso entre jogador e o bloco, e bloco seja O, empurra o jogador para trs de subtrai 1 de sua vida.
+void HandleObstacleCollision(Player *player, Rectangle block) {
+    Vector2 correction = {0, 0};
+    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
+        player->health -= 1;
+
+
+        // Volta o mundo para OBSTACLE_REWIND_SECONDS segundos atras, no fim do tick (SimulateTick)
+        player->rewindRequested = true;
+
+        DEBUG_LOG("Player health: %d\n", player->health);
+    }
+}
+
+// Compara dois jogadores
+int ComparaJogadores(JogadorLeader PlayerA, JogadorLeader PlayerB) {
+    // Ordena por pontos de forma decrescente
+    if (PlayerA.points != PlayerB.points) {
+        return PlayerB.points - PlayerA.points; // Maior pontuao primeiro
+    }
+
+    // Se as pontuaes forem iguais, ordena por nome em ordem alfabtica
+    return strcmp(PlayerA.nome, PlayerB.nome);
+}
+
+// Ordem do placar; empates completos (mesmo nome e pontos) ficam na ordem em que foram registrados
+int CompareLeaderboardEntries(Leaderboard *leaderboard, int a, int b) {
+    int order = ComparaJogadores(leaderboard->entries[a], leaderboard->entries[b]);
+    if (order != 0) return order;
+    return (a > b) - (a < b);
+}
+
+int LeaderboardHeight(Leaderboard *leaderboard, int node) {
+    return (node < 0) ? 0 : leaderboard->nodes[node].height;
+}
+
+int LeaderboardSize(Leaderboard *leaderboard, int node) {
+    return (node < 0) ? 0 : leaderboard->nodes[node].size;
+}
+
+void UpdateLeaderboardNode(Leaderboard *leaderboard, int node) {
+    LeaderboardNode *n = &leaderboard->nodes[node];
+    int left = LeaderboardHeight(leaderboard, n->left);
+    int right = LeaderboardHeight(leaderboard, n->right);
+    n->height = 1 + (left > right ? left : right);
+    n->size = 1 + LeaderboardSize(leaderboard, n->left) + LeaderboardSize(leaderboard, n->right);
+}
+
+int RotateLeaderboardLeft(Leaderboard *leaderboard, int node) {
+    int pivot = leaderboard->nodes[node].right;
+    leaderboard->nodes[node].right = leaderboard->nodes[pivot].left;
+    leaderboard->nodes[pivot].left = node;
+    UpdateLeaderboardNode(leaderboard, node);
+    UpdateLeaderboardNode(leaderboard, pivot);
+    return pivot;
+}
+
+int RotateLeaderboardRight(Leaderboard *leaderboard, int node) {
+    int pivot = leaderboard->nodes[node].left;
+    leaderboard->nodes[node].left = leaderboard->nodes[pivot].right;
+    leaderboard->nodes[pivot].right = node;
+    UpdateLeaderboardNode(leaderboard, node);
+    UpdateLeaderboardNode(leaderboard, pivot);
+    return pivot;
+}
+
+// Insere entry na subarvore de node e devolve a nova raiz dela, rebalanceada
+int InsertLeaderboardNode(Leaderboard *leaderboard, int node, int entry) {
+    if (node < 0) {
+        leaderboard->nodes[entry] = (LeaderboardNode){-1, -1, 1, 1};
+        return entry;
+    }
+
+    LeaderboardNode *n = &leaderboard->nodes[node];
+    if (CompareLeaderboardEntries(leaderboard, entry, node) < 0) {
+        n->left = InsertLeaderboardNode(leaderboard, n->left, entry);
+    } else {
+        n->right = InsertLeaderboardNode(leaderboard, n->right, entry);
+    }
+    UpdateLeaderboardNode(leaderboard, node);
+
+    int balance = LeaderboardHeight(leaderboard, n->left) - LeaderboardHeight(leaderboard, n->right);
+    if (balance > 1) {
+        if (LeaderboardHeight(leaderboard, leaderboard->nodes[n->left].left) < LeaderboardHeight(leaderboard, leaderboard->nodes[n->left].right)) {
+            n->left = RotateLeaderboardLeft(leaderboard, n->left);
+        }
+        return RotateLeaderboardRight(leaderboard, node);
+    }
+    if (balance < -1) {
+        if (LeaderboardHeight(leaderboard, leaderboard->nodes[n->right].right) < LeaderboardHeight(leaderboard, leaderboard->nodes[n->right].left)) {
+            n->right = RotateLeaderboardRight(leaderboard, n->right);
+        }
+        return RotateLeaderboardLeft(leaderboard, node);
+    }
+    return node;
+}
+
+// Arvore perfeitamente balanceada com as entradas [first, last], que ja estao em ordem. O(n)
+int BuildLeaderboardTree(Leaderboard *leaderboard, int first, int last) {
+    if (first > last) return -1;
+    int middle = first + (last - first) / 2;
+    LeaderboardNode *n = &leaderboard->nodes[middle];
+    n->left = BuildLeaderboardTree(leaderboard, first, middle - 1);
+    n->right = BuildLeaderboardTree(leaderboard, middle + 1, last);
+    UpdateLeaderboardNode(leaderboard, middle);
+    return middle;
+}
+
+// Garante espaco para mais uma pontuacao, dobrando a capacidade quando acaba
+bool ReserveLeaderboardEntry(Leaderboard *leaderboard, int count) {
+    if (count <= leaderboard->capacity) return true;
+
+    int capacity = leaderboard->capacity ? leaderboard->capacity : 64;
+    while (capacity < count) capacity *= 2;
+    JogadorLeader *entries = realloc(leaderboard->entries, capacity * sizeof(JogadorLeader));
+    if (!entries) {
+        printf("Erro ao alocar o placar!\n");
+        return false;
+    }
+    leaderboard->entries = entries;
+    LeaderboardNode *nodes = realloc(leaderboard->nodes, capacity * sizeof(LeaderboardNode));
+    if (!nodes) {
+        printf("Erro ao alocar o placar!\n");
+        return false;
+    }
+    leaderboard->nodes = nodes;
+    leaderboard->capacity = capacity;
+    return true;
+}
+
+// Coloca uma pontuacao na arvore (so na memoria) e devolve o indice dela
+int InsertLeaderboardEntry(Leaderboard *leaderboard, JogadorLeader entry) {
+    if (!ReserveLeaderboardEntry(leaderboard, leaderboard->count + 1)) return -1;
+
+    int index = leaderboard->count++;
+    leaderboard->entries[index] = entry;
+    leaderboard->root = InsertLeaderboardNode(leaderboard, leaderboard->root, index);
+    return index;
+}
+
+// Posicao (1 = primeiro lugar) da pontuacao de indice entry. O(log n)
+int GetLeaderboardRank(Leaderboard *leaderboard, int entry) {
+    int rank = 1;
+    int node = leaderboard->root;
+    while (node >= 0) {
+        int order = CompareLeaderboardEntries(leaderboard, entry, node);
+        if (order == 0) return rank + LeaderboardSize(leaderboard, leaderboard->nodes[node].left);
+        if (order < 0) {
+            node = leaderboard->nodes[node].left;
+        } else {
+            rank += LeaderboardSize(leaderboard, leaderboard->nodes[node].left) + 1;
+            node = leaderboard->nodes[node].right;
+        }
+    }
+    return -1;
+}
+
+// Copia as k melhores pontuacoes para out, em ordem, e devolve quantas copiou. O(k + log n)
+int GetLeaderboardTop(Leaderboard *leaderboard, JogadorLeader *out, int k) {
+    int stack[64];  // A altura de uma AVL com 2^31 nos nao passa de 45
+    int depth = 0;
+    int copied = 0;
+    int node = leaderboard->root;
+    while (copied < k && (node >= 0 || depth > 0)) {
+        while (node >= 0) {
+            stack[depth++] = node;
+            node = leaderboard->nodes[node].left;
+        }
+        node = stack[--depth];
+        out[copied++] = leaderboard->entries[node];
+        node = leaderboard->nodes[node].right;
+    }
+    return copied;
+}
+
+// FNV-1a do numero e da pontuacao do registro
+unsigned LeaderboardChecksum(LeaderboardLogRecord *record) {
+    unsigned hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&record->sequence;
+    for (size_t i = 0; i < sizeof(record->sequence); i++) hash = (hash ^ bytes[i]) * 16777619u;
+    bytes = (const unsigned char *)&record->entry;
+    for (size_t i = 0; i < sizeof(record->entry); i++) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Forca os dados do arquivo para o disco, nao so para o sistema
+bool FlushFileToDisk(FILE *file) {
+    if (fflush(file) != 0) return false;
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Troca to por from de uma vez: quem abrir to ve o arquivo antigo inteiro ou o novo inteiro, nunca um pedaco
+bool ReplaceFileAtomically(const char *from, const char *to) {
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+// Grava size bytes num arquivo novo ao lado e so troca pelo antigo depois de completo no disco
+bool WriteFileAtomically(const char *filename, const char *data, size_t size) {
+    char tempFilename[256];
+    snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
+
+    FILE *file = fopen(tempFilename, "wb");
+    if (!file) {
+        printf("Erro ao criar %s!\n", tempFilename);
+        return false;
+    }
+    bool ok = (size == 0 || fwrite(data, 1, size, file) == size) && FlushFileToDisk(file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok || !ReplaceFileAtomically(tempFilename, filename)) {
+        printf("Erro ao gravar %s!\n", filename);
+        remove(tempFilename);
+        return false;
+    }
+    return true;
+}
+
+// Le o arquivo inteiro para a memoria (malloc). NULL se nao existir ou nao der para ler
+char *ReadWholeFile(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = (length >= 0) ? malloc(length + 1) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    if (data) *size = length;
+    return data;
+}
+
+// Poe o placar inteiro em ordem no formato do arquivo compactado (cabecalho e pontuacoes, devolvido em memoria
+// para quem for gravar) e zera o contador do log. De quebra a memoria volta a ficar em ordem e a arvore
+// perfeitamente balanceada. NULL se faltar memoria
+char *CompactLeaderboard(Leaderboard *leaderboard, size_t *size) {
+    *size = sizeof(LeaderboardHeader) + (size_t)leaderboard->count * sizeof(JogadorLeader);
+    char *image = malloc(*size);
+    if (!image) {
+        printf("Erro ao alocar o placar!\n");
+        return NULL;
+    }
+    JogadorLeader *sorted = (JogadorLeader *)(image + sizeof(LeaderboardHeader));
+    int count = GetLeaderboardTop(leaderboard, sorted, leaderboard->count);
+
+    LeaderboardHeader header = {{0}, LEADERBOARD_VERSION, count, leaderboard->sequence};
+    memcpy(header.magic, LEADERBOARD_MAGIC, sizeof(header.magic));
+    memcpy(image, &header, sizeof(header));
+
+    memcpy(leaderboard->entries, sorted, count * sizeof(JogadorLeader));
+    leaderboard->count = count;
+    leaderboard->root = BuildLeaderboardTree(leaderboard, 0, count - 1);
+    leaderboard->logEntries = 0;
+    return image;
+}
+
+// Compacta e grava o placar na hora, depois zera o log. Se o programa cair antes de zerar o log, os registros
+// que ja estao no arquivo sao reconhecidos pelo numero e ignorados na leitura
+bool SaveLeaderboard(Leaderboard *leaderboard) {
+    size_t size;
+    char *image = CompactLeaderboard(leaderboard, &size);
+    bool ok = image && WriteFileAtomically(leaderboard->filename, image, size) &&
+              WriteFileAtomically(leaderboard->logFilename, NULL, 0);
+    free(image);
+    return ok;
+}
+
+// Le o placar compactado (se existir) e aplica o log. Sem placar, importa o top 5 antigo ou comeca com os
+// jogadores ficticios dele. Um registro cortado no fim do log (queda durante a gravacao) e descartado.
+// Le e grava direto no disco: no jogo roda na thread de arquivos (QueueLeaderboardLoad)
+bool LoadLeaderboard(Leaderboard *leaderboard, const char *filename, const char *logFilename) {
+    memset(leaderboard, 0, sizeof(*leaderboard));
+    leaderboard->root = -1;
+    leaderboard->filename = filename;
+    leaderboard->logFilename = logFilename;
+
+    FILE *file = fopen(filename, "rb");
+    if (file) {
+        LeaderboardHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+                memcmp(header.magic, LEADERBOARD_MAGIC, sizeof(header.magic)) != 0 ||
+                header.version != LEADERBOARD_VERSION || header.count < 0 ||
+                !ReserveLeaderboardEntry(leaderboard, header.count) ||
+                fread(leaderboard->entries, sizeof(JogadorLeader), header.count, file) != (size_t)header.count) {
+            printf("Placar %s invalido ou de outra versao\n", filename);
+            fclose(file);
+            return false;
+        }
+        fclose(file);
+
+        leaderboard->count = header.count;
+        leaderboard->sequence = header.sequence;
+        for (int i = 0; i < header.count; i++) {
+            leaderboard->entries[i].nome[MAX_NOME - 1] = '\0';
+        }
+
+        // O arquivo ja vem em ordem: a arvore sai montada em O(n). Se nao vier, insere um por um
+        bool sorted = true;
+        for (int i = 1; i < header.count && sorted; i++) {
+            sorted = CompareLeaderboardEntries(leaderboard, i - 1, i) < 0;
+        }
+        if (sorted) {
+            leaderboard->root = BuildLeaderboardTree(leaderboard, 0, header.count - 1);
+        } else {
+            for (int i = 0; i < header.count; i++) {
+                leaderboard->root = InsertLeaderboardNode(leaderboard, leaderboard->root, i);
+            }
+        }
+    } else {
+        JogadorLeader legacy[5] = {
+            {"Junior", 50},
+            {"Alerrandro", 40},
+            {"Adalberto", 110},
+            {"Dalessandro", 120},
+            {"Fernandao", 150}
+        };
+        FILE *legacyFile = fopen(LEADERBOARD_LEGACY_FILE, "rb");
+        if (legacyFile) {
+            if (fread(legacy, sizeof(JogadorLeader), 5, legacyFile) == 5) {
+                printf("Importando o top 5 de %s\n", LEADERBOARD_LEGACY_FILE);
+            }
+            fclose(legacyFile);
+        }
+        for (int i = 0; i < 5; i++) {
+            legacy[i].nome[MAX_NOME - 1] = '\0';
+            if (InsertLeaderboardEntry(leaderboard, legacy[i]) < 0) return false;
+        }
+    }
+
+    // Registros do log ainda nao compactados
+    bool truncated = false;
+    FILE *log = fopen(logFilename, "rb");
+    if (log) {
+        LeaderboardLogRecord record;
+        long records = 0;
+        while (fread(&record, sizeof(record), 1, log) == 1 && record.checksum == LeaderboardChecksum(&record)) {
+            records++;
+            if (record.sequence <= leaderboard->sequence) continue;  // Ja compactado antes de o log ser zerado
+            record.entry.nome[MAX_NOME - 1] = '\0';
+            if (InsertLeaderboardEntry(leaderboard, record.entry) < 0) {
+                fclose(log);
+                return false;
+            }
+            leaderboard->sequence = record.sequence;
+            leaderboard->logEntries++;
+        }
+        // Qualquer byte alem dos registros bons e de uma gravacao interrompida
+        fseek(log, 0, SEEK_END);
+        truncated = ftell(log) != records * (long)sizeof(record);
+        fclose(log);
+    }
+
+    // Sem arquivo compactado ainda, ou com lixo no fim do log: compacta agora para o log voltar a ficar limpo
+    if (!file || truncated) {
+        if (truncated) printf("Registro incompleto no fim de %s descartado\n", logFilename);
+        if (!SaveLeaderboard(leaderboard)) return false;
+    }
+    leaderboard->loaded = true;
+    return true;
+}
+
+void UnloadLeaderboard(Leaderboard *leaderboard) {
+    free(leaderboard->entries);
+    free(leaderboard->nodes);
+    memset(leaderboard, 0, sizeof(*leaderboard));
+    leaderboard->root = -1;
+}
+
+void LockIoQueue(IoQueue *io) {
+#if defined(_WIN32)
+    EnterCriticalSection(&io->lock);
+#else
+    pthread_mutex_lock(&io->lock);
+#endif
+}
+
+void UnlockIoQueue(IoQueue *io) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&io->lock);
+#else
+    pthread_mutex_unlock(&io->lock);
+#endif
+}
+
+// Espera (com a fila travada) por pedido novo (work) ou por andamento da thread e do jogo
+void WaitIoQueue(IoQueue *io, bool work) {
+#if defined(_WIN32)
+    SleepConditionVariableCS(work ? &io->workReady : &io->progress, &io->lock, INFINITE);
+#else
+    pthread_cond_wait(work ? &io->workReady : &io->progress, &io->lock);
+#endif
+}
+
+void WakeIoQueue(IoQueue *io, bool work) {
+#if defined(_WIN32)
+    WakeAllConditionVariable(work ? &io->workReady : &io->progress);
+#else
+    pthread_cond_broadcast(work ? &io->workReady : &io->progress);
+#endif
+}
+
+// Fecha o log que a thread mantem aberto entre acrescimos
+void CloseIoAppendFile(IoQueue *io) {
+    if (io->appendFile) fclose(io->appendFile);
+    io->appendFile = NULL;
+    io->appendFilename = NULL;
+}
+
+#ifndef HEADLESS
+// Le e decodifica o arquivo do asset, na thread. Nada de GPU ou audio aqui: so a thread principal pode
+bool DecodeAsset(Asset *asset) {
+    double start = GetTime();
+    bool ok;
+    if (asset->type == ASSET_SOUND || asset->type == ASSET_WAVE) {
+        asset->wave = LoadWave(asset->path);
+        ok = asset->wave.data != NULL;
+    } else {
+        asset->image = LoadImage(asset->path);
+        ok = asset->image.data != NULL;
+    }
+    asset->decodeSeconds = GetTime() - start;
+    return ok;
+}
+
+// Libera o que a thread decodificou e ainda nao foi enviado
+void UnloadDecodedAsset(Asset *asset) {
+    if (asset->image.data) UnloadImage(asset->image);
+    if (asset->wave.data) UnloadWave(asset->wave);
+    asset->image = (Image){0};
+    asset->wave = (Wave){0};
+}
+#endif
+
+// Atende um pedido, na thread de arquivos (ou na hora, sem thread). Os erros sao avisados aqui mesmo.
+// O ultimo arquivo que recebeu acrescimos fica aberto, como o log do placar antes da thread existir
+void ExecuteIoRequest(IoQueue *io, IoRequest *request) {
+    switch (request->type) {
+        case IO_WRITE_FILE:
+            if (io->appendFilename && strcmp(io->appendFilename, request->filename) == 0) CloseIoAppendFile(io);
+            request->ok = WriteFileAtomically(request->filename, request->data, request->size);
+            break;
+        case IO_APPEND_FILE:
+            if (io->appendFilename && strcmp(io->appendFilename, request->filename) != 0) CloseIoAppendFile(io);
+            if (!io->appendFile) {
+                io->appendFile = fopen(request->filename, "ab");
+                io->appendFilename = io->appendFile ? request->filename : NULL;
+            }
+            request->ok = io->appendFile && fwrite(request->data, 1, request->size, io->appendFile) == request->size &&
+                          fflush(io->appendFile) == 0;
+            if (!request->ok) printf("Erro ao gravar %s!\n", request->filename);
+            break;
+        case IO_READ_FILE:
+            request->data = ReadWholeFile(request->filename, &request->size);
+            request->ok = request->data != NULL;
+            break;
+        case IO_LOAD_LEADERBOARD:
+            request->ok = LoadLeaderboard(request->leaderboard, request->leaderboard->filename, request->leaderboard->logFilename);
+            break;
+        case IO_DECODE_ASSET:
+#ifndef HEADLESS
+            request->ok = DecodeAsset(request->asset);
+#endif
+            break;
+        case IO_READ_MAP_CHUNK:
+            request->ok = ReadQueuedMapChunk(request->map, request->chunk, &request->data, &request->size);
+            break;
+    }
+}
+
+// Conclusao que o jogo nao tratou por conta propria: um placar lido substitui a copia do jogo (se leaderboard
+// nao for NULL), um pedaco do mapa vai para a posicao dele e os dados do pedido sao liberados
+void FinishIoRequest(IoRequest *request, Leaderboard *leaderboard) {
+    if (request->type == IO_READ_MAP_CHUNK) {
+        if (request->ok) {
+            InstallMapChunk(request->map, request->chunk, request->data);
+        } else {
+            printf("Erro ao ler o pedaco %d de %s; sera lido na hora\n", request->chunk, request->filename);
+            MapChunk *chunk = &request->map->chunks[request->chunk & (MAP_RESIDENT_CHUNKS - 1)];
+            if (chunk->requested == request->chunk) chunk->requested = -1;
+        }
+    }
+    if (request->type == IO_LOAD_LEADERBOARD) {
+        if (request->ok && leaderboard) {
+            UnloadLeaderboard(leaderboard);
+            *leaderboard = *request->leaderboard;
+        } else {
+            if (!request->ok) printf("Erro ao carregar o placar %s; pontuacoes novas nao serao gravadas\n", request->filename);
+            UnloadLeaderboard(request->leaderboard);
+        }
+        free(request->leaderboard);
+    }
+#ifndef HEADLESS
+    if (request->type == IO_DECODE_ASSET) UnloadDecodedAsset(request->asset);
+#endif
+    free(request->data);
+    request->data = NULL;
+    request->leaderboard = NULL;
+}
+
+// Entrega o pedido atendido ao jogo (com a fila travada). Gravacoes nao tem conclusao: os erros ja foram
+// avisados e os dados podem ser liberados. Com a fila de conclusoes cheia a thread espera o jogo retirar alguma
+void PostIoCompletion(IoQueue *io, IoRequest *request) {
+    if (request->type == IO_WRITE_FILE || request->type == IO_APPEND_FILE) {
+        free(request->data);
+        return;
+    }
+    while (io->completionCount == IO_QUEUE_CAPACITY && io->threaded && !io->stop) {
+        WaitIoQueue(io, false);
+    }
+    if (io->completionCount == IO_QUEUE_CAPACITY) {
+        printf("Leitura de %s descartada: fila de conclusoes cheia\n", request->filename);
+        FinishIoRequest(request, NULL);
+        return;
+    }
+    io->completions[(io->firstCompletion + io->completionCount) % IO_QUEUE_CAPACITY] = *request;
+    io->completionCount++;
+}
+
+// Laco da thread de arquivos: atende os pedidos na ordem ate stop, terminando os que ja estavam na fila
+#if defined(_WIN32)
+DWORD WINAPI RunIoThread(LPVOID data) {
+#else
+void *RunIoThread(void *data) {
+#endif
+    IoQueue *io = data;
+
+    LockIoQueue(io);
+    while (true) {
+        while (io->requestCount == 0 && !io->stop) {
+            WaitIoQueue(io, true);
+        }
+        if (io->requestCount == 0) break;
+
+        IoRequest request = io->requests[io->firstRequest];
+        io->firstRequest = (io->firstRequest + 1) % IO_QUEUE_CAPACITY;
+        io->requestCount--;
+        io->busy = true;
+        WakeIoQueue(io, false);     // Espaco para mais um pedido
+        UnlockIoQueue(io);
+
+        ExecuteIoRequest(io, &request);
+
+        LockIoQueue(io);
+        PostIoCompletion(io, &request);
+        io->busy = false;
+        WakeIoQueue(io, false);
+    }
+    UnlockIoQueue(io);
+
+    CloseIoAppendFile(io);
+    return 0;
+}
+
+// Cria as filas e, com threaded, a thread de arquivos. Se a thread nao puder ser criada os pedidos sao
+// atendidos na hora, por quem pediu
+void InitializeIoQueue(IoQueue *io, bool threaded) {
+    memset(io, 0, sizeof(*io));
+#if defined(_WIN32)
+    InitializeCriticalSection(&io->lock);
+    InitializeConditionVariable(&io->workReady);
+    InitializeConditionVariable(&io->progress);
+    if (threaded) {
+        io->thread = CreateThread(NULL, 0, RunIoThread, io, 0, NULL);
+        io->threaded = io->thread != NULL;
+    }
+#else
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->workReady, NULL);
+    pthread_cond_init(&io->progress, NULL);
+    if (threaded) {
+        io->threaded = pthread_create(&io->thread, NULL, RunIoThread, io) == 0;
+    }
+#endif
+    if (threaded && !io->threaded) {
+        printf("Aviso: thread de arquivos nao criada; arquivos serao lidos e gravados na hora\n");
+    }
+}
+
+// Poe o pedido na fila (a fila fica com ele, inclusive com data). So espera se ja houver IO_QUEUE_CAPACITY
+// pedidos parados na fila
+void SubmitIoRequest(IoQueue *io, IoRequest *request) {
+    if (!io->threaded) {
+        ExecuteIoRequest(io, request);
+        LockIoQueue(io);
+        PostIoCompletion(io, request);
+        UnlockIoQueue(io);
+        return;
+    }
+
+    LockIoQueue(io);
+    while (io->requestCount == IO_QUEUE_CAPACITY) {
+        WaitIoQueue(io, false);
+    }
+    io->requests[(io->firstRequest + io->requestCount) % IO_QUEUE_CAPACITY] = *request;
+    io->requestCount++;
+    WakeIoQueue(io, true);
+    UnlockIoQueue(io);
+}
+
+// Retira uma conclusao, sem esperar. false se nenhuma leitura terminou desde a ultima chamada
+bool PollIoCompletion(IoQueue *io, IoRequest *request) {
+    bool found = false;
+    LockIoQueue(io);
+    if (io->completionCount > 0) {
+        *request = io->completions[io->firstCompletion];
+        io->firstCompletion = (io->firstCompletion + 1) % IO_QUEUE_CAPACITY;
+        io->completionCount--;
+        WakeIoQueue(io, false);
+        found = true;
+    }
+    UnlockIoQueue(io);
+    return found;
+}
+
+// Espera a thread atender todos os pedidos feitos ate agora
+void WaitIoIdle(IoQueue *io) {
+    LockIoQueue(io);
+    while (io->requestCount > 0 || io->busy) {
+        WaitIoQueue(io, false);
+    }
+    UnlockIoQueue(io);
+}
+
+// Termina os pedidos que ainda estao na fila, encerra a thread e descarta as conclusoes nao retiradas
+void UnloadIoQueue(IoQueue *io) {
+    if (io->threaded) {
+        LockIoQueue(io);
+        io->stop = true;
+        WakeIoQueue(io, true);
+        WakeIoQueue(io, false);
+        UnlockIoQueue(io);
+#if defined(_WIN32)
+        WaitForSingleObject(io->thread, INFINITE);
+        CloseHandle(io->thread);
+#else
+        pthread_join(io->thread, NULL);
+#endif
+    }
+    CloseIoAppendFile(io);
+
+    IoRequest request;
+    while (PollIoCompletion(io, &request)) {
+        FinishIoRequest(&request, NULL);
+    }
+#if defined(_WIN32)
+    DeleteCriticalSection(&io->lock);
+#else
+    pthread_cond_destroy(&io->progress);
+    pthread_cond_destroy(&io->workReady);
+    pthread_mutex_destroy(&io->lock);
+#endif
+}
+
+// Substitui o arquivo por size bytes de data (a fila fica com data, que tem que vir do malloc).
+// filename tem que continuar valido ate o pedido ser atendido
+void QueueFileWrite(IoQueue *io, const char *filename, char *data, size_t size) {
+    IoRequest request = {IO_WRITE_FILE, IO_TAG_NONE, filename, data, size, NULL, false};
+    SubmitIoRequest(io, &request);
+}
+
+// Acrescenta size bytes de data no fim do arquivo (a fila fica com data)
+void QueueFileAppend(IoQueue *io, const char *filename, char *data, size_t size) {
+    IoRequest request = {IO_APPEND_FILE, IO_TAG_NONE, filename, data, size, NULL, false};
+    SubmitIoRequest(io, &request);
+}
+
+// Le o arquivo inteiro; o conteudo chega numa conclusao com a mesma tag (ok false se nao existir)
+void QueueFileRead(IoQueue *io, const char *filename, IoTag tag) {
+    IoRequest request = {IO_READ_FILE, tag, filename, NULL, 0, NULL, false};
+    SubmitIoRequest(io, &request);
+}
+
+// Pede a thread de arquivos os pedacos das colunas [minX, maxX] que nao estao na memoria nem a caminho. Entram
+// no lugar quando a conclusao passa por FinishIoRequest; se a simulacao precisar antes, GetMapChunk le na hora
+void QueueMapColumns(IoQueue *io, TileMap *map, int minX, int maxX) {
+    if (minX < 0) minX = 0;
+    if (maxX >= map->cols) maxX = map->cols - 1;
+
+    for (int index = minX / MAP_CHUNK_COLUMNS; index <= maxX / MAP_CHUNK_COLUMNS; index++) {
+        MapChunk *chunk = &map->chunks[index & (MAP_RESIDENT_CHUNKS - 1)];
+        if (chunk->index == index || chunk->requested == index) continue;
+
+        IoRequest request = {IO_READ_MAP_CHUNK, IO_TAG_NONE, map->path, NULL, 0, NULL, false};
+        request.map = map;
+        request.chunk = index;
+        chunk->requested = index;
+        SubmitIoRequest(io, &request);
+    }
+}
+
+// Deixa leaderboard vazio (loaded false) e pede a leitura do placar num placar a parte, que so substitui
+// leaderboard quando a conclusao passa por FinishIoRequest
+bool QueueLeaderboardLoad(IoQueue *io, Leaderboard *leaderboard, const char *filename, const char *logFilename) {
+    memset(leaderboard, 0, sizeof(*leaderboard));
+    leaderboard->root = -1;
+    leaderboard->filename = filename;
+    leaderboard->logFilename = logFilename;
+
+    Leaderboard *loading = malloc(sizeof(Leaderboard));
+    if (!loading) {
+        printf("Erro ao alocar o placar!\n");
+        return false;
+    }
+    *loading = *leaderboard;
+    IoRequest request = {IO_LOAD_LEADERBOARD, IO_TAG_NONE, filename, NULL, 0, loading, false};
+    SubmitIoRequest(io, &request);
+    return true;
+}
+
+// Registra uma pontuacao: na memoria na hora, e no fim do log pela thread de arquivos (nada e reescrito).
+// Quando o log passa de LEADERBOARD_COMPACT_ENTRIES registros e de 1/4 do placar, compacta: o arquivo
+// compactado novo e o log zerado vao para a fila depois dos registros. Devolve a posicao
+int SubmitLeaderboardScore(Leaderboard *leaderboard, IoQueue *io, const char *nome, int points) {
+    if (!leaderboard->loaded) {
+        printf("Placar nao carregado; pontuacao de %s nao registrada\n", nome);
+        return -1;
+    }
+    LeaderboardLogRecord *record = calloc(1, sizeof(LeaderboardLogRecord));
+    if (!record) {
+        printf("Erro ao alocar o registro do placar!\n");
+        return -1;
+    }
+    record->sequence = leaderboard->sequence + 1;
+    snprintf(record->entry.nome, MAX_NOME, "%s", nome);
+    record->entry.points = points;
+    record->checksum = LeaderboardChecksum(record);
+
+    int index = InsertLeaderboardEntry(leaderboard, record->entry);
+    if (index < 0) {
+        free(record);
+        return -1;
+    }
+    leaderboard->sequence = record->sequence;
+    leaderboard->logEntries++;
+    QueueFileAppend(io, leaderboard->logFilename, (char *)record, sizeof(LeaderboardLogRecord));
+    int rank = GetLeaderboardRank(leaderboard, index);
+
+    if (leaderboard->logEntries >= LEADERBOARD_COMPACT_ENTRIES && leaderboard->logEntries >= leaderboard->count / 4) {
+        size_t size;
+        char *image = CompactLeaderboard(leaderboard, &size);
+        if (image) {
+            QueueFileWrite(io, leaderboard->filename, image, size);
+            QueueFileWrite(io, leaderboard->logFilename, NULL, 0);
+        }
+    }
+    return rank;
+}
+
+#ifndef HEADLESS
+void InitializeAssetManager(AssetManager *manager) {
+    memset(manager, 0, sizeof(*manager));
+    manager->startTime = GetTime();
+    InitializeIoQueue(&manager->io, true);
+}
+
+// Pede o arquivo. Se o mesmo caminho ja foi pedido (pronto ou ainda na thread), so conta mais uma referencia.
+// Devolve o id do asset, usado ate o ReleaseAsset correspondente, ou -1 se nao couber
+int AcquireAsset(AssetManager *manager, const char *path, AssetType type) {
+    int slot = -1;
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        Asset *asset = &manager->assets[i];
+        if (asset->state != ASSET_FREE && asset->type == type && strcmp(asset->path, path) == 0) {
+            asset->refCount++;
+            manager->hits++;
+            return i;
+        }
+        if (asset->state == ASSET_FREE && slot < 0) slot = i;
+    }
+    if (slot < 0 || strlen(path) >= sizeof(manager->assets[0].path)) {
+        printf("Erro ao pedir %s: mais de %d assets ou caminho longo demais!\n", path, MAX_ASSETS);
+        return -1;
+    }
+
+    Asset *asset = &manager->assets[slot];
+    memset(asset, 0, sizeof(*asset));
+    snprintf(asset->path, sizeof(asset->path), "%s", path);
+    asset->type = type;
+    asset->state = ASSET_LOADING;
+    asset->refCount = 1;
+    manager->loads++;
+
+    IoRequest request = {IO_DECODE_ASSET, IO_TAG_NONE, asset->path, NULL, 0, NULL, false, asset};
+    SubmitIoRequest(&manager->io, &request);
+    return slot;
+}
+
+// Libera textura, som ou imagem do asset e devolve a posicao
+void UnloadAsset(AssetManager *manager, Asset *asset) {
+    if (asset->state == ASSET_READY) {
+        if (asset->type == ASSET_TEXTURE) {
+            UnloadTexture(asset->texture);
+            manager->gpuBytes -= asset->bytes;
+        } else {
+            manager->cpuBytes -= asset->bytes;
+        }
+        if (asset->type == ASSET_SOUND) UnloadSound(asset->sound);
+    }
+    UnloadDecodedAsset(asset);
+    memset(asset, 0, sizeof(*asset));
+}
+
+// Devolve uma referencia; a ultima descarrega o asset. Ainda na thread, e descarregado quando ela terminar
+void ReleaseAsset(AssetManager *manager, int id) {
+    if (id < 0) return;
+    Asset *asset = &manager->assets[id];
+    if (--asset->refCount > 0 || asset->state == ASSET_LOADING) return;
+    UnloadAsset(manager, asset);
+}
+
+// Termina os assets que a thread ja decodificou: o envio para a GPU e para o audio so pode ser feito na thread
+// principal. Chamado a cada frame; sem nada decodificado, so confere a fila
+void UpdateAssetManager(AssetManager *manager) {
+    IoRequest done;
+    while (PollIoCompletion(&manager->io, &done)) {
+        Asset *asset = done.asset;
+        manager->decodeSeconds += asset->decodeSeconds;
+        if (!done.ok || asset->refCount == 0) {
+            if (!done.ok) {
+                printf("Erro ao carregar %s!\n", asset->path);
+                manager->failures++;
+            }
+            UnloadDecodedAsset(asset);
+            asset->state = (asset->refCount > 0) ? ASSET_FAILED : ASSET_FREE;
+            continue;
+        }
+
+        double start = GetTime();
+        if (asset->type == ASSET_TEXTURE) {
+            asset->texture = LoadTextureFromImage(asset->image);
+            asset->bytes = GetPixelDataSize(asset->image.width, asset->image.height, asset->image.format);
+            manager->gpuBytes += asset->bytes;
+            UnloadDecodedAsset(asset);
+        } else if (asset->type == ASSET_SOUND) {
+            asset->sound = LoadSoundFromWave(asset->wave);
+            asset->bytes = (size_t)asset->wave.frameCount * asset->wave.channels * asset->wave.sampleSize / 8;
+            manager->cpuBytes += asset->bytes;
+            UnloadDecodedAsset(asset);
+        } else if (asset->type == ASSET_WAVE) {
+            asset->bytes = (size_t)asset->wave.frameCount * asset->wave.channels * asset->wave.sampleSize / 8;
+            manager->cpuBytes += asset->bytes;
+        } else {
+            asset->bytes = GetPixelDataSize(asset->image.width, asset->image.height, asset->image.format);
+            manager->cpuBytes += asset->bytes;
+        }
+        asset->uploadSeconds = GetTime() - start;
+        asset->state = ASSET_READY;
+
+        manager->uploadSeconds += asset->uploadSeconds;
+        manager->readyTime = GetTime() - manager->startTime;
+        if (manager->cpuBytes + manager->gpuBytes > manager->peakBytes) {
+            manager->peakBytes = manager->cpuBytes + manager->gpuBytes;
+        }
+    }
+}
+
+// Espera a thread decodificar tudo o que foi pedido e envia. false se algum asset pedido falhou
+bool WaitForAssets(AssetManager *manager) {
+    WaitIoIdle(&manager->io);
+    UpdateAssetManager(manager);
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        if (manager->assets[i].state == ASSET_FAILED) return false;
+    }
+    return true;
+}
+
+// Textura pronta do asset; id 0 (nada desenhado) enquanto nao estiver pronta
+Texture2D GetAssetTexture(AssetManager *manager, int id) {
+    if (id < 0 || manager->assets[id].state != ASSET_READY) return (Texture2D){0};
+    return manager->assets[id].texture;
+}
+
+// Imagem do ASSET_IMAGE pronto; data NULL enquanto nao estiver pronta
+Image GetAssetImage(AssetManager *manager, int id) {
+    if (id < 0 || manager->assets[id].state != ASSET_READY) return (Image){0};
+    return manager->assets[id].image;
+}
+
+Sound GetAssetSound(AssetManager *manager, int id) {
+    if (id < 0 || manager->assets[id].state != ASSET_READY) return (Sound){0};
+    return manager->assets[id].sound;
+}
+
+// Amostras do ASSET_WAVE pronto; data NULL enquanto nao estiver pronto
+Wave GetAssetWave(AssetManager *manager, int id) {
+    if (id < 0 || manager->assets[id].state != ASSET_READY) return (Wave){0};
+    return manager->assets[id].wave;
+}
+
+// Bytes dos assets prontos (imagens e sons na memoria, texturas na GPU)
+size_t GetAssetMemoryUsage(AssetManager *manager) {
+    return manager->cpuBytes + manager->gpuBytes;
+}
+
+// Tempos de carregamento e memoria, no total e por asset
+void PrintAssetStats(AssetManager *manager) {
+    printf("Assets: %d carregados, %d pedidos reaproveitados, prontos em %.1f ms; decodificacao %.1f ms (thread), "
+           "envio %.1f ms; %zu KB na memoria, %zu KB na GPU, pico %zu KB\n",
+           manager->loads, manager->hits, manager->readyTime * 1000, manager->decodeSeconds * 1000,
+           manager->uploadSeconds * 1000, manager->cpuBytes / 1024, manager->gpuBytes / 1024, manager->peakBytes / 1024);
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        Asset *asset = &manager->assets[i];
+        if (asset->state != ASSET_READY) continue;
+        printf("  %-20s %2d ref, decodificacao %6.2f ms, envio %5.2f ms, %zu KB\n", asset->path, asset->refCount,
+               asset->decodeSeconds * 1000, asset->uploadSeconds * 1000, asset->bytes / 1024);
+    }
+}
+
+// Termina o que a thread ainda decodificava e descarrega tudo. Assets ainda com referencia sao avisados:
+// alguem pediu e nao devolveu
+void UnloadAssetManager(AssetManager *manager) {
+    WaitIoIdle(&manager->io);
+    UpdateAssetManager(manager);
+    UnloadIoQueue(&manager->io);
+    for (int i = 0; i < MAX_ASSETS; i++) {
+        Asset *asset = &manager->assets[i];
+        if (asset->state == ASSET_FREE) continue;
+        if (asset->refCount > 0) printf("Aviso: %s descarregado com %d referencias\n", asset->path, asset->refCount);
+        UnloadAsset(manager, asset);
+    }
+}
+
+void LockAudio(AudioSystem *audio) {
+#if defined(_WIN32)
+    EnterCriticalSection(&audio->lock);
+#else
+    pthread_mutex_lock(&audio->lock);
+#endif
+}
+
+void UnlockAudio(AudioSystem *audio) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&audio->lock);
+#else
+    pthread_mutex_unlock(&audio->lock);
+#endif
+}
+
+// Copia o WAV para o formato da mistura. false se faltar memoria
+bool SetSfxClip(SfxClip *clip, Wave wave, float volume) {
+    Wave copy = WaveCopy(wave);
+    if (!copy.data) return false;
+    WaveFormat(&copy, AUDIO_SAMPLE_RATE, 16, 1);
+
+    clip->samples = malloc((copy.frameCount + 1) * sizeof(short));
+    if (!clip->samples) {
+        UnloadWave(copy);
+        return false;
+    }
+    memcpy(clip->samples, copy.data, copy.frameCount * sizeof(short));
+    clip->frameCount = copy.frameCount;
+    clip->gain = volume * 256;
+    UnloadWave(copy);
+    return true;
+}
+
+// Efeito gerado na hora, para quando o arquivo do efeito nao existe: onda quadrada com a frequencia indo de
+// startHz a endHz (moeda: dois tons) ou ruido (acerto), sumindo ate o fim
+bool GenerateSfxClip(SfxClip *clip, SfxId id, float volume) {
+    float durations[SFX_COUNT] = {0.08f, 0.12f, 0.06f, 0.20f};
+    float startHz[SFX_COUNT] = {880, 988, 0, 220};
+    float endHz[SFX_COUNT] = {440, 1319, 0, 110};
+
+    int frameCount = durations[id] * AUDIO_SAMPLE_RATE;
+    clip->samples = malloc(frameCount * sizeof(short));
+    if (!clip->samples) return false;
+
+    float phase = 0;
+    unsigned noise = 1;
+    for (int i = 0; i < frameCount; i++) {
+        float t = (float)i / frameCount;
+        float value;
+        if (id == SFX_HIT) {
+            noise = noise * 1103515245 + 12345;
+            value = ((noise >> 16) & 0x7fff) / 16383.5f - 1.0f;
+        } else {
+            float hz = (id == SFX_COIN) ? (t < 0.4f ? startHz[id] : endHz[id]) : startHz[id] + (endHz[id] - startHz[id]) * t;
+            phase += hz / AUDIO_SAMPLE_RATE;
+            phase -= (int)phase;
+            value = (phase < 0.5f) ? 1.0f : -1.0f;
+        }
+        clip->samples[i] = value * (1.0f - t) * 6000;
+    }
+    clip->frameCount = frameCount;
+    clip->gain = volume * 256;
+    return true;
+}
+
+// Soma as vozes ativas em frames quadros e limita a 16 bits. Vozes que chegam ao fim ficam livres
+void MixSfxVoices(AudioSystem *audio, short *out, int frames) {
+    int *accumulator = audio->mixAccumulator;
+    memset(accumulator, 0, frames * sizeof(int));
+
+    LockAudio(audio);
+    for (int v = 0; v < SFX_VOICES; v++) {
+        SfxVoice *voice = &audio->voices[v];
+        if (!voice->active) continue;
+        SfxClip *clip = &audio->clips[voice->clip];
+        int count = clip->frameCount - voice->position;
+        if (count > frames) count = frames;
+        const short *samples = clip->samples + voice->position;
+        for (int i = 0; i < count; i++) {
+            accumulator[i] += (samples[i] * clip->gain) >> 8;
+        }
+        voice->position += count;
+        if (voice->position >= clip->frameCount) voice->active = false;
+    }
+    audio->refills++;
+    UnlockAudio(audio);
+
+    for (int i = 0; i < frames; i++) {
+        int value = accumulator[i];
+        out[i] = (value > 32767) ? 32767 : (value < -32768) ? -32768 : value;
+    }
+}
+
+// Um passo da thread de audio: volume novo, musica reabastecida e um buffer de efeitos para cada um que o
+// audio ja consumiu
+void UpdateAudio(AudioSystem *audio) {
+    LockAudio(audio);
+    float volume = audio->musicVolume;
+    UnlockAudio(audio);
+
+    if (audio->musicLoaded) {
+        if (volume != audio->appliedMusicVolume) {
+            SetMusicVolume(audio->music, volume);
+            audio->appliedMusicVolume = volume;
+        }
+        UpdateMusicStream(audio->music);
+    }
+    while (IsAudioStreamProcessed(audio->sfxStream)) {
+        MixSfxVoices(audio, audio->mixBuffer, audio->sfxBufferFrames);
+        UpdateAudioStream(audio->sfxStream, audio->mixBuffer, audio->sfxBufferFrames);
+    }
+}
+
+#if defined(_WIN32)
+DWORD WINAPI RunAudioThread(LPVOID data) {
+#else
+void *RunAudioThread(void *data) {
+#endif
+    AudioSystem *audio = data;
+
+    while (true) {
+        LockAudio(audio);
+        bool stop = audio->stop;
+        UnlockAudio(audio);
+        if (stop) break;
+
+        UpdateAudio(audio);
+#if defined(_WIN32)
+        Sleep(AUDIO_THREAD_SLEEP_MS);
+#else
+        struct timespec pause = {0, AUDIO_THREAD_SLEEP_MS * 1000000L};
+        nanosleep(&pause, NULL);
+#endif
+    }
+    return 0;
+}
+
+// Abre a musica (em loop) e o stream dos efeitos com buffers do tamanho pedido e inicia a thread de audio.
+// sfx[i] com data NULL (arquivo do efeito ausente) usa um efeito gerado. Sem thread, UpdateAudio tem que ser
+// chamado pelo jogo. false se faltar memoria
+bool InitializeAudio(AudioSystem *audio, const char *musicFile, Wave sfx[SFX_COUNT], int musicBufferFrames, int sfxBufferFrames) {
+    memset(audio, 0, sizeof(*audio));
+    audio->musicVolume = 0.5f;
+    audio->sfxBufferFrames = sfxBufferFrames;
+    audio->mixAccumulator = malloc(sfxBufferFrames * sizeof(int));
+    audio->mixBuffer = malloc(sfxBufferFrames * sizeof(short));
+    if (!audio->mixAccumulator || !audio->mixBuffer) {
+        printf("Erro ao alocar o buffer dos efeitos!\n");
+        free(audio->mixAccumulator);
+        free(audio->mixBuffer);
+        return false;
+    }
+    for (int i = 0; i < SFX_COUNT; i++) {
+        bool ok = sfx[i].data ? SetSfxClip(&audio->clips[i], sfx[i], 1.0f) : GenerateSfxClip(&audio->clips[i], i, 1.0f);
+        if (!ok) printf("Erro ao preparar o efeito %d; ele fica mudo\n", i);
+    }
+
+    // O tamanho padrao vale para os streams abertos depois dele
+    SetAudioStreamBufferSizeDefault(musicBufferFrames);
+    audio->music = LoadMusicStream(musicFile);
+    audio->musicLoaded = audio->music.ctxData != NULL;
+    if (audio->musicLoaded) {
+        SetMusicVolume(audio->music, audio->musicVolume);
+        audio->appliedMusicVolume = audio->musicVolume;
+        PlayMusicStream(audio->music);
+    }
+    SetAudioStreamBufferSizeDefault(sfxBufferFrames);
+    audio->sfxStream = LoadAudioStream(AUDIO_SAMPLE_RATE, 16, 1);
+    PlayAudioStream(audio->sfxStream);
+    SetAudioStreamBufferSizeDefault(0);
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&audio->lock);
+    audio->thread = CreateThread(NULL, 0, RunAudioThread, audio, 0, NULL);
+    audio->threaded = audio->thread != NULL;
+#else
+    pthread_mutex_init(&audio->lock, NULL);
+    audio->threaded = pthread_create(&audio->thread, NULL, RunAudioThread, audio) == 0;
+#endif
+    if (!audio->threaded) {
+        printf("Aviso: thread de audio nao criada; o som sera atualizado pelo jogo\n");
+    }
+    return true;
+}
+
+// Toca o efeito numa voz livre; sem voz livre, interrompe a que toca ha mais tempo. So escolhe a voz: a
+// mistura e da thread de audio
+void PlaySfx(AudioSystem *audio, SfxId id) {
+    if (!audio->clips[id].samples) return;
+
+    LockAudio(audio);
+    int voice = 0;
+    for (int v = 0; v < SFX_VOICES; v++) {
+        if (!audio->voices[v].active) {
+            voice = v;
+            break;
+        }
+        if (audio->voices[v].order < audio->voices[voice].order) voice = v;
+    }
+    if (audio->voices[voice].active) audio->stolen++;
+    audio->voices[voice] = (SfxVoice){id, 0, audio->playOrder++, true};
+    audio->played++;
+    UnlockAudio(audio);
+}
+
+// Volume da musica, aplicado pela thread de audio
+void SetAudioMusicVolume(AudioSystem *audio, float volume) {
+    LockAudio(audio);
+    audio->musicVolume = volume;
+    UnlockAudio(audio);
+}
+
+// Para a thread e fecha musica e efeitos. Antes do CloseAudioDevice
+void UnloadAudio(AudioSystem *audio) {
+    if (audio->threaded) {
+        LockAudio(audio);
+        audio->stop = true;
+        UnlockAudio(audio);
+#if defined(_WIN32)
+        WaitForSingleObject(audio->thread, INFINITE);
+        CloseHandle(audio->thread);
+#else
+        pthread_join(audio->thread, NULL);
+#endif
+    }
+    printf("Audio: %d efeitos tocados, %d interrompidos por falta de voz, %d buffers misturados\n",
+           audio->played, audio->stolen, audio->refills);
+
+    if (audio->musicLoaded) {
+        StopMusicStream(audio->music);
+        UnloadMusicStream(audio->music);
+    }
+    StopAudioStream(audio->sfxStream);
+    UnloadAudioStream(audio->sfxStream);
+    for (int i = 0; i < SFX_COUNT; i++) {
+        free(audio->clips[i].samples);
+    }
+    free(audio->mixAccumulator);
+    free(audio->mixBuffer);
+#if defined(_WIN32)
+    DeleteCriticalSection(&audio->lock);
+#else
+    pthread_mutex_destroy(&audio->lock);
+#endif
+}
+
+// Insere o nome do jogador  (exemplo simples de entrada)
+void InsertName(char strnome[50]) {
+    char nome[MAX_NOME] = {'\0'};
+    char caractere;
+    int contaChars = 0;
+
+    while (!IsKeyPressed(KEY_ENTER)) {
+        BeginDrawing();
+        ClearBackground(RAYWHITE);
+        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
+        DrawText("PARABENS! VOCE GANHOU", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT - 30) / 2, 60, GREEN);
+        DrawText("Aperte enter para voltar ao menu", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT + 60) / 2, 40, WHITE);
+        // Recebe o nome do jogador
+        caractere = GetCharPressed();
+
+        if (caractere != '\0' && contaChars < MAX_NOME - 1) {
+            nome[contaChars] = caractere;
+            contaChars++;
+        }
+
+        if (IsKeyPressed(KEY_BACKSPACE) && contaChars > 0) {
+            contaChars--;
+            nome[contaChars] = '\0';
+        }
+
+        DrawText(TextFormat("Nome: %s", nome), 45, 45, 40, RAYWHITE);
+        EndDrawing();
+    }
+ strcpy(strnome,nome);
+}
+
+// Desenha uma tela com os top 5 jogadores (exibe a leaderboard). Usa so a copia do placar na memoria;
+// enquanto a thread de arquivos nao termina de ler, mostra que esta carregando
+void DesenhaTop5(Leaderboard *leaderboard) {
+    JogadorLeader Players[5];
+    int i, j = 0;
+    int shown = GetLeaderboardTop(leaderboard, Players, 5);
+
+    Rectangle exitButton = {SCREEN_WIDTH - 150, 20, 130, 90}; // Exit button rectangle
+
+    BeginDrawing();
+    ClearBackground(RAYWHITE);
+    DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
+    DrawText("Leaderboard", (SCREEN_WIDTH / 2 - MeasureText("Leaderboard", 50) / 2), 20, 50, WHITE);
+
+    for (i = 0; i < shown; i++) {
+        DrawText(TextFormat("Nome: %s", Players[i].nome), 15, 100 + j, 30, WHITE);
+        DrawText(TextFormat("Pontuacao: %d \n", Players[i].points), 400, 100 + j, 30, WHITE);
+        j += 40;
+    }
+    if (leaderboard->loaded) {
+        DrawText(TextFormat("%d pontuacoes registradas", leaderboard->count), 15, 100 + j + 20, 20, GRAY);
+    } else {
+        DrawText("Carregando...", 15, 100, 30, GRAY);
+    }
+
+    // Draw the exit button
+    DrawRectangleRec(exitButton, RED);
+    DrawText("Aperte \nenter \npara sair", exitButton.x + 20, exitButton.y + 10, 20, WHITE);
+
+    EndDrawing();
+}
+
+// Pede o nome do jogador que chegou ao portao e registra a pontuacao no placar
+void RegistraPontuacao(Player *player, Leaderboard *leaderboard, IoQueue *io) {
+    char nomejogador[MAX_NOME];
+
+    // Insere o nome do jogador atual
+    InsertName(nomejogador);
+
+    // Placar ainda sendo lido (so se o jogador chegou antes de a thread terminar a leitura): espera por ele
+    if (!leaderboard->loaded) {
+        IoRequest done;
+        WaitIoIdle(io);
+        while (PollIoCompletion(io, &done)) {
+            FinishIoRequest(&done, leaderboard);
+        }
+    }
+
+    int rank = SubmitLeaderboardScore(leaderboard, io, nomejogador, player->points);
+    if (rank > 0) {
+        printf("Parabns, %s! Sua pontuao de %d foi registrada em %d lugar.\n", nomejogador, player->points, rank);
+    }
+}
+#endif
+
+// Verifica a coliso com o porto e finaliza a fase. O registro da pontuao (tela de nome e arquivo)
+// fica para depois dos ticks, fora da simulao
+void HandleGateCollision(Player *player, Rectangle block) {
+    Vector2 correction = {0, 0};
+
+    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
+        player->reachedGate = true;
+        player->health = -1;
+    }
+}
+
+// Consulta apenas as celulas que o retangulo do jogador toca e usa CheckCollisionWithBlock() (nos handlers) para resolver a colisao com cada bloco.
+// As celulas vazias sao puladas pela grade de colisao; so obstaculo e portao precisam ler o caractere
+void HandlePlayerBlockCollisions(Player *player, TileMap *map, float blockSize) {
+    player->isGrounded = false;
+
+    TileRange range = QueryTileRange(player->rect, map->rows, map->cols, blockSize);
+
+    for (int y = range.minY; y <= range.maxY; y++) {
+        // O retangulo toca no maximo dois pedacos; cada um e buscado uma vez por linha
+        for (int index = range.minX / MAP_CHUNK_COLUMNS; index <= range.maxX / MAP_CHUNK_COLUMNS; index++) {
+            MapChunk *chunk = GetMapChunk(map, index);
+            const unsigned long long *solid = &chunk->collision.solid[(size_t)y * MAP_CHUNK_WORDS];
+            const unsigned long long *occupied = &chunk->collision.occupied[(size_t)y * MAP_CHUNK_WORDS];
+            int firstColumn = index * MAP_CHUNK_COLUMNS;
+            int c = (range.minX > firstColumn) ? range.minX - firstColumn : 0;
+            int last = (range.maxX < firstColumn + MAP_CHUNK_COLUMNS - 1) ? range.maxX - firstColumn : MAP_CHUNK_COLUMNS - 1;
+
+            while (FindFirstBit(occupied, c, last, &c)) {
+                Rectangle block = GetTileRect(firstColumn + c, y, blockSize);
+                if ((solid[c >> 6] >> (c & 63)) & 1) {
+                    HandleBlockCollision(player, block);
+                }
+                else if (chunk->tiles[y * MAP_CHUNK_COLUMNS + c] == 'O') {
+                    HandleObstacleCollision(player, block);
+                }
+                else {
+                    HandleGateCollision(player, block);
+                }
+                c++;
+            }
+        }
+    }
+}
+
+// Chama todas as funes de coliso 1 vez s
+void HandleCollisions(Player* player, EnemyStore *enemies, ProjectilePool *projectiles, TileMap *map, float blockSize, unsigned currentFrame, float dt, Coin *coins, int *coinCount, SpatialHash *hash, JobSystem *jobs) {
+    HandlePlayerBlockCollisions(player, map, blockSize);
+
+    // Broadphase: cada teste abaixo so olha entidades proximas
+    BuildEntitySpatialHash(hash, enemies, coins, *coinCount, projectiles, jobs);
+
+    HandlePlayerEnemyCollision(player, enemies, &currentFrame, dt, hash);
+    CheckProjectileEnemyCollision(projectiles, enemies, player, hash, jobs);
+    CheckPlayerCoinCollision(player, coins, coinCount, hash);
+
+    RemoveDeadEnemies(enemies);
+}
+
+#ifndef HEADLESS
+// Clipes das folhas de sprites e buffer de quadros para capacity inimigos. false se faltar memoria
+bool InitializeAnimationSystem(AnimationSystem *animation, int enemyCapacity) {
+    memset(animation, 0, sizeof(*animation));
+
+    // Folha do jogador: 0 parado, 2-4 correndo, 5 pulando, 7 parado atirando, 7-9 correndo atirando, 10 pulando
+    // atirando. Folha dos inimigos: 2 quadros de caminhada
+    animation->clips[CLIP_PLAYER_IDLE] = (AnimationClip){0, 1, 0.15f};
+    animation->clips[CLIP_PLAYER_IDLE_SHOOT] = (AnimationClip){7, 1, 0.15f};
+    animation->clips[CLIP_PLAYER_RUN] = (AnimationClip){2, 3, 0.15f};
+    animation->clips[CLIP_PLAYER_RUN_SHOOT] = (AnimationClip){7, 3, 0.15f};
+    animation->clips[CLIP_PLAYER_JUMP] = (AnimationClip){5, 1, 0.15f};
+    animation->clips[CLIP_PLAYER_JUMP_SHOOT] = (AnimationClip){10, 1, 0.15f};
+    animation->clips[CLIP_ENEMY_WALK] = (AnimationClip){0, 2, 0.5f};
+
+    animation->enemyFrames = malloc((enemyCapacity + 1) * sizeof(int));
+    animation->enemyCapacity = enemyCapacity;
+    if (!animation->enemyFrames) {
+        printf("Erro ao alocar os quadros dos inimigos!\n");
+        return false;
+    }
+    return true;
+}
+
+void UnloadAnimationSystem(AnimationSystem *animation) {
+    free(animation->enemyFrames);
+    animation->enemyFrames = NULL;
+    animation->enemyCapacity = 0;
+}
+
+// Quadro do clipe elapsed segundos depois de ele comecar
+int GetClipFrame(const AnimationClip *clip, double elapsed) {
+    long step = (long)(elapsed / clip->frameDuration);
+    return clip->firstFrame + (int)(step % clip->frameCount);
+}
+
+// Clipe do jogador pelo estado: no ar, correndo ou parado, atirando ou nao
+AnimationClipId SelectPlayerClip(Player *player) {
+    if (!player->isGrounded) {
+        return player->isShooting ? CLIP_PLAYER_JUMP_SHOOT : CLIP_PLAYER_JUMP;
+    }
+    if (player->velocity.x != 0) {
+        return player->isShooting ? CLIP_PLAYER_RUN_SHOOT : CLIP_PLAYER_RUN;
+    }
+    return player->isShooting ? CLIP_PLAYER_IDLE_SHOOT : CLIP_PLAYER_IDLE;
+}
+
+// Quadro de todos os inimigos vivos num laco so. O clipe de cada um comeca spawnId quadros antes do relogio,
+// para nao andarem todos no mesmo passo, e a fase acompanha o inimigo nas trocas do EnemyStore
+void AnimateEnemies(AnimationSystem *animation, EnemyStore *enemies) {
+    const AnimationClip *clip = &animation->clips[CLIP_ENEMY_WALK];
+    long step = (long)(animation->time / clip->frameDuration);
+    const int *spawnId = enemies->spawnId;
+    int *frames = animation->enemyFrames;
+    int count = (enemies->activeCount < animation->enemyCapacity) ? enemies->activeCount : animation->enemyCapacity;
+
+    for (int i = 0; i < count; i++) {
+        frames[i] = clip->firstFrame + (int)((step + spawnId[i]) % clip->frameCount);
+    }
+}
+
+// Avanca o relogio das animacoes e calcula o quadro do jogador e dos inimigos. Uma vez por frame, antes do desenho
+void UpdateAnimations(AnimationSystem *animation, Player *player, EnemyStore *enemies, float dt) {
+    animation->time += dt;
+
+    AnimationClipId clip = SelectPlayerClip(player);
+    if (clip != animation->playerClip) {
+        animation->playerClip = clip;
+        animation->playerClipStart = animation->time;
+    }
+    animation->playerFrame = GetClipFrame(&animation->clips[clip], animation->time - animation->playerClipStart);
+
+    AnimateEnemies(animation, enemies);
+}
+#endif
+
+// Verifica vida do jogador e, se abaixo de 0, encerra o jogo
+int isPlayerDead(Player *player) {
+    if (player->health < 0) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+// Guarda as posicoes do tick atual antes de simular o proximo
+void StorePreviousPositions(Player *player, EnemyStore *enemies, ProjectilePool *projectiles) {
+    player->previousPosition = player->position;
+    memcpy(enemies->previousX, enemies->x, enemies->activeCount * sizeof(float));
+    memcpy(projectiles->previousX, projectiles->x, projectiles->count * sizeof(float));
+    memcpy(projectiles->previousY, projectiles->y, projectiles->count * sizeof(float));
+}
+
+// Tamanho maximo do estado serializado por SerializeWorldState para essas capacidades
+int GetWorldStateSize(int enemyCapacity, int coinCapacity, int projectileCapacity) {
+    return sizeof(Player) + 3 * sizeof(int) +
+           enemyCapacity * (5 * sizeof(float) + 2 * sizeof(int)) +
+           coinCapacity +
+           projectileCapacity * (6 * sizeof(float) + sizeof(Color));
+}
+
+// Grava count valores de 4 bytes separados por byte: primeiro o byte menos significativo de todos, depois o
+// seguinte... Valores que mudam pouco de um tick para o outro so mudam nos bytes baixos, e os altos viram
+// sequencias de zeros no XOR
+void WriteByteplanes(unsigned char **cursor, const void *values, int count) {
+    const unsigned char *bytes = values;
+    unsigned char *plane = *cursor;
+    for (int i = 0; i < count; i++) {
+        unsigned int value;
+        memcpy(&value, bytes + i * 4, sizeof(value));
+        plane[i] = (unsigned char)value;
+        plane[count + i] = (unsigned char)(value >> 8);
+        plane[2 * count + i] = (unsigned char)(value >> 16);
+        plane[3 * count + i] = (unsigned char)(value >> 24);
+    }
+    *cursor += 4 * count;
+}
+
+void ReadByteplanes(const unsigned char **cursor, void *values, int count) {
+    unsigned char *bytes = values;
+    const unsigned char *plane = *cursor;
+    for (int i = 0; i < count; i++) {
+        unsigned int value = plane[i] | (unsigned int)plane[count + i] << 8 |
+                         (unsigned int)plane[2 * count + i] << 16 | (unsigned int)plane[3 * count + i] << 24;
+        memcpy(bytes + i * 4, &value, sizeof(value));
+    }
+    *cursor += 4 * count;
+}
+
+// Serializa o estado do mundo que o rewind volta. Posicoes anteriores e campos de rascunho ficam de fora:
+// sao refeitos na leitura. Devolve o tamanho
+int SerializeWorldState(unsigned char *out, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    unsigned char *cursor = out;
+
+    memcpy(cursor, player, sizeof(Player));
+    cursor += sizeof(Player);
+    memcpy(cursor, &enemies->count, sizeof(int));
+    memcpy(cursor + sizeof(int), &enemies->activeCount, sizeof(int));
+    memcpy(cursor + 2 * sizeof(int), &projectiles->count, sizeof(int));
+    cursor += 3 * sizeof(int);
+
+    WriteByteplanes(&cursor, enemies->x, enemies->count);
+    WriteByteplanes(&cursor, enemies->y, enemies->count);
+    WriteByteplanes(&cursor, enemies->speedX, enemies->count);
+    WriteByteplanes(&cursor, enemies->minX, enemies->count);
+    WriteByteplanes(&cursor, enemies->maxX, enemies->count);
+    WriteByteplanes(&cursor, enemies->health, enemies->count);
+    WriteByteplanes(&cursor, enemies->spawnId, enemies->count);
+
+    for (int i = 0; i < coinCount; i++) {
+        *cursor++ = coins[i].active;
+    }
+
+    // Projeteis por ultimo: a quantidade muda muito e o que vem antes continua alinhado com o tick anterior
+    WriteByteplanes(&cursor, projectiles->x, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->y, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->width, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->height, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->speedX, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->speedY, projectiles->count);
+    WriteByteplanes(&cursor, projectiles->color, projectiles->count);
+
+    return cursor - out;
+}
+
+void DeserializeWorldState(const unsigned char *in, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    const unsigned char *cursor = in;
+
+    memcpy(player, cursor, sizeof(Player));
+    cursor += sizeof(Player);
+    memcpy(&enemies->count, cursor, sizeof(int));
+    memcpy(&enemies->activeCount, cursor + sizeof(int), sizeof(int));
+    memcpy(&projectiles->count, cursor + 2 * sizeof(int), sizeof(int));
+    cursor += 3 * sizeof(int);
+
+    ReadByteplanes(&cursor, enemies->x, enemies->count);
+    ReadByteplanes(&cursor, enemies->y, enemies->count);
+    ReadByteplanes(&cursor, enemies->speedX, enemies->count);
+    ReadByteplanes(&cursor, enemies->minX, enemies->count);
+    ReadByteplanes(&cursor, enemies->maxX, enemies->count);
+    ReadByteplanes(&cursor, enemies->health, enemies->count);
+    ReadByteplanes(&cursor, enemies->spawnId, enemies->count);
+    memcpy(enemies->previousX, enemies->x, enemies->count * sizeof(float));
+
+    for (int i = 0; i < coinCount; i++) {
+        coins[i].active = *cursor++;
+    }
+
+    ReadByteplanes(&cursor, projectiles->x, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->y, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->width, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->height, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->speedX, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->speedY, projectiles->count);
+    ReadByteplanes(&cursor, projectiles->color, projectiles->count);
+    memcpy(projectiles->previousX, projectiles->x, projectiles->count * sizeof(float));
+    memcpy(projectiles->previousY, projectiles->y, projectiles->count * sizeof(float));
+    memset(projectiles->travel, 0, projectiles->count * sizeof(float));
+    memset(projectiles->expired, 0, projectiles->count * sizeof(bool));
+}
+
+int WriteVarint(unsigned char *out, unsigned value) {
+    int size = 0;
+    while (value >= 0x80) {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+    return size;
+}
+
+unsigned ReadVarint(const unsigned char *in, int *position) {
+    unsigned value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = in[(*position)++];
+        if (shift < 32) value |= (unsigned)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// delta = state XOR base; base termina em baseSize e depois disso vale zero
+void XorRewindState(const unsigned char *base, int baseSize, const unsigned char *state, int size, unsigned char *delta) {
+    int common = (baseSize < size) ? baseSize : size;
+    int i = 0;
+    for (; i + 8 <= common; i += 8) {
+        unsigned long long a, b;
+        memcpy(&a, state + i, sizeof(a));
+        memcpy(&b, base + i, sizeof(b));
+        a ^= b;
+        memcpy(delta + i, &a, sizeof(a));
+    }
+    for (; i < common; i++) {
+        delta[i] = state[i] ^ base[i];
+    }
+    memcpy(delta + common, state + common, size - common);
+}
+
+// Primeiro byte diferente de zero a partir de i (size se nao houver), de 8 em 8 bytes enquanto der
+int SkipZeroBytes(const unsigned char *delta, int i, int size) {
+    while (i + 8 <= size) {
+        unsigned long long word;
+        memcpy(&word, delta + i, sizeof(word));
+        if (word) break;
+        i += 8;
+    }
+    while (i < size && delta[i] == 0) i++;
+    return i;
+}
+
+// Codifica delta (XOR com o estado anterior, ou o estado inteiro num keyframe) em pares (zeros, literais)
+// em varint, cada par seguido dos literais. Devolve o tamanho; out precisa de 2 * size + 16 bytes
+int EncodeRewindState(const unsigned char *delta, int size, unsigned char *out) {
+    int encoded = 0;
+    int i = 0;
+    while (i < size) {
+        int start = SkipZeroBytes(delta, i, size);
+        int zeros = start - i;
+
+        // Literais ate a proxima sequencia de pelo menos 2 zeros (um zero sozinho sai mais barato como literal)
+        i = start;
+        while (i < size && !(delta[i] == 0 && i + 1 < size && delta[i + 1] == 0)) i++;
+
+        encoded += WriteVarint(out + encoded, zeros);
+        encoded += WriteVarint(out + encoded, i - start);
+        memcpy(out + encoded, delta + start, i - start);
+        encoded += i - start;
+    }
+    return encoded;
+}
+
+// Aplica um registro codificado sobre state, que tem o estado anterior (baseSize bytes) e passa a ter o novo.
+// So os literais sao tocados; os zeros do XOR ja estao certos
+void DecodeRewindState(unsigned char *state, int baseSize, const unsigned char *in, int inSize, int size) {
+    if (size > baseSize) {
+        memset(state + baseSize, 0, size - baseSize);
+    }
+    int position = 0;
+    int i = 0;
+    while (position < inSize) {
+        i += ReadVarint(in, &position);
+        int literals = ReadVarint(in, &position);
+        for (int k = 0; k < literals; k++) {
+            state[i++] ^= in[position++];
+        }
+    }
+}
+
+bool InitializeRewindBuffer(RewindBuffer *rewind, int enemyCapacity, int coinCapacity, int projectileCapacity) {
+    memset(rewind, 0, sizeof(*rewind));
+    rewind->maxStateSize = GetWorldStateSize(enemyCapacity, coinCapacity, projectileCapacity);
+    rewind->data = malloc(REWIND_BUFFER_BYTES);
+    rewind->previous = malloc(rewind->maxStateSize);
+    rewind->current = malloc(rewind->maxStateSize);
+    rewind->delta = malloc(rewind->maxStateSize);
+    rewind->encoded = malloc(2 * rewind->maxStateSize + 16);
+    if (!rewind->data || !rewind->previous || !rewind->current || !rewind->delta || !rewind->encoded) {
+        printf("Erro ao alocar o historico de rewind!\n");
+        return false;
+    }
+    return true;
+}
+
+void UnloadRewindBuffer(RewindBuffer *rewind) {
+    free(rewind->data);
+    free(rewind->previous);
+    free(rewind->current);
+    free(rewind->delta);
+    free(rewind->encoded);
+    memset(rewind, 0, sizeof(*rewind));
+}
+
+// Esquece o historico (a fase recomecou ou o mundo foi trocado por um quickload)
+void ClearRewindBuffer(RewindBuffer *rewind) {
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->writeOffset = 0;
+    rewind->previousSize = 0;
+    rewind->sinceKeyframe = 0;
+}
+
+RewindRecord *GetRewindRecord(RewindBuffer *rewind, int k) {
+    return &rewind->records[(rewind->first + k) % REWIND_TICKS];
+}
+
+// Descarta o registro mais antigo e os seguintes que dependiam dele, ate o proximo estado completo
+void DropOldestRewindRecord(RewindBuffer *rewind) {
+    do {
+        rewind->first = (rewind->first + 1) % REWIND_TICKS;
+        rewind->count--;
+    } while (rewind->count > 0 && !GetRewindRecord(rewind, 0)->keyframe);
+}
+
+// Libera size bytes contiguos em data, descartando os registros mais antigos, e devolve onde gravar
+int ReserveRewindSpace(RewindBuffer *rewind, int size) {
+    if (rewind->writeOffset + size > REWIND_BUFFER_BYTES) {
+        // Nao cabe no fim: os registros entre writeOffset e o fim sao os mais antigos e saem antes de voltar ao comeco
+        while (rewind->count > 0 && GetRewindRecord(rewind, 0)->offset >= rewind->writeOffset) {
+            DropOldestRewindRecord(rewind);
+        }
+        rewind->writeOffset = 0;
+    }
+
+    while (rewind->count > 0) {
+        RewindRecord *oldest = GetRewindRecord(rewind, 0);
+        bool overlaps = oldest->offset < rewind->writeOffset + size && rewind->writeOffset < oldest->offset + oldest->size;
+        if (!overlaps && rewind->count < REWIND_TICKS) break;
+        DropOldestRewindRecord(rewind);
+    }
+    return rewind->writeOffset;
+}
+
+// Grava o estado atual no historico. Chamado no fim de cada tick
+void RecordRewindFrame(RewindBuffer *rewind, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    int stateSize = SerializeWorldState(rewind->current, player, enemies, coins, coinCount, projectiles);
+    bool keyframe = rewind->count == 0 || rewind->sinceKeyframe >= REWIND_KEYFRAME_INTERVAL - 1;
+    XorRewindState(rewind->previous, keyframe ? 0 : rewind->previousSize, rewind->current, stateSize, rewind->delta);
+    int size = EncodeRewindState(rewind->delta, stateSize, rewind->encoded);
+    int offset = ReserveRewindSpace(rewind, size);
+
+    if (!keyframe && rewind->count == 0) {
+        // O estado completo de que este dependia foi descartado para abrir espaco
+        keyframe = true;
+        size = EncodeRewindState(rewind->current, stateSize, rewind->encoded);
+        offset = ReserveRewindSpace(rewind, size);
+    }
+    if (size > REWIND_BUFFER_BYTES) {
+        ClearRewindBuffer(rewind);  // Estado maior que o historico inteiro: nao da para voltar
+        return;
+    }
+
+    memcpy(rewind->data + offset, rewind->encoded, size);
+    *GetRewindRecord(rewind, rewind->count) = (RewindRecord){offset, size, stateSize, keyframe};
+    rewind->count++;
+    rewind->writeOffset = offset + size;
+    rewind->sinceKeyframe = keyframe ? 0 : rewind->sinceKeyframe + 1;
+
+    // O estado gravado vira a base do proximo
+    unsigned char *swap = rewind->previous;
+    rewind->previous = rewind->current;
+    rewind->current = swap;
+    rewind->previousSize = stateSize;
+
+    rewind->recordedBytes += size;
+    rewind->recordedTicks++;
+}
+
+// Volta o mundo ticks ticks antes do registro mais novo (limitado ao historico) e descarta os registros
+// mais novos que ele. Devolve quantos ticks voltou
+int RewindWorld(RewindBuffer *rewind, int ticks, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    if (ticks > rewind->count - 1) ticks = rewind->count - 1;
+    if (ticks <= 0) return 0;
+
+    int target = rewind->count - 1 - ticks;
+    int key = target;
+    while (!GetRewindRecord(rewind, key)->keyframe) key--;
+
+    // Reconstroi do estado completo ate o alvo em previous, que vira a base do proximo registro
+    int stateSize = 0;
+    for (int k = key; k <= target; k++) {
+        RewindRecord *record = GetRewindRecord(rewind, k);
+        DecodeRewindState(rewind->previous, stateSize, rewind->data + record->offset, record->size, record->stateSize);
+        stateSize = record->stateSize;
+    }
+    rewind->previousSize = stateSize;
+    RewindRecord *last = GetRewindRecord(rewind, target);
+    rewind->writeOffset = last->offset + last->size;
+    rewind->count = target + 1;
+    rewind->sinceKeyframe = target - key;
+
+    DeserializeWorldState(rewind->previous, player, enemies, coins, coinCount, projectiles);
+    return ticks;
+}
+
+// Segundos que o historico consegue voltar agora
+float GetRewindSeconds(RewindBuffer *rewind) {
+    return (rewind->count > 0) ? (rewind->count - 1) / (float)SIMULATION_HZ : 0.0f;
+}
+
+// Memoria fixa do rewind: historico, rascunhos e a propria estrutura
+size_t GetRewindMemoryUsage(RewindBuffer *rewind) {
+    return sizeof(RewindBuffer) + REWIND_BUFFER_BYTES + 5 * (size_t)rewind->maxStateSize + 16;
+}
+
+// Avanca o jogo um tick de SIMULATION_DT: movimento, tiros e colisoes. Com jobs, movimento dos inimigos e
+// projeteis, hash espacial e alvos dos projeteis sao divididos entre as threads, com o mesmo resultado de sem
+void SimulateTick(Player *player,
+                  PlayerInput *input,
+                  unsigned *currentFrame,
+                  GameSettings *settings,
+                  TileMap *map,
+                  Coin *coins,
+                  int *coinCount,
+                  EnemyStore *enemies,
+                  ProjectilePool *projectiles,
+                  SpatialHash *hash,
+                  RewindBuffer *rewind,
+                  JobSystem *jobs)
+{
+    float dt = SIMULATION_DT;
+
+    // R segurado: o tick volta um registro do historico em vez de andar, e os toques do tick sao descartados
+    if (input->rewind) {
+        if (rewind) {
+            PROFILE_SCOPE(PROFILE_REWIND) {
+                RewindWorld(rewind, 1, player, enemies, coins, *coinCount, projectiles);
+            }
+        }
+        ConsumePressedInput(input);
+        return;
+    }
+
+    StorePreviousPositions(player, enemies, projectiles);
+    ApplyGravity(player, settings->gravity, dt);
+    HandleRespawn(player, fmaxf(SCREEN_HEIGHT, map->rows * BLOCK_SIZE));  // Caiu abaixo da tela ou do fim do mapa
+
+    // Movimento
+    PROFILE_SCOPE(PROFILE_MOVE_PLAYER) {
+        MovePlayer(player, input, settings->playerSpeed, settings->jumpForce, dt);
+    }
+    PROFILE_SCOPE(PROFILE_MOVE_ENEMIES) {
+        MoveEnemies(enemies, dt, jobs);
+    }
+    PROFILE_SCOPE(PROFILE_MOVE_PROJECTILES) {
+        MoveProjectiles(projectiles, dt, player, SCREEN_WIDTH, map, BLOCK_SIZE, jobs);
+    }
+
+    // Outros
+    CreateProjectile(player, input, projectiles, settings->projectileWidth, settings->projectileHeight, settings->projectileSpeed, dt);
+    PROFILE_SCOPE(PROFILE_COLLISIONS) {
+        HandleCollisions(player, enemies, projectiles, map, BLOCK_SIZE, *currentFrame, dt, coins, coinCount, hash, jobs);
+    }
+
+    ConsumePressedInput(input);
+
+    // Obstaculo: o mundo volta OBSTACLE_REWIND_SECONDS segundos, mas a vida perdida continua perdida.
+    // Sem historico (rewind NULL ou vazio), volta so o jogador para o spawn
+    if (player->rewindRequested) {
+        int health = player->health;
+        player->rewindRequested = false;
+        if (!isPlayerDead(player) && rewind &&
+                RewindWorld(rewind, OBSTACLE_REWIND_SECONDS * SIMULATION_HZ, player, enemies, coins, *coinCount, projectiles) > 0) {
+            player->health = health;
+        } else {
+            ReturnPlayerToSpawn(player);
+        }
+    }
+
+    if (rewind) {
+        PROFILE_SCOPE(PROFILE_REWIND) {
+            RecordRewindFrame(rewind, player, enemies, coins, *coinCount, projectiles);
+        }
+    }
+}
+
+// Soma o tempo do frame ao relogio (limitado a MAX_FRAME_TIME) e devolve quantos ticks devem rodar agora
+int AdvanceFixedClock(FixedClock *clock, float frameTime) {
+    if (frameTime > MAX_FRAME_TIME) frameTime = MAX_FRAME_TIME;
+    clock->accumulator += frameTime;
+
+    int ticks = (int)(clock->accumulator / SIMULATION_DT);
+    clock->accumulator -= ticks * SIMULATION_DT;
+    clock->alpha = clock->accumulator / SIMULATION_DT;
+    clock->tick += ticks;
+    return ticks;
+}
+
+bool InitializeWorldSnapshot(WorldSnapshot *snapshot, int enemyCapacity, int coinCapacity, int projectileCapacity) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->coins = malloc((coinCapacity + 1) * sizeof(Coin));
+    snapshot->coinCapacity = coinCapacity;
+    if (!snapshot->coins) {
+        printf("Erro ao alocar o estado do mundo!\n");
+        return false;
+    }
+    return InitializeEnemyStore(&snapshot->enemies, enemyCapacity, BLOCK_SIZE, BLOCK_SIZE) &&
+           InitializeProjectilePool(&snapshot->projectiles, projectileCapacity);
+}
+
+void UnloadWorldSnapshot(WorldSnapshot *snapshot) {
+    UnloadEnemyStore(&snapshot->enemies);
+    UnloadProjectilePool(&snapshot->projectiles);
+    free(snapshot->coins);
+    snapshot->coins = NULL;
+    snapshot->captured = false;
+}
+
+// Copia os inimigos carregados de src para dst; dst precisa ter capacidade para src->count
+void CopyEnemyStore(EnemyStore *dst, EnemyStore *src) {
+    size_t floats = src->count * sizeof(float);
+    size_t ints = src->count * sizeof(int);
+    memcpy(dst->x, src->x, floats);
+    memcpy(dst->y, src->y, floats);
+    memcpy(dst->previousX, src->previousX, floats);
+    memcpy(dst->speedX, src->speedX, floats);
+    memcpy(dst->minX, src->minX, floats);
+    memcpy(dst->maxX, src->maxX, floats);
+    memcpy(dst->health, src->health, ints);
+    memcpy(dst->spawnId, src->spawnId, ints);
+    dst->count = src->count;
+    dst->activeCount = src->activeCount;
+}
+
+// Copia os projeteis vivos de src para dst; dst precisa ter capacidade para src->count
+void CopyProjectilePool(ProjectilePool *dst, ProjectilePool *src) {
+    size_t floats = src->count * sizeof(float);
+    memcpy(dst->x, src->x, floats);
+    memcpy(dst->y, src->y, floats);
+    memcpy(dst->previousX, src->previousX, floats);
+    memcpy(dst->previousY, src->previousY, floats);
+    memcpy(dst->width, src->width, floats);
+    memcpy(dst->height, src->height, floats);
+    memcpy(dst->speedX, src->speedX, floats);
+    memcpy(dst->speedY, src->speedY, floats);
+    memcpy(dst->travel, src->travel, floats);
+    memcpy(dst->expired, src->expired, src->count * sizeof(bool));
+    memcpy(dst->color, src->color, src->count * sizeof(Color));
+    dst->count = src->count;
+}
+
+// Guarda o estado atual do mundo
+void CaptureWorldSnapshot(WorldSnapshot *snapshot, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    snapshot->player = *player;
+    CopyEnemyStore(&snapshot->enemies, enemies);
+    CopyProjectilePool(&snapshot->projectiles, projectiles);
+    memcpy(snapshot->coins, coins, coinCount * sizeof(Coin));
+    snapshot->coinCount = coinCount;
+    snapshot->captured = true;
+}
+
+// Volta o mundo para o estado guardado. Usado para recomecar a fase (estado de logo depois de carregar) e no quickload
+void RestoreWorldSnapshot(WorldSnapshot *snapshot, Player *player, EnemyStore *enemies, Coin *coins, int *coinCount, ProjectilePool *projectiles) {
+    if (!snapshot->captured) return;
+
+    *player = snapshot->player;
+    CopyEnemyStore(enemies, &snapshot->enemies);
+    CopyProjectilePool(projectiles, &snapshot->projectiles);
+    memcpy(coins, snapshot->coins, snapshot->coinCount * sizeof(Coin));
+    *coinCount = snapshot->coinCount;
+}
+
+// Copia bytes para o cursor e avanca
+void WriteQuicksaveBytes(char **cursor, const void *values, size_t bytes) {
+    memcpy(*cursor, values, bytes);
+    *cursor += bytes;
+}
+
+// Copia bytes do cursor e avanca; false se o arquivo acabar antes
+bool ReadQuicksaveBytes(const char **cursor, const char *end, void *values, size_t bytes) {
+    if ((size_t)(end - *cursor) < bytes) return false;
+    memcpy(values, *cursor, bytes);
+    *cursor += bytes;
+    return true;
+}
+
+// Poe o estado guardado no formato do quicksave, em memoria, para a thread de arquivos gravar (so vale no mesmo
+// mapa e na mesma versao do jogo). NULL se nao houver estado ou faltar memoria
+char *EncodeQuicksave(WorldSnapshot *snapshot, TileMap *map, size_t *size) {
+    if (!snapshot->captured) return NULL;
+
+    EnemyStore *enemies = &snapshot->enemies;
+    ProjectilePool *projectiles = &snapshot->projectiles;
+    QuicksaveHeader header = {{0}, QUICKSAVE_VERSION, map->rows, map->cols, enemies->count, enemies->activeCount,
+                              snapshot->coinCount, projectiles->count};
+    memcpy(header.magic, QUICKSAVE_MAGIC, sizeof(header.magic));
+
+    *size = sizeof(header) + sizeof(Player) +
+            (size_t)enemies->count * (6 * sizeof(float) + 2 * sizeof(int)) +
+            (size_t)snapshot->coinCount * sizeof(Coin) +
+            (size_t)projectiles->count * (8 * sizeof(float) + sizeof(Color));
+    char *data = malloc(*size);
+    if (!data) {
+        printf("Erro ao alocar o quicksave!\n");
+        return NULL;
+    }
+
+    char *cursor = data;
+    WriteQuicksaveBytes(&cursor, &header, sizeof(header));
+    WriteQuicksaveBytes(&cursor, &snapshot->player, sizeof(Player));
+    WriteQuicksaveBytes(&cursor, enemies->x, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->y, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->previousX, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->speedX, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->minX, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->maxX, enemies->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, enemies->health, enemies->count * sizeof(int));
+    WriteQuicksaveBytes(&cursor, enemies->spawnId, enemies->count * sizeof(int));
+    WriteQuicksaveBytes(&cursor, snapshot->coins, snapshot->coinCount * sizeof(Coin));
+    WriteQuicksaveBytes(&cursor, projectiles->x, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->y, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->previousX, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->previousY, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->width, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->height, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->speedX, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->speedY, projectiles->count * sizeof(float));
+    WriteQuicksaveBytes(&cursor, projectiles->color, projectiles->count * sizeof(Color));
+    return data;
+}
+
+// Le um quicksave ja lido do disco (filename so para as mensagens) para o snapshot. Recusa arquivos de outra
+// versao, de outro mapa ou maiores que o snapshot
+bool DecodeQuicksave(WorldSnapshot *snapshot, TileMap *map, const char *data, size_t size, const char *filename) {
+    EnemyStore *enemies = &snapshot->enemies;
+    ProjectilePool *projectiles = &snapshot->projectiles;
+    const char *cursor = data;
+    const char *end = data + size;
+    QuicksaveHeader header;
+    if (!ReadQuicksaveBytes(&cursor, end, &header, sizeof(header)) ||
+            memcmp(header.magic, QUICKSAVE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != QUICKSAVE_VERSION ||
+            header.rows != map->rows || header.cols != map->cols ||
+            header.enemyCount < 0 || header.enemyCount > enemies->capacity ||
+            header.enemyActiveCount < 0 || header.enemyActiveCount > header.enemyCount ||
+            header.coinCount < 0 || header.coinCount > snapshot->coinCapacity ||
+            header.projectileCount < 0 || header.projectileCount > projectiles->capacity) {
+        printf("Quicksave %s invalido, de outra versao ou de outro mapa\n", filename);
+        return false;
+    }
+
+    size_t n = header.enemyCount;
+    size_t p = header.projectileCount;
+    bool ok = ReadQuicksaveBytes(&cursor, end, &snapshot->player, sizeof(Player)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->x, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->y, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->previousX, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->speedX, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->minX, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->maxX, n * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->health, n * sizeof(int)) &&
+              ReadQuicksaveBytes(&cursor, end, enemies->spawnId, n * sizeof(int)) &&
+              ReadQuicksaveBytes(&cursor, end, snapshot->coins, header.coinCount * sizeof(Coin)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->x, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->y, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->previousX, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->previousY, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->width, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->height, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->speedX, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->speedY, p * sizeof(float)) &&
+              ReadQuicksaveBytes(&cursor, end, projectiles->color, p * sizeof(Color));
+
+    if (!ok) {
+        printf("Quicksave %s incompleto\n", filename);
+        snapshot->captured = false;
+        return false;
+    }
+
+    enemies->count = header.enemyCount;
+    enemies->activeCount = header.enemyActiveCount;
+    memset(projectiles->travel, 0, p * sizeof(float));
+    memset(projectiles->expired, 0, p * sizeof(bool));
+    projectiles->count = header.projectileCount;
+    snapshot->coinCount = header.coinCount;
+    snapshot->captured = true;
+    return true;
+}
+
+// Mistura count valores de 4 bytes no hash (FNV-1a de 64 bits, uma palavra por vez). Quatro acumuladores
+// independentes, juntados no fim, para uma multiplicacao nao ter que esperar a anterior
+unsigned long long HashWords(unsigned long long hash, const void *values, int count) {
+    const unsigned char *bytes = values;
+    unsigned long long lanes[4] = {hash, hash ^ 1, hash ^ 2, hash ^ 3};
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            unsigned int word;
+            memcpy(&word, bytes + (i + lane) * 4, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * 0x100000001b3ULL;
+        }
+    }
+    for (; i < count; i++) {
+        unsigned int word;
+        memcpy(&word, bytes + i * 4, sizeof(word));
+        lanes[0] = (lanes[0] ^ word) * 0x100000001b3ULL;
+    }
+    for (int lane = 1; lane < 4; lane++) {
+        lanes[0] = (lanes[0] ^ lanes[lane]) * 0x100000001b3ULL;
+    }
+    return lanes[0];
+}
+
+// Hash do estado que a simulacao produz: se dois mundos diferem em qualquer posicao, velocidade, vida,
+// pontuacao, moeda ou projetil, os hashes diferem (salvo colisao)
+unsigned HashWorldState(Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    float playerState[5] = {
+        player->position.x, player->position.y, player->velocity.x, player->velocity.y, player->shootTimer
+    };
+    int playerFlags[6] = {
+        player->isGrounded, player->facingRight, player->isShooting, player->health, player->points, player->reachedGate
+    };
+    int counts[3] = {enemies->count, enemies->activeCount, projectiles->count};
+
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    hash = HashWords(hash, playerState, 5);
+    hash = HashWords(hash, playerFlags, 6);
+    hash = HashWords(hash, counts, 3);
+    hash = HashWords(hash, enemies->x, enemies->count);
+    hash = HashWords(hash, enemies->y, enemies->count);
+    hash = HashWords(hash, enemies->speedX, enemies->count);
+    hash = HashWords(hash, enemies->health, enemies->count);
+    for (int i = 0; i < coinCount; i++) {
+        hash = (hash ^ coins[i].active) * 0x100000001b3ULL;
+    }
+    hash = HashWords(hash, projectiles->x, projectiles->count);
+    hash = HashWords(hash, projectiles->y, projectiles->count);
+    hash = HashWords(hash, projectiles->speedX, projectiles->count);
+    hash = HashWords(hash, projectiles->speedY, projectiles->count);
+    return (unsigned)(hash ^ (hash >> 32));
+}
+
+void InitializeReplay(InputReplay *replay) {
+    memset(replay, 0, sizeof(*replay));
+    replay->divergedTick = -1;
+}
+
+void UnloadReplay(InputReplay *replay) {
+    free(replay->inputs);
+    free(replay->checkpoints);
+    InitializeReplay(replay);
+}
+
+// Comeca a gravar a partir do proximo tick. O mundo tem que estar no comeco da fase
+void BeginReplayRecording(InputReplay *replay, int extraEnemies) {
+    UnloadReplay(replay);
+    replay->extraEnemies = extraEnemies;
+    replay->recording = true;
+}
+
+// Garante espaco para mais um tick gravado, dobrando a capacidade quando acaba
+bool ReserveReplayTick(InputReplay *replay) {
+    if (replay->tickCount < replay->tickCapacity) return true;
+
+    int capacity = replay->tickCapacity ? replay->tickCapacity * 2 : SIMULATION_HZ * 60;
+    unsigned char *inputs = realloc(replay->inputs, capacity);
+    if (!inputs) return false;
+    replay->inputs = inputs;
+
+    unsigned *checkpoints = realloc(replay->checkpoints, (capacity / REPLAY_HASH_INTERVAL + 1) * sizeof(unsigned));
+    if (!checkpoints) return false;
+    replay->checkpoints = checkpoints;
+    replay->tickCapacity = capacity;
+    return true;
+}
+
+// Entrada do proximo tick da reproducao. Devolve false quando a gravacao acabou
+bool NextReplayInput(InputReplay *replay, PlayerInput *input) {
+    if (!replay->playing || replay->current >= replay->tickCount) {
+        replay->playing = false;
+        return false;
+    }
+    *input = UnpackPlayerInput(replay->inputs[replay->current++]);
+    return true;
+}
+
+// Fecha o tick que acabou de rodar com a entrada buttons: acumula o hash do mundo e, a cada
+// REPLAY_HASH_INTERVAL ticks, grava (gravando) ou confere (reproduzindo) o hash acumulado
+void AdvanceReplay(InputReplay *replay, unsigned char buttons, Player *player, EnemyStore *enemies, Coin *coins, int coinCount, ProjectilePool *projectiles) {
+    if (!replay->recording && !replay->playing) return;
+
+    replay->hash = (replay->hash ^ HashWorldState(player, enemies, coins, coinCount, projectiles)) * 16777619u;
+
+    if (replay->recording) {
+        if (!ReserveReplayTick(replay)) {
+            printf("Erro ao alocar a gravacao! Gravacao interrompida em %d ticks\n", replay->tickCount);
+            replay->recording = false;
+            return;
+        }
+        replay->inputs[replay->tickCount++] = buttons;
+        if (replay->tickCount % REPLAY_HASH_INTERVAL == 0) {
+            replay->checkpoints[replay->tickCount / REPLAY_HASH_INTERVAL - 1] = replay->hash;
+        }
+    } else if (replay->current % REPLAY_HASH_INTERVAL == 0 && replay->divergedTick < 0 &&
+               replay->checkpoints[replay->current / REPLAY_HASH_INTERVAL - 1] != replay->hash) {
+        replay->divergedTick = replay->current;
+        printf("Replay divergiu da gravacao entre os ticks %d e %d\n", replay->current - REPLAY_HASH_INTERVAL, replay->current - 1);
+    }
+}
+
+void PrintReplayResult(InputReplay *replay) {
+    if (replay->divergedTick >= 0) {
+        printf("Replay: %d de %d ticks, divergiu da gravacao ate o tick %d\n", replay->current, replay->tickCount, replay->divergedTick);
+    } else {
+        printf("Replay: %d de %d ticks, mundo igual a gravacao nos %d hashes conferidos\n",
+               replay->current, replay->tickCount, replay->current / REPLAY_HASH_INTERVAL);
+    }
+}
+
+// Grava a sessao. Ticks seguidos com os mesmos botoes viram um par (botoes, repeticoes): segurar uma
+// direcao por um minuto ocupa poucos bytes
+bool SaveReplay(InputReplay *replay, TileMap *map, const char *filename) {
+    unsigned char *runs = malloc(replay->tickCount * 6 + 1);
+    if (!runs) {
+        printf("Erro ao alocar a gravacao!\n");
+        return false;
+    }
+    int size = 0;
+    for (int i = 0; i < replay->tickCount; ) {
+        int run = 1;
+        while (i + run < replay->tickCount && replay->inputs[i + run] == replay->inputs[i]) run++;
+        runs[size++] = replay->inputs[i];
+        size += WriteVarint(runs + size, run - 1);
+        i += run;
+    }
+
+    ReplayHeader header = {{0}, REPLAY_VERSION, map->rows, map->cols, replay->extraEnemies, replay->tickCount, size, REPLAY_HASH_INTERVAL};
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Erro ao criar %s!\n", filename);
+        free(runs);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(runs, 1, size, file);
+    fwrite(replay->checkpoints, sizeof(unsigned), replay->tickCount / REPLAY_HASH_INTERVAL, file);
+    free(runs);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) printf("Erro ao gravar %s!\n", filename);
+    return ok;
+}
+
+// Le uma gravacao e deixa pronta para reproduzir. Recusa arquivos de outra versao ou de outro mapa
+bool LoadReplay(InputReplay *replay, TileMap *map, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Erro ao abrir a gravacao %s!\n", filename);
+        return false;
+    }
+
+    ReplayHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != REPLAY_VERSION ||
+            header.hashInterval != REPLAY_HASH_INTERVAL ||
+            header.rows != map->rows || header.cols != map->cols ||
+            header.extraEnemies < 0 || header.tickCount < 0 ||
+            header.inputBytes < 0 || header.inputBytes > INT_MAX - 5) {     // A leitura dos varints passa ate 5 bytes do fim
+        printf("Gravacao %s invalida, de outra versao ou de outro mapa\n", filename);
+        fclose(file);
+        return false;
+    }
+
+    UnloadReplay(replay);
+    int hashCount = header.tickCount / REPLAY_HASH_INTERVAL;
+    // Contas em size_t: tickCount e inputBytes vem do arquivo e podem estar perto do maximo de int
+    replay->inputs = malloc((size_t)header.tickCount + 1);
+    replay->checkpoints = malloc(((size_t)hashCount + 1) * sizeof(unsigned));
+    unsigned char *runs = calloc((size_t)header.inputBytes + 5, 1);  // Os zeros do fim terminam um varint cortado
+    if (!replay->inputs || !replay->checkpoints || !runs) {
+        printf("Erro ao alocar a gravacao!\n");
+        fclose(file);
+        free(runs);
+        UnloadReplay(replay);
+        return false;
+    }
+
+    bool ok = fread(runs, 1, header.inputBytes, file) == (size_t)header.inputBytes &&
+              fread(replay->checkpoints, sizeof(unsigned), hashCount, file) == (size_t)hashCount;
+    fclose(file);
+
+    // Expande as sequencias; tem que dar exatamente tickCount ticks
+    int position = 0;
+    int ticks = 0;
+    while (ok && position < header.inputBytes) {
+        unsigned char buttons = runs[position++];
+        unsigned run = ReadVarint(runs, &position) + 1;
+        if (run == 0 || run > (unsigned)(header.tickCount - ticks)) {
+            ok = false;
+            break;
+        }
+        memset(replay->inputs + ticks, buttons, run);
+        ticks += run;
+    }
+    free(runs);
+
+    if (!ok || ticks != header.tickCount) {
+        printf("Gravacao %s incompleta\n", filename);
+        UnloadReplay(replay);
+        return false;
+    }
+
+    replay->tickCount = header.tickCount;
+    replay->tickCapacity = header.tickCount;
+    replay->extraEnemies = header.extraEnemies;
+    replay->playing = true;
+    return true;
+}
+
+#ifndef HEADLESS
+int BeginGame(Player *player,
+             Rectangle frameRec,
+             AnimationSystem *animation,
+             unsigned *currentFrame,
+             Camera2D camera,
+             GameSettings *settings,
+             TileMap *map,
+             Coin *coins,
+             int *coinCount,
+             EnemyStore *enemies,
+             ProjectilePool *projectiles,
+             BackgroundLayer backgroundLayers[MAX_BACKGROUND_LAYERS],
+             int backgroundLayerCount,
+             int frameWidth,
+             int *guarda,
+             Rectangle enemyFrameRec,
+             SpatialHash *hash,
+             TerrainCache *terrain,
+             SpriteBatch *batch,
+             FixedClock *clock,
+             PlayerInput *input,
+             WorldSnapshot *levelStart,
+             WorldSnapshot *quicksave,
+             RewindBuffer *rewind,
+             InputReplay *replay,
+             Leaderboard *leaderboard,
+             IoQueue *io,
+             AudioSystem *audio,
+             JobSystem *jobs
+            )
+{
+
+    if(!isPlayerDead(player)) {
+
+#ifdef PROFILER
+    FrameProfiler *profiler = GetFrameProfiler();
+    ProfilerBeginFrame(profiler);
+    if (IsKeyPressed(KEY_F3)) profiler->visible = !profiler->visible;
+    if (IsKeyPressed(KEY_F4)) {
+        size_t size;
+        char *csv = FormatProfilerCsv(profiler, &size);
+        if (csv) {
+            QueueFileWrite(io, PROFILER_CSV, csv, size);
+            printf("Profiler: %d frames enviados para %s\n", profiler->count, PROFILER_CSV);
+        }
+    }
+#endif
+
+    // Quicksave (F5) e quickload (F9). Gravando ou reproduzindo uma replay nao ha quickload: o mundo lido do
+    // arquivo nao sai das entradas gravadas. O disco fica com a thread de arquivos: F5 so copia o mundo e F9
+    // so pede a leitura, aplicada num frame seguinte quando termina
+    if (IsKeyPressed(KEY_F5)) {
+        CaptureWorldSnapshot(quicksave, player, enemies, coins, *coinCount, projectiles);
+        size_t size;
+        char *data = EncodeQuicksave(quicksave, map, &size);
+        if (data) QueueFileWrite(io, QUICKSAVE_FILE, data, size);
+    }
+    if (IsKeyPressed(KEY_F9) && !replay->recording && !replay->playing) {
+        QueueFileRead(io, QUICKSAVE_FILE, IO_TAG_QUICKLOAD);
+    }
+    IoRequest done;
+    while (PollIoCompletion(io, &done)) {
+        if (done.tag == IO_TAG_QUICKLOAD && !done.ok) {
+            printf("Nenhum quicksave em %s\n", done.filename);
+        } else if (done.tag == IO_TAG_QUICKLOAD && !replay->recording && !replay->playing &&
+                   DecodeQuicksave(quicksave, map, done.data, done.size, done.filename)) {
+            RestoreWorldSnapshot(quicksave, player, enemies, coins, coinCount, projectiles);
+            ClearRewindBuffer(rewind);
+        }
+        FinishIoRequest(&done, leaderboard);
+    }
+
+    // Simulacao em passo fixo: roda quantos ticks couberem no tempo do frame, independente do FPS.
+    // Reproduzindo uma replay, a entrada de cada tick vem da gravacao em vez do teclado
+    PollPlayerInput(input);
+    int ticks = AdvanceFixedClock(clock, GetFrameTime());
+    PROFILE_SCOPE(PROFILE_SIMULATION) {
+        for (int t = 0; t < ticks && !isPlayerDead(player); t++) {
+            if (replay->playing && !NextReplayInput(replay, input)) {
+                PrintReplayResult(replay);  // Acabou a gravacao: o teclado volta a controlar
+            }
+            unsigned char buttons = PackPlayerInput(input);
+            bool rewinding = input->rewind;
+            bool shooting = input->shootHorizontal || input->shootVertical;
+            int points = player->points;
+            int health = player->health;
+            SimulateTick(player, input, currentFrame, settings, map,
+                         coins, coinCount, enemies, projectiles, hash, rewind, jobs);
+            AdvanceReplay(replay, buttons, player, enemies, coins, *coinCount, projectiles);
+
+            // Efeitos sonoros pelo que o tick mudou; a simulacao nao sabe de audio. Cada inimigo acertado vale 100
+            // pontos e cada moeda 10. Voltando no tempo (R) nada toca
+            int gained = player->points - points;
+            if (!rewinding) {
+                if (shooting) PlaySfx(audio, SFX_SHOT);
+                if (gained >= 100) PlaySfx(audio, SFX_HIT);
+                if (gained > 0 && gained % 100 != 0) PlaySfx(audio, SFX_COIN);
+                if (player->health < health) PlaySfx(audio, SFX_HURT);
+            }
+        }
+    }
+#ifdef PROFILER
+    profiler->frames[profiler->current].ticks = ticks;
+#endif
+
+    // Chegou ao portao: tela de nome e gravacao do placar ficam fora dos ticks
+    if (player->reachedGate) {
+        RegistraPontuacao(player, leaderboard, io);
+    }
+
+    // Quadros de animacao de todos, com o estado depois dos ticks
+    PROFILE_SCOPE(PROFILE_ANIMATION) {
+        UpdateAnimations(animation, player, enemies, GetFrameTime());
+    }
+    frameRec.x = frameWidth * animation->playerFrame;
+    frameRec.width = player->facingRight ? -frameWidth : frameWidth;
+
+    // Desenho interpolado entre o tick anterior e o atual
+    float alpha = clock->alpha;
+    MoveCamera(&camera, player, alpha);
+
+    // Area visivel, usada para nao desenhar o que esta fora da tela
+    Rectangle view = GetCameraViewRect(camera);
+
+    // Pede os pedacos do mapa da tela e o proximo a direita, antes do jogador chegar nele; chegam num frame seguinte
+    QueueMapColumns(io, map, view.x / BLOCK_SIZE - 1, (view.x + view.width) / BLOCK_SIZE + MAP_CHUNK_COLUMNS);
+
+    BeginDrawing();
+
+    // Redesenha pedacos de terreno que mudaram antes de entrar no modo de camera
+    PROFILE_SCOPE(PROFILE_TERRAIN_CACHE) {
+        UpdateTerrainCache(terrain, view, map, BLOCK_SIZE, batch);
+    }
+
+    ClearBackground(RAYWHITE);
+
+    BeginMode2D(camera);
+
+    // Renderiza o fundo atrs do jogador
+    PROFILE_SCOPE(PROFILE_RENDER_BACKGROUND) {
+        RenderBackground(backgroundLayers, backgroundLayerCount, view);
+    }
+
+    // Renderiza jogador e moedas. O lote e enviado antes do terreno para manter a ordem de desenho
+    PROFILE_SCOPE(PROFILE_RENDER_PLAYER_COINS) {
+        ResetSpriteBatchStats(batch);
+        Vector2 playerDrawPosition = GetInterpolatedPlayerPosition(player, alpha);
+        SubmitSpriteFrame(batch, SPRITE_PLAYER, frameRec, (Rectangle){playerDrawPosition.x, playerDrawPosition.y, player->rect.width, player->rect.height}, WHITE);
+        RenderCoins(batch, coins, *coinCount, view);
+        FlushSpriteBatch(batch);
+    }
+
+    // Renderiza mapa e elementos dinmicos
+    PROFILE_SCOPE(PROFILE_RENDER_MAP) {
+        RenderMap(terrain, BLOCK_SIZE, view);
+    }
+    PROFILE_SCOPE(PROFILE_RENDER_PROJECTILES) {
+        RenderProjectiles(batch, projectiles, view, alpha);
+    }
+    PROFILE_SCOPE(PROFILE_RENDER_ENEMIES) {
+        RenderEnemies(batch, enemies, BLOCK_SIZE, enemyFrameRec, animation->enemyFrames, view, alpha);
+        FlushSpriteBatch(batch);
+    }
+
+    EndMode2D();
+
+    // Interface
+    PROFILE_SCOPE(PROFILE_HUD) {
+        int heartX = 85;
+        int heartY = 37;
+        float heartWidth = 30.0f;
+        float heartHeight = 30.0f;
+
+        for (int i = 0; i < player->health; i++) {
+            Rectangle destRect = { heartX + i * (heartWidth + 5), heartY, heartWidth, heartHeight };
+            SubmitSprite(batch, SPRITE_HEART, destRect, WHITE);
+        }
+        FlushSpriteBatch(batch);
+
+        int textX = 10;
+        int textY = 40;
+        int textHeight = 20;
+        int textWidth = MeasureText(TextFormat("Health:"), textHeight);
+        DrawRectangle(textX - 5, textY - 5, textWidth + 10, textHeight + 10, BLACK);
+        DrawText(TextFormat("Health:"), textX, textY, 20, WHITE);
+
+        int pointsX = 10;
+        int pointsY = 70;
+        int pointsHeight = 20;
+        int pointsWidth = MeasureText(TextFormat("Points: %d", player->points), textHeight);
+        DrawRectangle(pointsX - 5, pointsY - 5, pointsWidth + 10, pointsHeight + 10, BLACK);
+        DrawText(TextFormat("Points: %d", player->points), 10, 70, textHeight, WHITE);
+    }
+
+#ifdef PROFILER
+    if (profiler->visible) {
+        DrawProfilerOverlay(profiler);
+    }
+#endif
+
+    EndDrawing();
+
+    *guarda = 1;
+    } else {
+        *guarda = 0;
+
+        if(player->points < 0) {
+            DesenhaTelaFinal();
+        }
+
+        // Recomeca a fase: tudo volta ao estado de logo depois de carregar, inclusive as moedas
+        RestoreWorldSnapshot(levelStart, player, enemies, coins, coinCount, projectiles);
+        ClearRewindBuffer(rewind);
+        WaitTime(0.1);
+    }
+}
+#endif
+
+// Relogio de parede em segundos (benchmarks e modo sem janela)
+double BenchmarkNow(void) {
+#ifdef TIME_UTC
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#if defined(BENCHMARK)
+// Benchmarks (alvo Benchmark do test.cbp, compilado com -DBENCHMARK). Mede as funcoes quentes em mundos gerados
+// de varios tamanhos e grava ns/op e op/s num CSV. Cada op das funcoes de simulacao e uma chamada por tick,
+// entao op/s e o teto de ticks por segundo que a funcao sozinha permite; no SimulateTick a op e o tick inteiro.
+// Com -b compara com um CSV anterior e sai com erro se algo ficou mais lento que a tolerancia
+
+#define MAX_BENCHMARK_RESULTS 64
+#define BENCHMARK_MAP_FILE "benchmark_map.txt"
+#define BENCHMARK_ASSET_COUNT 8
+#define BENCHMARK_COMPILED_MAP_FILE "benchmark_map.bin"
+#define BENCHMARK_QUICKSAVE_FILE "benchmark_quicksave.bin"
+#define BENCHMARK_REPLAY_FILE "benchmark_replay.bin"
+#define BENCHMARK_LEADERBOARD_FILE "benchmark_leaderboard.bin"
+#define BENCHMARK_LEADERBOARD_LOG "benchmark_leaderboard.log"
+
+typedef struct {
+    char name[48];
+    int rows, cols;          // Tamanho do mapa (0 quando nao usa mapa)
+    int enemies, coins, projectiles;
+    long ops;                // Operacoes medidas
+    double nsPerOp;
+    double opsPerSec;
+} BenchmarkResult;
+
+typedef struct {
+    BenchmarkResult results[MAX_BENCHMARK_RESULTS];
+    int count;
+    int failures;            // Verificacoes que falharam durante as medicoes; o benchmark termina com erro
+} BenchmarkReport;
+
+// Mundo de teste com as mesmas estruturas do jogo
+typedef struct {
+    TileMap map;            // Lido de BENCHMARK_MAP_FILE, como o jogo le o map.txt
+    Player player;
+    Coin *coins;
+    int coinCount;
+    EnemyStore enemies;
+    ProjectilePool projectiles;
+    SpatialHash hash;
+    GameSettings settings;
+    WorldSnapshot levelStart;   // Estado logo depois de criar o mundo
+} BenchmarkWorld;
+
+// Guarda o resultado e imprime uma linha legivel
+void RecordBenchmark(BenchmarkReport *report, const char *name, int rows, int cols, int enemies, int coins, int projectiles, long ops, double seconds) {
+    if (report->count >= MAX_BENCHMARK_RESULTS || ops <= 0) return;
+
+    BenchmarkResult *result = &report->results[report->count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->rows = rows;
+    result->cols = cols;
+    result->enemies = enemies;
+    result->coins = coins;
+    result->projectiles = projectiles;
+    result->ops = ops;
+    result->nsPerOp = seconds * 1e9 / ops;
+    result->opsPerSec = seconds > 0 ? ops / seconds : 0;
+
+    printf("%-30s %3dx%-4d  M %5d  C %4d  P %4d  %12.1f ns/op  %12.0f op/s\n",
+           name, rows, cols, enemies, coins, projectiles, result->nsPerOp, result->opsPerSec);
+}
+
+// Grava os resultados em CSV, uma linha por benchmark
+bool WriteBenchmarkReport(BenchmarkReport *report, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Erro ao criar %s!\n", filename);
+        return false;
+    }
+
+    fprintf(file, "benchmark,rows,cols,enemies,coins,projectiles,ops,ns_per_op,ops_per_sec\n");
+    for (int i = 0; i < report->count; i++) {
+        BenchmarkResult *r = &report->results[i];
+        fprintf(file, "%s,%d,%d,%d,%d,%d,%ld,%.3f,%.3f\n",
+                r->name, r->rows, r->cols, r->enemies, r->coins, r->projectiles, r->ops, r->nsPerOp, r->opsPerSec);
+    }
+    fclose(file);
+    return true;
+}
+
+// Compara com um CSV de referencia e retorna quantos benchmarks ficaram mais de tolerance% mais lentos
+int CompareBenchmarkBaseline(BenchmarkReport *report, const char *filename, double tolerance) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Erro ao abrir a referencia %s!\n", filename);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        BenchmarkResult base;
+        if (sscanf(line, "%47[^,],%d,%d,%d,%d,%d,%ld,%lf,%lf", base.name, &base.rows, &base.cols, &base.enemies,
+                   &base.coins, &base.projectiles, &base.ops, &base.nsPerOp, &base.opsPerSec) != 9) {
+            continue;   // Cabecalho ou linha invalida
+        }
+
+        for (int i = 0; i < report->count; i++) {
+            BenchmarkResult *r = &report->results[i];
+            if (strcmp(r->name, base.name) != 0 || r->rows != base.rows || r->cols != base.cols ||
+                    r->enemies != base.enemies || r->coins != base.coins || r->projectiles != base.projectiles) {
+                continue;
+            }
+
+            double change = (r->nsPerOp - base.nsPerOp) * 100.0 / base.nsPerOp;
+            if (change > tolerance) {
+                printf("REGRESSAO %s %dx%d M %d C %d P %d: %.1f -> %.1f ns/op (%+.1f%%)\n", r->name, r->rows, r->cols,
+                       r->enemies, r->coins, r->projectiles, base.nsPerOp, r->nsPerOp, change);
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+// Gera em tiles (rows x cols, linha por linha) uma fase com chao, plataformas, obstaculos (O) no chao,
+// enemyCount inimigos (M), coinCount moedas (C), spawn e portao
+void GenerateBenchmarkMap(char *tiles, int rows, int cols, int enemyCount, int coinCount) {
+    srand(42);
+    memset(tiles, ' ', (size_t)rows * cols);
+
+    // Chao de dois blocos
+    for (int x = 0; x < cols; x++) {
+        tiles[(size_t)(rows - 1) * cols + x] = 'B';
+        tiles[(size_t)(rows - 2) * cols + x] = 'B';
+    }
+
+    // Plataformas de 4 blocos, uma a cada 64 celulas em media
+    for (long i = 0; i < (long)rows * cols / 64; i++) {
+        int y = 2 + rand() % (rows - 5);
+        int x = rand() % (cols - 4);
+        memset(&tiles[(size_t)y * cols + x], 'B', 4);
+    }
+
+    // Obstaculos sobre o chao: uma fileira no caminho de quem anda do spawn para a direita, como nos benchmarks
+    // de tick (larga para nao ser pulada), e mais um a cada 128 colunas em media, longe do spawn e do portao
+    memset(&tiles[(size_t)(rows - 3) * cols + 24], 'O', 6);
+    for (long i = 0; i < cols / 128; i++) {
+        int x = 8 + rand() % (cols - 16);
+        tiles[(size_t)(rows - 3) * cols + x] = 'O';
+    }
+
+    tiles[(size_t)(rows - 3) * cols + 1] = 'P';
+    tiles[(size_t)(rows - 3) * cols + cols - 2] = 'G';
+
+    // Inimigos e moedas so em celulas livres
+    for (long placed = 0, tries = 0; placed < enemyCount && tries < (long)rows * cols * 4; tries++) {
+        int y = rand() % (rows - 2);
+        int x = 4 + rand() % (cols - 8);
+        if (tiles[(size_t)y * cols + x] == ' ') {
+            tiles[(size_t)y * cols + x] = 'M';
+            placed++;
+        }
+    }
+    for (long placed = 0, tries = 0; placed < coinCount && tries < (long)rows * cols * 4; tries++) {
+        int y = rand() % (rows - 2);
+        int x = 4 + rand() % (cols - 8);
+        if (tiles[(size_t)y * cols + x] == ' ') {
+            tiles[(size_t)y * cols + x] = 'C';
+            placed++;
+        }
+    }
+}
+
+// Gera a fase e grava no formato texto do map.txt
+bool WriteBenchmarkMap(const char *filename, int rows, int cols, int enemyCount, int coinCount) {
+    char *tiles = malloc((size_t)rows * cols);
+    if (!tiles) {
+        printf("Erro ao alocar o mapa do benchmark!\n");
+        return false;
+    }
+    GenerateBenchmarkMap(tiles, rows, cols, enemyCount, coinCount);
+
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Erro ao criar %s!\n", filename);
+        free(tiles);
+        return false;
+    }
+    for (int y = 0; y < rows; y++) {
+        fwrite(&tiles[(size_t)y * cols], 1, cols, file);
+        fputc('\n', file);
+    }
+    fclose(file);
+    free(tiles);
+    return true;
+}
+
+bool CreateBenchmarkWorld(BenchmarkWorld *world, int rows, int cols, int enemyCount, int coinCount) {
+    memset(world, 0, sizeof(*world));
+    if (!WriteBenchmarkMap(BENCHMARK_MAP_FILE, rows, cols, enemyCount, coinCount) ||
+            !LoadMap(BENCHMARK_MAP_FILE, &world->map)) {
+        return false;
+    }
+    world->settings = InitializeGameSettings();
+
+    world->player = InitializePlayer();
+    FindPlayerSpawnPoint(&world->map, &world->player);
+    world->coins = malloc((world->map.coinCount + 1) * sizeof(Coin));
+    if (!world->coins) {
+        printf("Erro ao alocar as moedas do benchmark!\n");
+        return false;
+    }
+    world->coinCount = InitializeCoins(&world->map, world->coins, BLOCK_SIZE);
+
+    int enemyCapacity = (world->map.enemyCount > MAX_ENEMIES) ? world->map.enemyCount : MAX_ENEMIES;
+    if (!InitializeEnemyStore(&world->enemies, enemyCapacity, BLOCK_SIZE, BLOCK_SIZE) ||
+            !InitializeProjectilePool(&world->projectiles, MAX_PROJECTILES) ||
+            !InitializeSpatialHash(&world->hash, enemyCapacity + world->coinCount + MAX_PROJECTILES)) {
+        return false;
+    }
+    InitializeEnemies(&world->map, &world->enemies, BLOCK_SIZE, world->settings.enemySpeedX, world->settings.enemyOffset);
+
+    if (!InitializeWorldSnapshot(&world->levelStart, enemyCapacity, world->coinCount, MAX_PROJECTILES)) {
+        return false;
+    }
+    CaptureWorldSnapshot(&world->levelStart, &world->player, &world->enemies, world->coins, world->coinCount, &world->projectiles);
+    return true;
+}
+
+void UnloadBenchmarkWorld(BenchmarkWorld *world) {
+    UnloadWorldSnapshot(&world->levelStart);
+    UnloadSpatialHash(&world->hash);
+    UnloadProjectilePool(&world->projectiles);
+    UnloadEnemyStore(&world->enemies);
+    free(world->coins);
+    UnloadMap(&world->map);
+    remove(BENCHMARK_MAP_FILE);
+}
+
+// Enche o pool com count projeteis a ate spread pixels do jogador, metade horizontais e metade verticais.
+// A semente fixa repete o mesmo conjunto a cada chamada
+void FillBenchmarkProjectiles(BenchmarkWorld *world, int count, float spread) {
+    srand(7);
+    world->projectiles.count = 0;
+    for (int i = 0; i < count; i++) {
+        Rectangle rect = {
+            world->player.position.x + ((float)rand() / RAND_MAX * 2 - 1) * spread,
+            (float)(rand() % (world->map.rows * BLOCK_SIZE)),
+            world->settings.projectileWidth,
+            world->settings.projectileHeight
+        };
+        Vector2 speed = (i % 2) ? (Vector2){(rand() % 2) ? 400 : -400, 0} : (Vector2){0, (rand() % 2) ? 400 : -400};
+        SpawnProjectile(&world->projectiles, rect, speed, YELLOW);
+    }
+}
+
+// Abre o mesmo mapa varias vezes do disco (indice de linhas e entidades; os blocos sao lidos depois, por pedaco)
+void BenchmarkLoadMap(BenchmarkReport *report, int rows, int cols, int loads) {
+    if (!WriteBenchmarkMap(BENCHMARK_MAP_FILE, rows, cols, 0, 0)) return;
+
+    TileMap map;
+    int loadedRows = 0, loadedCols = 0;
+    double start = BenchmarkNow();
+    for (int i = 0; i < loads; i++) {
+        if (!LoadMap(BENCHMARK_MAP_FILE, &map)) break;
+        loadedRows = map.rows;
+        loadedCols = map.cols;
+        UnloadMap(&map);
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    if (loadedRows != rows || loadedCols != cols) {
+        printf("LoadMap leu %dx%d em vez de %dx%d!\n", loadedRows, loadedCols, rows, cols);
+    }
+    RecordBenchmark(report, "LoadMap", rows, cols, 0, 0, 0, loads, elapsed);
+
+    remove(BENCHMARK_MAP_FILE);
+}
+
+// Abre o mesmo mapa compilado varias vezes e prepara a fase (spawn, inimigos e moedas), que e o que o jogo
+// faz ao carregar; compara com o LoadMap do texto do mesmo tamanho
+void BenchmarkLoadCompiledMap(BenchmarkReport *report, int rows, int cols, int loads) {
+    TileMap map;
+    if (!WriteBenchmarkMap(BENCHMARK_MAP_FILE, rows, cols, MAX_ENEMIES, 1000) || !LoadMap(BENCHMARK_MAP_FILE, &map)) return;
+    bool compiled = CompileMap(&map, BENCHMARK_COMPILED_MAP_FILE);
+    UnloadMap(&map);
+    remove(BENCHMARK_MAP_FILE);
+    if (!compiled) return;
+
+    Player player = InitializePlayer();
+    EnemyStore enemies;
+    Coin *coins = malloc(1000 * sizeof(Coin));
+    if (!coins || !InitializeEnemyStore(&enemies, MAX_ENEMIES, BLOCK_SIZE, BLOCK_SIZE)) {
+        free(coins);
+        remove(BENCHMARK_COMPILED_MAP_FILE);
+        return;
+    }
+
+    int coinCount = 0;
+    double start = BenchmarkNow();
+    for (int i = 0; i < loads; i++) {
+        if (!LoadMap(BENCHMARK_COMPILED_MAP_FILE, &map)) break;
+        FindPlayerSpawnPoint(&map, &player);
+        InitializeEnemies(&map, &enemies, BLOCK_SIZE, 150, 200);
+        coinCount = InitializeCoins(&map, coins, BLOCK_SIZE);
+        UnloadMap(&map);
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "LoadMap compilado", rows, cols, enemies.count, coinCount, 0, loads, elapsed);
+
+    UnloadEnemyStore(&enemies);
+    free(coins);
+    remove(BENCHMARK_COMPILED_MAP_FILE);
+}
+
+// Colisao do jogador andando a fase inteira da esquerda para a direita, um bloco por op: mede o custo
+// de ler os pedacos do disco conforme o jogador avanca, com a memoria do mapa limitada
+void BenchmarkMapStreaming(BenchmarkReport *report, int rows, int cols) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, 0, 0)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    int grounded = 0;
+    double start = BenchmarkNow();
+    for (int x = 0; x < cols; x++) {
+        world.player.position.x = x * BLOCK_SIZE;
+        world.player.rect.x = world.player.position.x;
+        world.player.rect.y = world.player.spawnPoint.y;
+        HandlePlayerBlockCollisions(&world.player, &world.map, BLOCK_SIZE);
+        grounded += world.player.isGrounded;
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "MapStreaming", rows, cols, 0, 0, 0, cols, elapsed);
+    printf("    %lu pedacos lidos, %zu KB de mapa na memoria\n", world.map.chunkLoads, GetMapMemoryUsage(&world.map) / 1024);
+    if (grounded < 0) printf("%d\n", grounded);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Colisao do jogador com o mapa em posicoes espalhadas pela fase inteira
+void BenchmarkPlayerBlockCollisions(BenchmarkReport *report, int rows, int cols, long calls) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, 0, 0)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    Vector2 positions[1024];
+    srand(11);
+    for (int i = 0; i < 1024; i++) {
+        positions[i] = (Vector2){(float)(rand() % (cols * BLOCK_SIZE)), (float)(rand() % (rows * BLOCK_SIZE))};
+    }
+
+    int grounded = 0;
+    double start = BenchmarkNow();
+    for (long i = 0; i < calls; i++) {
+        world.player.position = positions[i & 1023];
+        world.player.rect.x = world.player.position.x;
+        world.player.rect.y = world.player.position.y;
+        HandlePlayerBlockCollisions(&world.player, &world.map, BLOCK_SIZE);
+        grounded += world.player.isGrounded;
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "HandlePlayerBlockCollisions", rows, cols, 0, 0, 0, calls, elapsed);
+    if (grounded < 0) printf("%d\n", grounded);  // Usa o resultado para o compilador nao descartar o laco
+    UnloadBenchmarkWorld(&world);
+}
+
+// Linha de visada entre pontos espalhados pela fase, ate 32 blocos de distancia (inimigo procurando o jogador)
+void BenchmarkLineOfSight(BenchmarkReport *report, int rows, int cols, long calls) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, 0, 0)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    Vector2 from[1024], to[1024];
+    srand(13);
+    for (int i = 0; i < 1024; i++) {
+        from[i] = (Vector2){(float)(rand() % (cols * BLOCK_SIZE)), (float)(rand() % (rows * BLOCK_SIZE))};
+        to[i] = (Vector2){from[i].x + (rand() % (64 * BLOCK_SIZE)) - 32 * BLOCK_SIZE, (float)(rand() % (rows * BLOCK_SIZE))};
+        if (i % 2 == 0) to[i].y = from[i].y;   // Metade na horizontal, o caso do inimigo na mesma altura
+    }
+
+    int visible = 0;
+    double start = BenchmarkNow();
+    for (long i = 0; i < calls; i++) {
+        visible += HasLineOfSight(&world.map, from[i & 1023], to[i & 1023], BLOCK_SIZE);
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "HasLineOfSight", rows, cols, 0, 0, 0, calls, elapsed);
+    if (visible < 0) printf("%d\n", visible);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Movimento dos projeteis; o pool e recarregado (fora da medida) a cada 8 ticks para manter a quantidade
+void BenchmarkMoveProjectiles(BenchmarkReport *report, int rows, int cols, int projectileCount, int batches) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, 0, 0)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    world.player.position = (Vector2){cols * BLOCK_SIZE / 2.0f, rows * BLOCK_SIZE / 2.0f};
+
+    long ticks = 0;
+    double elapsed = 0;
+    for (int b = 0; b < batches; b++) {
+        FillBenchmarkProjectiles(&world, projectileCount, SCREEN_WIDTH);
+
+        double start = BenchmarkNow();
+        for (int t = 0; t < 8; t++) {
+            MoveProjectiles(&world.projectiles, SIMULATION_DT, &world.player, SCREEN_WIDTH, &world.map, BLOCK_SIZE, NULL);
+        }
+        elapsed += BenchmarkNow() - start;
+        ticks += 8;
+    }
+
+    RecordBenchmark(report, "MoveProjectiles", rows, cols, 0, 0, projectileCount, ticks, elapsed);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Teste projetil x inimigo pelo hash espacial; inimigos e projeteis sao restaurados (fora da medida) a cada chamada
+void BenchmarkProjectileEnemyCollision(BenchmarkReport *report, int rows, int cols, int enemyCount, int projectileCount, int calls) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, 0)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    world.player.position = (Vector2){cols * BLOCK_SIZE / 2.0f, rows * BLOCK_SIZE / 2.0f};
+
+    double elapsed = 0;
+    for (int c = 0; c < calls; c++) {
+        InitializeEnemies(&world.map, &world.enemies, BLOCK_SIZE, world.settings.enemySpeedX, world.settings.enemyOffset);
+        FillBenchmarkProjectiles(&world, projectileCount, cols * BLOCK_SIZE / 2.0f);
+        BuildEntitySpatialHash(&world.hash, &world.enemies, world.coins, 0, &world.projectiles, NULL);
+
+        double start = BenchmarkNow();
+        CheckProjectileEnemyCollision(&world.projectiles, &world.enemies, &world.player, &world.hash, NULL);
+        elapsed += BenchmarkNow() - start;
+    }
+
+    RecordBenchmark(report, "CheckProjectileEnemyCollision", rows, cols, world.enemies.count, 0, projectileCount, calls, elapsed);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Tick completo com entrada fixa: corre para a direita, pula a cada meio segundo e atira a cada 10 ticks
+void BenchmarkSimulateTick(BenchmarkReport *report, int rows, int cols, int enemyCount, int coinCount, long ticks) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, coinCount)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    PlayerInput input = {0};
+    unsigned currentFrame = 0;
+    int coinCount0 = world.coinCount;
+    int enemyCount0 = world.enemies.count;
+
+    double start = BenchmarkNow();
+    for (long t = 0; t < ticks; t++) {
+        input.right = true;
+        input.jump = (t % 60) == 0;
+        input.shootHorizontal = (t % 10) == 0;
+        SimulateTick(&world.player, &input, &currentFrame, &world.settings, &world.map,
+                     world.coins, &world.coinCount, &world.enemies, &world.projectiles, &world.hash, NULL, NULL);
+
+        if (isPlayerDead(&world.player)) {
+            RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+        }
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "SimulateTick", rows, cols, enemyCount0, coinCount0, 0, ticks, elapsed);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Tick completo (mesma entrada do BenchmarkSimulateTick) com as fases divididas entre 1, 2, 4... threads de
+// jobs, ate uma por nucleo. Toda rodada comeca do mesmo mundo e tem que terminar igual a rodada com uma thread
+void BenchmarkParallelTick(BenchmarkReport *report, int rows, int cols, int enemyCount, int coinCount, long ticks) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, coinCount)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    int enemyCount0 = world.enemies.count;
+    int coinCount0 = world.coinCount;
+    int cores = GetProcessorCount();
+    unsigned singleThreadHash = 0;
+    for (int threads = 1; threads <= cores && threads <= MAX_JOB_THREADS; threads *= 2) {
+        RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+        JobSystem jobs;
+        InitializeJobSystem(&jobs, threads);
+        PlayerInput input = {0};
+        unsigned currentFrame = 0;
+
+        double start = BenchmarkNow();
+        for (long t = 0; t < ticks; t++) {
+            input.right = true;
+            input.jump = (t % 60) == 0;
+            input.shootHorizontal = (t % 10) == 0;
+            SimulateTick(&world.player, &input, &currentFrame, &world.settings, &world.map,
+                         world.coins, &world.coinCount, &world.enemies, &world.projectiles, &world.hash, NULL, &jobs);
+
+            if (isPlayerDead(&world.player)) {
+                RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+            }
+        }
+        double elapsed = BenchmarkNow() - start;
+        UnloadJobSystem(&jobs);
+
+        unsigned hash = HashWorldState(&world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+        if (threads == 1) {
+            singleThreadHash = hash;
+        } else if (hash != singleThreadHash) {
+            printf("Erro: com %d threads o mundo terminou diferente de com uma!\n", threads);
+            report->failures++;
+        }
+
+        char name[48];
+        snprintf(name, sizeof(name), "SimulateTick %d threads", threads);
+        RecordBenchmark(report, name, rows, cols, enemyCount0, coinCount0, 0, ticks, elapsed);
+    }
+    UnloadBenchmarkWorld(&world);
+}
+
+// Recomeco da fase pelo snapshot e quicksave/quickload pela thread de arquivos, com o mundo cheio de projeteis
+void BenchmarkWorldSnapshot(BenchmarkReport *report, int rows, int cols, int enemyCount, int coinCount, int projectileCount, int ops) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, coinCount)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    FillBenchmarkProjectiles(&world, projectileCount, SCREEN_WIDTH);
+    CaptureWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+
+    double start = BenchmarkNow();
+    for (int i = 0; i < ops; i++) {
+        RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+    }
+    double elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "RestoreWorldSnapshot", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, ops, elapsed);
+
+    // Quicksave: no frame so a copia para a memoria e o pedido; disco e leitura de volta ficam com a thread.
+    // No maximo uma fila cheia de gravacoes, para medir o pedido e nao a espera pelo disco
+    IoQueue io;
+    InitializeIoQueue(&io, true);
+    int writes = (ops < IO_QUEUE_CAPACITY) ? ops : IO_QUEUE_CAPACITY;
+    start = BenchmarkNow();
+    for (int i = 0; i < writes; i++) {
+        size_t size;
+        char *data = EncodeQuicksave(&world.levelStart, &world.map, &size);
+        if (data) QueueFileWrite(&io, BENCHMARK_QUICKSAVE_FILE, data, size);
+    }
+    elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "QueueQuicksave", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, writes, elapsed);
+
+    start = BenchmarkNow();
+    WaitIoIdle(&io);
+    elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "QuicksaveIoDrain", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, writes, elapsed);
+
+    QueueFileRead(&io, BENCHMARK_QUICKSAVE_FILE, IO_TAG_QUICKLOAD);
+    WaitIoIdle(&io);
+    IoRequest done;
+    if (!PollIoCompletion(&io, &done) || !done.ok) {
+        printf("Erro: quicksave %s nao lido de volta\n", BENCHMARK_QUICKSAVE_FILE);
+        report->failures++;
+    } else {
+        start = BenchmarkNow();
+        for (int i = 0; i < ops; i++) {
+            DecodeQuicksave(&world.levelStart, &world.map, done.data, done.size, done.filename);
+            RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+        }
+        elapsed = BenchmarkNow() - start;
+        RecordBenchmark(report, "DecodeQuicksave", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, ops, elapsed);
+        FinishIoRequest(&done, NULL);
+    }
+    UnloadIoQueue(&io);
+
+    remove(BENCHMARK_QUICKSAVE_FILE);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Gravacao do historico de rewind a cada tick e volta de OBSTACLE_REWIND_SECONDS segundos. Inimigos patrulham e
+// os projeteis andam em linha reta (sem colisao), para o XOR com o tick anterior ter o tamanho de um jogo real
+void BenchmarkRewind(BenchmarkReport *report, int rows, int cols, int enemyCount, int coinCount, int projectileCount, long ticks) {
+    BenchmarkWorld world;
+    RewindBuffer rewind;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, coinCount)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    if (!InitializeRewindBuffer(&rewind, MAX_ENEMIES, world.coinCount, MAX_PROJECTILES)) {
+        UnloadRewindBuffer(&rewind);
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    FillBenchmarkProjectiles(&world, projectileCount, SCREEN_WIDTH);
+
+    double elapsed = 0;
+    for (long t = 0; t < ticks; t++) {
+        world.player.position.x += world.settings.playerSpeed * SIMULATION_DT;
+        MoveEnemies(&world.enemies, SIMULATION_DT, NULL);
+        for (int i = 0; i < world.projectiles.count; i++) {
+            world.projectiles.x[i] += world.projectiles.speedX[i] * SIMULATION_DT;
+            world.projectiles.y[i] += world.projectiles.speedY[i] * SIMULATION_DT;
+        }
+
+        double start = BenchmarkNow();
+        RecordRewindFrame(&rewind, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+        elapsed += BenchmarkNow() - start;
+    }
+    RecordBenchmark(report, "RecordRewindFrame", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, ticks, elapsed);
+    printf("  rewind: media de %.0f bytes por tick, %.1f s no historico, %zu KB\n",
+           (double)rewind.recordedBytes / rewind.recordedTicks, GetRewindSeconds(&rewind), GetRewindMemoryUsage(&rewind) / 1024);
+
+    // Cada volta consome o historico, entao ele e regravado (fora do tempo medido) antes da proxima
+    int rewinds = 0;
+    elapsed = 0;
+    for (long t = 0; t < ticks; t++) {
+        MoveEnemies(&world.enemies, SIMULATION_DT, NULL);
+        RecordRewindFrame(&rewind, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+        if (rewind.count == REWIND_TICKS) {
+            double start = BenchmarkNow();
+            RewindWorld(&rewind, OBSTACLE_REWIND_SECONDS * SIMULATION_HZ, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+            elapsed += BenchmarkNow() - start;
+            rewinds++;
+        }
+    }
+    RecordBenchmark(report, "RewindWorld", rows, cols, world.enemies.count, world.coinCount, world.projectiles.count, rewinds, elapsed);
+
+    UnloadRewindBuffer(&rewind);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Grava uma sessao com a entrada do BenchmarkSimulateTick, passa pelo arquivo e reproduz do comeco da fase,
+// conferindo o hash do mundo. O tempo medido e o da reproducao: ticks mais o hash de cada um
+void BenchmarkReplay(BenchmarkReport *report, int rows, int cols, int enemyCount, int coinCount, long ticks) {
+    BenchmarkWorld world;
+    if (!CreateBenchmarkWorld(&world, rows, cols, enemyCount, coinCount)) {
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+
+    InputReplay replay;
+    InitializeReplay(&replay);
+    BeginReplayRecording(&replay, 0);
+    PlayerInput input = {0};
+    unsigned currentFrame = 0;
+    for (long t = 0; t < ticks; t++) {
+        input.right = true;
+        input.jump = (t % 60) == 0;
+        input.shootHorizontal = (t % 10) == 0;
+        unsigned char buttons = PackPlayerInput(&input);
+        SimulateTick(&world.player, &input, &currentFrame, &world.settings, &world.map,
+                     world.coins, &world.coinCount, &world.enemies, &world.projectiles, &world.hash, NULL, NULL);
+        AdvanceReplay(&replay, buttons, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+        if (isPlayerDead(&world.player)) {
+            RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+        }
+    }
+
+    if (!SaveReplay(&replay, &world.map, BENCHMARK_REPLAY_FILE) || !LoadReplay(&replay, &world.map, BENCHMARK_REPLAY_FILE)) {
+        UnloadReplay(&replay);
+        UnloadBenchmarkWorld(&world);
+        return;
+    }
+    RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+
+    double start = BenchmarkNow();
+    while (NextReplayInput(&replay, &input)) {
+        unsigned char buttons = PackPlayerInput(&input);
+        SimulateTick(&world.player, &input, &currentFrame, &world.settings, &world.map,
+                     world.coins, &world.coinCount, &world.enemies, &world.projectiles, &world.hash, NULL, NULL);
+        AdvanceReplay(&replay, buttons, &world.player, &world.enemies, world.coins, world.coinCount, &world.projectiles);
+        if (isPlayerDead(&world.player)) {
+            RestoreWorldSnapshot(&world.levelStart, &world.player, &world.enemies, world.coins, &world.coinCount, &world.projectiles);
+        }
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    RecordBenchmark(report, "ReplayTick", rows, cols, enemyCount, world.coinCount, 0, replay.current, elapsed);
+    PrintReplayResult(&replay);
+    if (replay.divergedTick >= 0 || replay.current != replay.tickCount) report->failures++;
+
+    remove(BENCHMARK_REPLAY_FILE);
+    UnloadReplay(&replay);
+    UnloadBenchmarkWorld(&world);
+}
+
+// Layout antigo dos inimigos (array de structs), mantido so como referencia de comparacao
+typedef struct {
+    Vector2 position;
+    Vector2 velocity;
+    Rectangle rect;
+    Vector2 minPosition;
+    Vector2 maxPosition;
+    int health;
+    bool active;
+} LegacyEnemy;
+
+// MoveEnemies como era antes do EnemyStore: percorre todos, inclusive os inativos
+void MoveLegacyEnemies(LegacyEnemy* enemies, int enemyCount, float dt) {
+    for (int i = 0; i < enemyCount; i++) {
+        if (enemies[i].position.x <= enemies[i].minPosition.x || enemies[i].position.x >= enemies[i].maxPosition.x) {
+            enemies[i].velocity.x = -enemies[i].velocity.x;
+        }
+        enemies[i].position.x += enemies[i].velocity.x * dt;
+        enemies[i].rect.x = enemies[i].position.x;
+        enemies[i].rect.y = enemies[i].position.y;
+    }
+}
+
+// Compara o movimento de enemyCount inimigos patrulhando nos dois layouts; deadFraction deles estao mortos
+void BenchmarkEnemyPatrol(BenchmarkReport *report, int enemyCount, float deadFraction, int ticks) {
+    float dt = SIMULATION_DT;
+    LegacyEnemy *legacy = malloc(enemyCount * sizeof(LegacyEnemy));
+    EnemyStore store;
+    if (!legacy || !InitializeEnemyStore(&store, enemyCount, BLOCK_SIZE, BLOCK_SIZE)) {
+        free(legacy);
+        return;
+    }
+
+    srand(42);
+    for (int i = 0; i < enemyCount; i++) {
+        float minX = (float)(rand() % (1000 * BLOCK_SIZE));  // Espalhados por uma fase de 1000 colunas
+        float x = minX + (float)(rand() % 200);
+        float speed = (rand() % 2) ? 150.0f : -150.0f;
+        bool alive = (float)rand() / RAND_MAX >= deadFraction;
+
+        legacy[i] = (LegacyEnemy){{x, 0}, {speed, 0}, {x, 0, BLOCK_SIZE, BLOCK_SIZE}, {minX, 0}, {minX + 200, 0}, alive ? 1 : 0, alive};
+
+        int slot = AddEnemy(&store, minX, 0, speed, 200);
+        store.x[slot] = x;
+        store.health[slot] = alive ? 1 : 0;
+    }
+    RemoveDeadEnemies(&store);
+
+    double start = BenchmarkNow();
+    for (int t = 0; t < ticks; t++) MoveLegacyEnemies(legacy, enemyCount, dt);
+    double legacyTime = BenchmarkNow() - start;
+
+    start = BenchmarkNow();
+    for (int t = 0; t < ticks; t++) MoveEnemies(&store, dt, NULL);
+    double storeTime = BenchmarkNow() - start;
+
+    // Soma as posicoes para o compilador nao descartar o trabalho
+    double checksum = 0;
+    for (int i = 0; i < enemyCount; i++) checksum += legacy[i].position.x;
+    for (int i = 0; i < store.activeCount; i++) checksum += store.x[i];
+    if (checksum < 0) printf("%g\n", checksum);
+
+    char name[48];
+    snprintf(name, sizeof(name), "MoveEnemies AoS %.0f%% mortos", deadFraction * 100);
+    RecordBenchmark(report, name, 0, 0, enemyCount, 0, 0, ticks, legacyTime);
+    snprintf(name, sizeof(name), "MoveEnemies SoA %.0f%% mortos", deadFraction * 100);
+    RecordBenchmark(report, name, 0, 0, enemyCount, 0, 0, ticks, storeTime);
+
+    free(legacy);
+    UnloadEnemyStore(&store);
+}
+
+// Placar com entries pontuacoes registradas uma a uma (log e compactacoes incluidos), posicao de pontuacoes
+// sorteadas, top 10 e leitura do placar do disco
+void BenchmarkLeaderboard(BenchmarkReport *report, int entries, int queries) {
+    remove(BENCHMARK_LEADERBOARD_FILE);
+    remove(BENCHMARK_LEADERBOARD_LOG);
+
+    // Como no jogo: leitura e gravacoes pela thread de arquivos
+    IoQueue io;
+    InitializeIoQueue(&io, true);
+    Leaderboard leaderboard;
+    IoRequest done;
+    if (!QueueLeaderboardLoad(&io, &leaderboard, BENCHMARK_LEADERBOARD_FILE, BENCHMARK_LEADERBOARD_LOG)) {
+        UnloadIoQueue(&io);
+        return;
+    }
+    WaitIoIdle(&io);
+    while (PollIoCompletion(&io, &done)) {
+        FinishIoRequest(&done, &leaderboard);
+    }
+    if (!leaderboard.loaded) {
+        UnloadIoQueue(&io);
+        return;
+    }
+
+    srand(99);
+    char nome[MAX_NOME];
+    double start = BenchmarkNow();
+    for (int i = 0; i < entries; i++) {
+        snprintf(nome, sizeof(nome), "Jogador%d", i);
+        SubmitLeaderboardScore(&leaderboard, &io, nome, rand() % 100000);
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    char name[48];
+    snprintf(name, sizeof(name), "SubmitLeaderboardScore %dk", entries / 1000);
+    RecordBenchmark(report, name, 0, 0, 0, 0, 0, entries, elapsed);
+
+    // O que a thread ainda tinha para gravar quando a ultima pontuacao foi registrada
+    start = BenchmarkNow();
+    WaitIoIdle(&io);
+    elapsed = BenchmarkNow() - start;
+    snprintf(name, sizeof(name), "LeaderboardIoDrain %dk", entries / 1000);
+    RecordBenchmark(report, name, 0, 0, 0, 0, 0, entries, elapsed);
+    UnloadIoQueue(&io);
+
+    long checksum = 0;
+    start = BenchmarkNow();
+    for (int i = 0; i < queries; i++) {
+        checksum += GetLeaderboardRank(&leaderboard, rand() % leaderboard.count);
+    }
+    elapsed = BenchmarkNow() - start;
+    snprintf(name, sizeof(name), "GetLeaderboardRank %dk", entries / 1000);
+    RecordBenchmark(report, name, 0, 0, 0, 0, 0, queries, elapsed);
+
+    JogadorLeader top[10];
+    start = BenchmarkNow();
+    for (int i = 0; i < queries; i++) {
+        checksum += GetLeaderboardTop(&leaderboard, top, 10) + top[i % 10].points;
+    }
+    elapsed = BenchmarkNow() - start;
+    snprintf(name, sizeof(name), "GetLeaderboardTop 10 de %dk", entries / 1000);
+    RecordBenchmark(report, name, 0, 0, 0, 0, 0, queries, elapsed);
+
+    int count = leaderboard.count;
+    UnloadLeaderboard(&leaderboard);
+
+    start = BenchmarkNow();
+    bool loaded = LoadLeaderboard(&leaderboard, BENCHMARK_LEADERBOARD_FILE, BENCHMARK_LEADERBOARD_LOG);
+    elapsed = BenchmarkNow() - start;
+    if (loaded && leaderboard.count == count) {
+        snprintf(name, sizeof(name), "LoadLeaderboard %dk", entries / 1000);
+        RecordBenchmark(report, name, 0, 0, 0, 0, 0, 1, elapsed);
+    } else {
+        printf("Erro: placar lido com %d de %d pontuacoes\n", leaderboard.count, count);
+        report->failures++;
+    }
+    if (checksum < 0) printf("%ld\n", checksum);
+
+    UnloadLeaderboard(&leaderboard);
+    remove(BENCHMARK_LEADERBOARD_FILE);
+    remove(BENCHMARK_LEADERBOARD_LOG);
+}
 
-    OrdenaPlayers(Players);
+#ifndef HEADLESS
+// Desenho do terreno pre-desenhado com a camera percorrendo a fase, um frame por op. Precisa de janela (escondida)
+void BenchmarkRenderMap(BenchmarkReport *report, int rows, int cols, int frames) {
+    TileMap map;
+    if (!WriteBenchmarkMap(BENCHMARK_MAP_FILE, rows, cols, 0, 0) || !LoadMap(BENCHMARK_MAP_FILE, &map)) return;
 
-    arq = fopen("top_scores.bin", "wb");
-    if (!arq) {
-        printf("Erro na criao do arquivo top_scores.bin!\n");
+    // Sprites gerados: o benchmark nao depende dos arquivos de imagem do jogo
+    Image sprites[SPRITE_COUNT];
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        sprites[i] = GenImageColor(4, 4, WHITE);
+    }
+    TextureAtlas atlas;
+    SpriteBatch batch;
+    bool loaded = LoadTextureAtlas(&atlas, sprites) && InitializeSpriteBatch(&batch, &atlas);
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        UnloadImage(sprites[i]);
+    }
+    if (!loaded) {
+        UnloadMap(&map);
+        remove(BENCHMARK_MAP_FILE);
         return;
     }
-    fwrite(Players, sizeof(JogadorLeader), 5, arq);
-    fclose(arq);
-}
-
-// Insere o nome do jogador  (exemplo simples de entrada)
-void InsertName(char strnome[50]) {
-    char nome[MAX_NOME] = {'\0'};
-    char caractere;
-    int contaChars = 0;
 
-    while (!IsKeyPressed(KEY_ENTER)) {
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
-        DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
-        DrawText("PARABENS! VOCE GANHOU", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT - 30) / 2, 60, GREEN);
-        DrawText("Aperte enter para voltar ao menu", (SCREEN_WIDTH - MeasureText("PARABENS! VOCE GANHOU", 60)) / 2, (SCREEN_HEIGHT + 60) / 2, 40, WHITE);
-        // Recebe o nome do jogador
-        caractere = GetCharPressed();
+    TerrainCache terrain;
+    InitializeTerrainCache(&terrain, rows, cols);
 
-        if (caractere != '\0' && contaChars < 23) {
-            nome[contaChars] = caractere;
-            contaChars++;
-        }
+    Player player = InitializePlayer();
+    FindPlayerSpawnPoint(&map, &player);
+    Camera2D camera = InitializeCamera(&player);
 
-        if (IsKeyPressed(KEY_BACKSPACE)) {
-            nome[contaChars - 1] = '\0';
-            if (contaChars > 0)
-                contaChars--;
-        }
+    double elapsed = 0;
+    for (int f = 0; f < frames; f++) {
+        camera.target.x = fmodf(f * 37.0f, cols * BLOCK_SIZE);
+        Rectangle view = GetCameraViewRect(camera);
 
-        DrawText(TextFormat("Nome: %s", nome), 45, 45, 40, RAYWHITE);
+        double start = BenchmarkNow();
+        BeginDrawing();
+        UpdateTerrainCache(&terrain, view, &map, BLOCK_SIZE, &batch);
+        ClearBackground(RAYWHITE);
+        BeginMode2D(camera);
+        RenderMap(&terrain, BLOCK_SIZE, view);
+        EndMode2D();
         EndDrawing();
+        elapsed += BenchmarkNow() - start;
     }
- strcpy(strnome,nome);
-}
 
-// Desenha uma tela com os top 5 jogadores (exibe a leaderboard)
-void DesenhaTop5(int *guarda) {
-    FILE *arq;
-    JogadorLeader Players[5];
-    int i, j = 0;
-    arq = fopen("top_scores.bin", "rb");
-    if (!arq) {
-        printf("Erro na abertura do arquivo!\n");
-        return;
-    }
+    RecordBenchmark(report, "RenderMap", rows, cols, 0, 0, 0, frames, elapsed);
 
-    int bytesRead = fread(Players, sizeof(JogadorLeader), 5, arq);
-    fclose(arq);
+    UnloadTerrainCache(&terrain);
+    UnloadSpriteBatch(&batch);
+    UnloadTextureAtlas(&atlas);
+    UnloadMap(&map);
+    remove(BENCHMARK_MAP_FILE);
+}
 
-    if (bytesRead != 5) {
-        printf("Erro ao ler dados do arquivo ou o arquivo est incompleto.\n");
-        return;
+// Carregamento de count PNGs gerados de size x size: LoadTexture direto (decodificacao e envio na thread
+// principal) contra o AssetManager, em que a thread principal so pede e envia. Depois, pedidos repetidos do
+// mesmo arquivo, atendidos pelo cache
+void BenchmarkAssetLoad(BenchmarkReport *report, int size, int lookups) {
+    char files[BENCHMARK_ASSET_COUNT][32];
+    for (int i = 0; i < BENCHMARK_ASSET_COUNT; i++) {
+        snprintf(files[i], sizeof(files[i]), "benchmark_asset%d.png", i);
+        Image image = GenImageColor(size, size, (Color){i * 30, 255 - i * 30, 128, 255});
+        bool exported = ExportImage(image, files[i]);
+        UnloadImage(image);
+        if (!exported) return;
     }
 
-    Rectangle exitButton = {SCREEN_WIDTH - 150, 20, 130, 90}; // Exit button rectangle
-
-    BeginDrawing();
-    ClearBackground(RAYWHITE);
-    DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
-    DrawText("Leaderboard", (SCREEN_WIDTH / 2 - MeasureText("Leaderboard", 50) / 2), 20, 50, WHITE);
+    Texture2D textures[BENCHMARK_ASSET_COUNT];
+    double start = BenchmarkNow();
+    for (int i = 0; i < BENCHMARK_ASSET_COUNT; i++) {
+        textures[i] = LoadTexture(files[i]);
+    }
+    double elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "LoadTexture", size, size, 0, 0, 0, BENCHMARK_ASSET_COUNT, elapsed);
+    for (int i = 0; i < BENCHMARK_ASSET_COUNT; i++) {
+        UnloadTexture(textures[i]);
+    }
 
-    for (i = 0; i < 5; i++) {
-        DrawText(TextFormat("Nome: %s", Players[i].nome), 15, 100 + j, 30, WHITE);
-        DrawText(TextFormat("Pontuacao: %d \n", Players[i].points), 400, 100 + j, 30, WHITE);
-        j += 40;
+    AssetManager assets;
+    InitializeAssetManager(&assets);
+    int ids[BENCHMARK_ASSET_COUNT];
+    start = BenchmarkNow();
+    for (int i = 0; i < BENCHMARK_ASSET_COUNT; i++) {
+        ids[i] = AcquireAsset(&assets, files[i], ASSET_TEXTURE);
+    }
+    elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "AcquireAsset pedido", size, size, 0, 0, 0, BENCHMARK_ASSET_COUNT, elapsed);
+
+    start = BenchmarkNow();
+    bool ready = WaitForAssets(&assets);
+    elapsed = BenchmarkNow() - start;
+    if (ready) {
+        RecordBenchmark(report, "WaitForAssets", size, size, 0, 0, 0, BENCHMARK_ASSET_COUNT, elapsed);
+        RecordBenchmark(report, "Asset decodificacao (thread)", size, size, 0, 0, 0, BENCHMARK_ASSET_COUNT, assets.decodeSeconds);
+        RecordBenchmark(report, "Asset envio (principal)", size, size, 0, 0, 0, BENCHMARK_ASSET_COUNT, assets.uploadSeconds);
     }
 
-    // Draw the exit button
-    DrawRectangleRec(exitButton, RED);
-    DrawText("Aperte \nenter \npara sair", exitButton.x + 20, exitButton.y + 10, 20, WHITE);
+    start = BenchmarkNow();
+    for (int i = 0; i < lookups; i++) {
+        int id = AcquireAsset(&assets, files[i % BENCHMARK_ASSET_COUNT], ASSET_TEXTURE);
+        ReleaseAsset(&assets, id);
+    }
+    elapsed = BenchmarkNow() - start;
+    RecordBenchmark(report, "AcquireAsset cache", size, size, 0, 0, 0, lookups, elapsed);
 
-    EndDrawing();
+    for (int i = 0; i < BENCHMARK_ASSET_COUNT; i++) {
+        ReleaseAsset(&assets, ids[i]);
+        remove(files[i]);
+    }
+    if (GetAssetMemoryUsage(&assets) != 0) {
+        printf("Erro: assets ainda na memoria depois de devolvidos\n");
+        report->failures++;
+    }
+    UnloadAssetManager(&assets);
 }
+#endif
+
+int main(int argc, char *argv[]) {
+    const char *outputFile = "benchmark.csv";
+    const char *baselineFile = NULL;
+    double tolerance = 10.0;    // Porcentagem de piora aceita em relacao a referencia
+
+    for (int i = 1; i < argc; i += 2) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "-o") == 0) outputFile = value;
+        else if (value && strcmp(argv[i], "-b") == 0) baselineFile = value;
+        else if (value && strcmp(argv[i], "-r") == 0) tolerance = atof(value);
+        else {
+            printf("Uso: %s [-o resultado.csv] [-b referencia.csv] [-r tolerancia_%%]\n", argv[0]);
+            return 1;
+        }
+    }
 
-// Atualiza o leaderboard com o novo jogador e sua pontuao
-void AtualizaTop5(JogadorLeader player1) {
-    FILE *arq;
-    JogadorLeader Players[5];
-    int i, j = 0;
+    // Mapas pequeno, medio e grande
+    int sizes[3][2] = {{20, 250}, {50, 500}, {100, 1000}};
+    BenchmarkReport report;
+    report.count = 0;
+    report.failures = 0;
 
-    arq = fopen("top_scores.bin", "rb+");
-    if (!arq) {
-        printf("Erro na abertura do arquivo!\n");
-        return;
+    for (int s = 0; s < 3; s++) {
+        BenchmarkLoadMap(&report, sizes[s][0], sizes[s][1], 200);
     }
+    BenchmarkLoadMap(&report, 18, 1000000, 5);
+    BenchmarkLoadCompiledMap(&report, sizes[2][0], sizes[2][1], 200);
+    BenchmarkLoadCompiledMap(&report, 18, 1000000, 200);
+    BenchmarkMapStreaming(&report, 18, 1000000);
+    for (int s = 0; s < 3; s++) {
+        BenchmarkPlayerBlockCollisions(&report, sizes[s][0], sizes[s][1], 2000000);
+    }
+    BenchmarkLineOfSight(&report, sizes[2][0], sizes[2][1], 2000000);
 
-    fread(Players, sizeof(JogadorLeader), 5, arq);
-    OrdenaPlayers(Players);
-    Players[4] = player1;
-    OrdenaPlayers(Players);
-    fwrite(Players, sizeof(JogadorLeader), 5, arq);
-    fclose(arq);
-}
-
-// Verifica a coliso com o porto e registra a pontuao do jogador
-void HandleGateCollision(Player *player, Rectangle block) {
-    char nomejogador[MAX_NOME];
-    Vector2 correction = {0, 0};
-    FILE *arq;
-    JogadorLeader Players[5];
+    int projectileCounts[3] = {10, 100, MAX_PROJECTILES};
+    for (int p = 0; p < 3; p++) {
+        BenchmarkMoveProjectiles(&report, sizes[2][0], sizes[2][1], projectileCounts[p], 2000);
+    }
 
-    if (CheckCollisionWithBlock(player->rect, block, &correction)) {
-        // Verifica se o arquivo existe
-        arq = fopen("top_scores.bin", "rb");
-        if (!arq) {
-            printf("Arquivo no encontrado. Criando top_scores.bin...\n");
-            CriaTop5Jogadores();
-            arq = fopen("top_scores.bin", "rb"); // Reabre aps criao
+    int enemyCounts[2] = {100, MAX_ENEMIES};
+    for (int e = 0; e < 2; e++) {
+        for (int p = 1; p < 3; p++) {
+            BenchmarkProjectileEnemyCollision(&report, sizes[2][0], sizes[2][1], enemyCounts[e], projectileCounts[p], 2000);
         }
+    }
 
-        // L os jogadores do arquivo
-        fread(Players, sizeof(JogadorLeader), 5, arq);
-        fclose(arq);
+    BenchmarkSimulateTick(&report, 20, 250, 20, 100, 20000);
+    BenchmarkSimulateTick(&report, 50, 500, 100, 500, 20000);
+    BenchmarkSimulateTick(&report, sizes[2][0], sizes[2][1], MAX_ENEMIES, 1000, 20000);
+    BenchmarkParallelTick(&report, sizes[2][0], sizes[2][1], 50000, 1000, 2000);
 
-        // Insere o nome do jogador atual
-        InsertName(nomejogador);
+    BenchmarkWorldSnapshot(&report, sizes[2][0], sizes[2][1], MAX_ENEMIES, 1000, MAX_PROJECTILES, 2000);
+    BenchmarkRewind(&report, sizes[2][0], sizes[2][1], 100, 500, 100, 20000);
+    BenchmarkRewind(&report, sizes[2][0], sizes[2][1], MAX_ENEMIES, 1000, MAX_PROJECTILES, 20000);
 
-        JogadorLeader jogadorAtual;
-        strcpy(jogadorAtual.nome, nomejogador);
-        jogadorAtual.points = player->points;
+    BenchmarkReplay(&report, 20, 250, 20, 100, 20000);
+    BenchmarkReplay(&report, sizes[2][0], sizes[2][1], MAX_ENEMIES, 1000, 20000);
 
-        // Adiciona o novo jogador no final do array
-        Players[4] = jogadorAtual;
+    BenchmarkEnemyPatrol(&report, 1000, 0.0f, 20000);
+    BenchmarkEnemyPatrol(&report, 100000, 0.0f, 500);
+    BenchmarkEnemyPatrol(&report, 100000, 0.5f, 500);
 
-        // Ordena os jogadores
-        OrdenaPlayers(Players);
+    BenchmarkLeaderboard(&report, 10000, 100000);
+    BenchmarkLeaderboard(&report, 1000000, 1000000);
 
-        // Reabre o arquivo para sobrescrever os dados
-        arq = fopen("top_scores.bin", "wb");
-        if (!arq) {
-            printf("Erro ao abrir top_scores.bin para escrita!\n");
-            return;
+#ifndef HEADLESS
+    // Desenho precisa de contexto grafico; sem ele (servidor sem video) o RenderMap fica de fora
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "INF-MAN benchmark");
+    if (IsWindowReady()) {
+        for (int s = 0; s < 3; s++) {
+            BenchmarkRenderMap(&report, sizes[s][0], sizes[s][1], 300);
         }
-
-        fwrite(Players, sizeof(JogadorLeader), 5, arq);
-        fclose(arq);
-
-        // Exibe mensagem e finaliza o jogo
-        printf("Parabns, %s! Sua pontuao de %d foi registrada.\n", nomejogador, jogadorAtual.points);
-        player->health = -1;
+        BenchmarkAssetLoad(&report, 1024, 100000);
+        CloseWindow();
+    } else {
+        printf("Sem janela: RenderMap e os assets nao foram medidos\n");
     }
-}
+#endif
 
-// Percorre o array de caracteres (mapa), cria um retangulo e usa CheckCollisionWithBlock() para determinar se o jogador est colidindo com algum bloco.
-void HandlePlayerBlockCollisions(Player *player, char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, float blockSize) {
-    player->isGrounded = false;
+    if (!WriteBenchmarkReport(&report, outputFile)) {
+        return 1;
+    }
+    printf("Resultados gravados em %s\n", outputFile);
 
-    for (int y = 0; y < rows; y++) {
-        for (int x = 0; x < cols; x++) {
-            Rectangle block = {x * blockSize, y * blockSize, blockSize, blockSize};
+    if (report.failures > 0) {
+        printf("%d verificacao(oes) falharam durante o benchmark\n", report.failures);
+        return 1;
+    }
 
-            if (map[y][x] == 'B') {
-                HandleBlockCollision(player, block);
-            }
-            else if (map[y][x] == 'O') {
-                HandleObstacleCollision(player, block);
-            }
-            else if (map[y][x] == 'G') {
-                HandleGateCollision(player, block);
-            }
+    if (baselineFile) {
+        int regressions = CompareBenchmarkBaseline(&report, baselineFile, tolerance);
+        if (regressions < 0) {
+            return 1;
         }
+        if (regressions > 0) {
+            printf("%d benchmark(s) mais lentos que %s (tolerancia %.0f%%)\n", regressions, baselineFile, tolerance);
+            return 1;
+        }
+        printf("Nenhuma regressao em relacao a %s\n", baselineFile);
     }
+    return 0;
 }
+#elif defined(MAP_COMPILER)
+// Compilador de mapas (alvo MapCompiler do test.cbp, compilado com -DMAP_COMPILER). O map.txt continua sendo
+// o formato de edicao; o map.bin gerado aqui e aberto pelo jogo sem ler nem procurar nada celula por celula
+int main(int argc, char *argv[]) {
+    const char *inputFile = "map.txt";
+    const char *outputFile = "map.bin";
+
+    for (int i = 1; i < argc; i += 2) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "-i") == 0) inputFile = value;
+        else if (value && strcmp(argv[i], "-o") == 0) outputFile = value;
+        else {
+            printf("Uso: %s [-i mapa.txt] [-o mapa.bin]\n", argv[0]);
+            return 1;
+        }
+    }
 
-// Chama todas as funes de coliso 1 vez s
-void HandleCollisions(Player* player, Enemy* enemies, int enemyCount, Projectile projectiles[MAX_PROJECTILES], char map[MAX_HEIGHT][MAX_WIDTH], int rows, int cols, float blockSize, unsigned currentFrame, float dt, Coin coins[MAX_WIDTH], int *coinCount) {
-    HandlePlayerBlockCollisions(player, map, rows, cols, blockSize);
-    HandlePlayerEnemyCollision(player, enemies, enemyCount, &currentFrame, dt);
-    CheckProjectileEnemyCollision(projectiles, &enemyCount, enemies, player);
-    CheckPlayerCoinCollision(player, coins, coinCount);
+    TileMap map;
+    if (!LoadMap(inputFile, &map)) {
+        return 1;
+    }
+    if (map.mapping) {
+        printf("%s ja esta compilado\n", inputFile);
+        UnloadMap(&map);
+        return 1;
+    }
+
+    bool ok = CompileMap(&map, outputFile);
+    if (ok) {
+        printf("%s -> %s: %dx%d, %d inimigos, %d moedas\n", inputFile, outputFile, map.cols, map.rows, map.enemyCount, map.coinCount);
+    }
+    UnloadMap(&map);
+    return ok ? 0 : 1;
 }
+#elif defined(HEADLESS)
+// Modo sem janela (alvo Headless do test.cbp): roda a fase com entrada roteirizada o mais rapido que a CPU deixa
+// e mede ticks por segundo. Nao abre janela nem usa placa de video, entao roda em servidor de CI
 
-// Atualiza textura que apresenta o jogador conforme movimento
-void UpdatePlayerAnimation(Player *player, float *frameTimer, float frameSpeed, int *currentFrame) {
-    if (*frameTimer >= frameSpeed) { // Condicional para nao entrar em loop infinito
-        *frameTimer = 0.0f;
+#define MAX_SCRIPT_STEPS 1024
 
-        if (!player->isGrounded) {  // Jogador est no ar
-            *currentFrame = player->isShooting ? 10 : 5; // Animao de pulo
-        } else if (player->velocity.x != 0)  // Verifica se jogador est se mexendo horizontalmente (eixo x)
-            {
+// Passo do roteiro: as teclas seguradas valem por todos os ticks; as pressionadas (pulo e tiros) so no primeiro
+typedef struct {
+    int ticks;
+    PlayerInput input;
+} InputScriptStep;
 
-            if (player->isShooting) { // Verifica se jogador est atirando, se sim:
-                *currentFrame = (*currentFrame < 6 || *currentFrame > 8) ? 7 : *currentFrame + 1; // Varia entre texturas 6, 7 e 9
-            } else {  // Se no est atirando:
-                *currentFrame = (*currentFrame < 1 || *currentFrame > 3) ? 2 : *currentFrame + 1; // Varia entre texturas 1, 2 e 3
-            }
-        } else { // Jogador nao est fazendo nenhum movimento
-            *currentFrame = player->isShooting ? 7 : 0; // Animao de estar parado ou parado e atirando
+typedef struct {
+    InputScriptStep steps[MAX_SCRIPT_STEPS];
+    int count;
+    int current;        // Passo em execucao
+    int elapsed;        // Ticks ja rodados do passo atual
+} InputScript;
+
+// Le um passo no formato "<ticks> <teclas>", com teclas entre L, R (seguradas), J, Z, X (pressionadas) ou '-' para nenhuma
+bool ParseInputScriptLine(const char *line, InputScriptStep *step) {
+    char keys[16] = "-";
+    if (sscanf(line, "%d %15s", &step->ticks, keys) < 1 || step->ticks <= 0) {
+        return false;
+    }
+
+    step->input = (PlayerInput){0};
+    for (char *key = keys; *key; key++) {
+        switch (*key) {
+            case 'L': step->input.left = true; break;
+            case 'R': step->input.right = true; break;
+            case 'J': step->input.jump = true; break;
+            case 'Z': step->input.shootHorizontal = true; break;
+            case 'X': step->input.shootVertical = true; break;
         }
     }
+    return true;
 }
 
-// Atualiza estado do jogador frame a frame e chama a funo cada vez para trocar textura de acordo com estado
-void UpdatePlayerAnimationState(Player *player, float *frameTimer, float frameSpeed, unsigned *currentFrame, Rectangle *frameRec, int frameWidth) {
-    *frameTimer += GetFrameTime(); // Pega tempo desde o ltimo frame
-    UpdatePlayerAnimation(player, frameTimer, frameSpeed, currentFrame); // Aplica textura ao jogador
-    frameRec->x = frameWidth * (*currentFrame);
-    frameRec->width = player->facingRight ? -frameWidth : frameWidth;
-}
+// Carrega o roteiro de um arquivo texto, um passo por linha; linhas comecando com '#' sao comentarios
+bool LoadInputScript(const char *filename, InputScript *script) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Erro ao abrir o roteiro %s!\n", filename);
+        return false;
+    }
 
-// Verifica vida do jogador e, se abaixo de 0, encerra o jogo
-int isPlayerDead(Player *player) {
-    if (player->health < 0) {
-        return 1;
-    } else {
-        return 0;
+    char line[128];
+    script->count = 0;
+    while (fgets(line, sizeof(line), file) && script->count < MAX_SCRIPT_STEPS) {
+        if (line[0] != '#' && ParseInputScriptLine(line, &script->steps[script->count])) {
+            script->count++;
+        }
     }
-}
+    fclose(file);
 
-int BeginGame(Player *player,
-             Texture2D infmanTex,
-             Rectangle frameRec,
-             float *frameTimer,
-             unsigned *currentFrame,
-             Camera2D camera,
-             float frameSpeed,
-             float gravity,
-             float playerSpeed,
-             float jumpForce,
-             float enemySpeedX,
-             float enemySpeedY,
-             float enemyOffset,
-             float projectileWidth,
-             float projectileHeight,
-             float projectileSpeed,
-             char map[MAX_HEIGHT][MAX_WIDTH],
-             int rows,
-             int cols,
-             Coin coins[MAX_WIDTH],
-             int *coinCount,
-             Enemy enemies[MAX_WIDTH],
-             int enemyCount,
-             Projectile projectiles[MAX_PROJECTILES],
-             Texture2D background,
-             Texture2D blockTexture,
-             Texture2D obstacleTexture,
-             Texture2D gateTexture,
-             Texture2D enemiesTexture,
-             Texture2D heartTexture,
-             int frameWidth,
-             int *guarda,
-             Texture2D enemyTex,
-             Rectangle enemyFrameRec
-            )
-{
+    script->current = 0;
+    script->elapsed = 0;
+    if (script->count == 0) {
+        printf("Erro: roteiro %s sem nenhum passo!\n", filename);
+        return false;
+    }
+    return true;
+}
 
-    float dt = GetFrameTime();
+// Roteiro usado sem -s: corre para a direita pulando e atirando, voltando um pouco de vez em quando
+void LoadDefaultInputScript(InputScript *script) {
+    const char *lines[] = {
+        "60 R", "1 RJ", "40 R", "1 RZ", "30 R", "1 RJ", "20 R", "1 RX",
+        "30 -", "1 Z", "40 L", "1 LJ", "30 R", "1 RJZ", "60 R"
+    };
+    script->count = 0;
+    for (int i = 0; i < (int)(sizeof(lines) / sizeof(lines[0])); i++) {
+        ParseInputScriptLine(lines[i], &script->steps[script->count++]);
+    }
+    script->current = 0;
+    script->elapsed = 0;
+}
 
-    ApplyGravity(player, gravity, dt);
+// Entrada do proximo tick; o roteiro recomeca quando acaba
+void NextScriptedInput(InputScript *script, PlayerInput *input) {
+    InputScriptStep *step = &script->steps[script->current];
 
-    if(!isPlayerDead(player)) {
+    *input = step->input;
+    if (script->elapsed > 0) {
+        ConsumePressedInput(input);
+    }
 
-    UpdatePlayerAnimationState(player, frameTimer, frameSpeed, currentFrame, &frameRec, frameWidth);
-    HandleRespawn(player, SCREEN_HEIGHT);
+    if (++script->elapsed >= step->ticks) {
+        script->elapsed = 0;
+        script->current = (script->current + 1) % script->count;
+    }
+}
 
-    // Movimento
-    MovePlayer(player, playerSpeed, jumpForce, dt);
-    MoveCamera(&camera, player);
-    MoveEnemies(enemies, enemyCount, dt);
-    MoveProjectiles(projectiles, dt, player, SCREEN_WIDTH, map, rows, cols, BLOCK_SIZE);
+// Espalha count inimigos extras pelo mapa para medir a simulacao em escala, longe do spawn para o jogador
+// nao morrer logo ao nascer. A semente fixa repete as mesmas posicoes
+void AddExtraEnemies(EnemyStore *enemies, int count, int rows, int cols, Vector2 spawnPoint, GameSettings *settings) {
+    srand(1234);
+    for (int i = 0; i < count; i++) {
+        float x = (float)(rand() % cols) * BLOCK_SIZE;
+        float y = (float)(rand() % rows) * BLOCK_SIZE;
+        if (fabsf(x - spawnPoint.x) < settings->enemyOffset + 4 * BLOCK_SIZE) {
+            x = fmodf(x + 2 * (settings->enemyOffset + 4 * BLOCK_SIZE), cols * BLOCK_SIZE);
+        }
+        AddEnemy(enemies, x, y, (rand() % 2) ? settings->enemySpeedX : -settings->enemySpeedX, settings->enemyOffset);
+    }
+}
 
-    // Outros
-    CreateProjectile(player, projectiles, projectileWidth, projectileHeight, projectileSpeed, dt);
-    HandleCollisions(player, enemies, enemyCount, projectiles, map, rows, cols, BLOCK_SIZE, *currentFrame, dt, coins, coinCount);
+int main(int argc, char *argv[]) {
+    const char *mapFile = "map.txt";
+    const char *scriptFile = NULL;
+    long totalTicks = SIMULATION_HZ * 60 * 10;    // 10 minutos de jogo
+    int extraEnemies = 0;
+    const char *recordFile = NULL;
+    const char *replayFile = NULL;
+    int threadCount = 0;
+
+    for (int i = 1; i < argc; i += 2) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "-m") == 0) mapFile = value;
+        else if (value && strcmp(argv[i], "-s") == 0) scriptFile = value;
+        else if (value && strcmp(argv[i], "-t") == 0) totalTicks = atol(value);
+        else if (value && strcmp(argv[i], "-e") == 0) extraEnemies = atoi(value);
+        else if (value && strcmp(argv[i], "-g") == 0) recordFile = value;
+        else if (value && strcmp(argv[i], "-r") == 0) replayFile = value;
+        else if (value && strcmp(argv[i], "-j") == 0) threadCount = atoi(value);
+        else {
+            printf("Uso: %s [-m mapa.txt] [-s roteiro.txt] [-t ticks] [-e inimigos_extras] [-g grava_replay.bin] [-r reproduz_replay.bin] [-j threads]\n", argv[0]);
+            return 1;
+        }
+    }
 
-    BeginDrawing();
-    ClearBackground(RAYWHITE);
+    GameSettings settings = InitializeGameSettings();
 
-    BeginMode2D(camera);
+    TileMap map;
+    if (!LoadMap(mapFile, &map)) {
+        return 1;
+    }
 
-    // Renderiza o fundo atrs do jogador
-    RenderBackground(background, rows, cols);
+    Player player = InitializePlayer();
+    if (!FindPlayerSpawnPoint(&map, &player)) {
+        printf("Erro: mapa sem ponto de spawn (P)!\n");
+        return 1;
+    }
 
-    // Renderiza jogador
-    DrawTexturePro(infmanTex, frameRec, player->rect, (Vector2) {0, 0}, 0.0f, WHITE);
+    InputScript script;
+    if (scriptFile) {
+        if (!LoadInputScript(scriptFile, &script)) return 1;
+    } else {
+        LoadDefaultInputScript(&script);
+    }
 
-    // Renderiza mapa e elementos dinmicos
-    RenderCoins(coins, *coinCount);
-    RenderMap(map, rows, cols, BLOCK_SIZE, blockTexture, obstacleTexture, gateTexture);
-    RenderProjectiles(projectiles);
-    RenderEnemies(enemies, enemyCount, BLOCK_SIZE, enemiesTexture, &enemyFrameRec, frameTimer, currentFrame);
+    // Com -r as entradas (e os inimigos extras) vem da gravacao, e o tempo e o dela; com -g a sessao e gravada
+    InputReplay replay;
+    InitializeReplay(&replay);
+    if (replayFile) {
+        if (!LoadReplay(&replay, &map, replayFile)) return 1;
+        extraEnemies = replay.extraEnemies;
+        totalTicks = replay.tickCount;
+    } else if (recordFile) {
+        BeginReplayRecording(&replay, extraEnemies);
+    }
 
-    EndMode2D();
+    Coin *coins = malloc((map.coinCount + 1) * sizeof(Coin));
+    if (!coins) {
+        printf("Erro ao alocar as moedas!\n");
+        return 1;
+    }
+    int coinCount = InitializeCoins(&map, coins, BLOCK_SIZE);
+
+    int enemyCapacity = (map.enemyCount > MAX_ENEMIES) ? map.enemyCount : MAX_ENEMIES;
+    EnemyStore enemies;
+    ProjectilePool projectiles;
+    SpatialHash hash;
+    if (!InitializeEnemyStore(&enemies, enemyCapacity + extraEnemies, BLOCK_SIZE, BLOCK_SIZE) ||
+            !InitializeProjectilePool(&projectiles, MAX_PROJECTILES) ||
+            !InitializeSpatialHash(&hash, enemyCapacity + extraEnemies + coinCount + MAX_PROJECTILES)) {
+        return 1;
+    }
+    InitializeEnemies(&map, &enemies, BLOCK_SIZE, settings.enemySpeedX, settings.enemyOffset);
+    int levelEnemies = enemies.count;
+    AddExtraEnemies(&enemies, extraEnemies, map.rows, map.cols, player.spawnPoint, &settings);
 
-    // Interface
-    int heartX = 85;
-    int heartY = 37;
-    float heartWidth = 30.0f;
-    float heartHeight = 30.0f;
-
-    for (int i = 0; i < player->health; i++) {
-        Rectangle destRect = { heartX + i * (heartWidth + 5), heartY, heartWidth, heartHeight };
-        DrawTexturePro(heartTexture, (Rectangle) {0, 0, heartTexture.width, heartTexture.height}, destRect, (Vector2){0, 0}, 0.0f, WHITE);
-    }
-
-    int textX = 10;
-    int textY = 40;
-    int textHeight = 20;
-    int textWidth = MeasureText(TextFormat("Health:"), textHeight);
-    DrawRectangle(textX - 5, textY - 5, textWidth + 10, textHeight + 10, BLACK);
-    DrawText(TextFormat("Health:"), textX, textY, 20, WHITE);
-
-    int pointsX = 10;
-    int pointsY = 70;
-    int pointsHeight = 20;
-    int pointsWidth = MeasureText(TextFormat("Points: %d", player->points), textHeight);
-    DrawRectangle(pointsX - 5, pointsY - 5, pointsWidth + 10, pointsHeight + 10, BLACK);
-    DrawText(TextFormat("Points: %d", player->points), 10, 70, textHeight, WHITE);
+    WorldSnapshot levelStart;
+    if (!InitializeWorldSnapshot(&levelStart, enemyCapacity + extraEnemies, coinCount, MAX_PROJECTILES)) {
+        return 1;
+    }
+    CaptureWorldSnapshot(&levelStart, &player, &enemies, coins, coinCount, &projectiles);
 
-    EndDrawing();
+    RewindBuffer rewind;
+    if (!InitializeRewindBuffer(&rewind, enemyCapacity + extraEnemies, coinCount, MAX_PROJECTILES)) {
+        return 1;
+    }
 
-    *guarda = 1;
-    } else {
-        *guarda = 0;
+    // Fases do tick divididas entre threads (-j; 0 = uma por nucleo). O resultado nao depende de quantas
+    JobSystem jobs;
+    InitializeJobSystem(&jobs, threadCount);
 
-        int test = InitializeEnemies(map, rows, cols, enemies, BLOCK_SIZE, enemySpeedX, enemySpeedY, enemyOffset);
+    PlayerInput input = {0};
+    unsigned currentFrame = 0;
+    int deaths = 0;
+    int gates = 0;
 
-        if(player->points < 0) {
-            DesenhaTelaFinal();
+    double start = BenchmarkNow();
+    for (long t = 0; t < totalTicks; t++) {
+        if (!NextReplayInput(&replay, &input)) {
+            NextScriptedInput(&script, &input);
         }
-
-        player->health = 3;
-        player->points = 0;
-        player->position = player->spawnPoint;
-        WaitTime(0.1);
+        unsigned char buttons = PackPlayerInput(&input);
+        SimulateTick(&player, &input, &currentFrame, &settings, &map,
+                     coins, &coinCount, &enemies, &projectiles, &hash, &rewind, &jobs);
+        AdvanceReplay(&replay, buttons, &player, &enemies, coins, coinCount, &projectiles);
+
+        // Mesma regra do jogo: morreu ou chegou ao portao, a fase recomeca
+        if (isPlayerDead(&player)) {
+            if (player.reachedGate) gates++;
+            else deaths++;
+            RestoreWorldSnapshot(&levelStart, &player, &enemies, coins, &coinCount, &projectiles);
+            ClearRewindBuffer(&rewind);
+        }
+    }
+    double elapsed = BenchmarkNow() - start;
+
+    printf("Mapa %s: %dx%d, %d inimigos (+%d extras), %d moedas\n", mapFile, map.cols, map.rows, levelEnemies, extraEnemies, coinCount);
+    printf("%ld ticks em %.3f s: %.0f ticks/s (%.1fx tempo real a %d Hz)\n",
+           totalTicks, elapsed, totalTicks / elapsed, totalTicks / elapsed / SIMULATION_HZ, SIMULATION_HZ);
+    printf("Jogador em (%.1f, %.1f), vida %d, pontos %d; %d mortes, %d portoes; %d inimigos vivos, %d projeteis\n",
+           player.position.x, player.position.y, player.health, player.points, deaths, gates,
+           enemies.activeCount, projectiles.count);
+    printf("Mapa na memoria: %zu KB, %lu pedacos lidos do disco\n", GetMapMemoryUsage(&map) / 1024, map.chunkLoads);
+    printf("Rewind: %zu KB, media de %.0f bytes por tick, %.1f s no historico\n", GetRewindMemoryUsage(&rewind) / 1024,
+           rewind.recordedTicks ? (double)rewind.recordedBytes / rewind.recordedTicks : 0.0, GetRewindSeconds(&rewind));
+    printf("Jobs: %d threads, %ld jobs, %ld roubados de outra thread\n", jobs.threadCount, jobs.executed, jobs.stolen);
+    printf("Hash final do mundo: %08x\n", HashWorldState(&player, &enemies, coins, coinCount, &projectiles));
+
+    int result = 0;
+    if (recordFile && !SaveReplay(&replay, &map, recordFile)) {
+        result = 1;
+    }
+    if (replayFile) {
+        PrintReplayResult(&replay);
+        if (replay.divergedTick >= 0) result = 1;
     }
+
+    UnloadJobSystem(&jobs);
+    UnloadReplay(&replay);
+    UnloadRewindBuffer(&rewind);
+    UnloadWorldSnapshot(&levelStart);
+    UnloadSpatialHash(&hash);
+    UnloadProjectilePool(&projectiles);
+    UnloadEnemyStore(&enemies);
+    free(coins);
+    UnloadMap(&map);
+    return result;
 }
+#else
+int main(int argc, char *argv[]) {
+    const char *recordFile = NULL;
+    const char *replayFile = NULL;
+
+    for (int i = 1; i < argc; i += 2) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "-g") == 0) recordFile = value;
+        else if (value && strcmp(argv[i], "-r") == 0) replayFile = value;
+        else {
+            printf("Uso: %s [-g grava_replay.bin] [-r reproduz_replay.bin]\n", argv[0]);
+            return 1;
+        }
+    }
 
-int main(void) {
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "INF-MAN");
     InitAudioDevice();
-    // World control variables
-    float gravity = 800.0;
-    float playerSpeed = 200.0;
-    float jumpForce = -300.0;
 
-    float enemySpeedX = 150.0;
-    float enemySpeedY = 50.0;
-    float enemyOffset = 200.0f;
+    // Imagens pedidas primeiro: a thread de assets decodifica enquanto o mapa e o resto carregam aqui
+    AssetManager assets;
+    InitializeAssetManager(&assets);
+    int backgroundAsset = AcquireAsset(&assets, "background.png", ASSET_TEXTURE);
+    int logoAsset = AcquireAsset(&assets, "inf_man.png", ASSET_TEXTURE);
+
+    // Todos os sprites do jogo numa textura so (mesma ordem do SpriteId)
+    const char *spriteFiles[SPRITE_COUNT] = {
+        "tile1.png",
+        "spike.png",
+        "gate.png",
+        "enemies.png",
+        "heart.png",
+        "player-sheet.png",
+        NULL    // Pixel branco gerado
+    };
+    int spriteAssets[SPRITE_COUNT];
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        spriteAssets[i] = spriteFiles[i] ? AcquireAsset(&assets, spriteFiles[i], ASSET_IMAGE) : -1;
+    }
 
-    float projectileWidth = 20.0;
-    float projectileHeight = 10.0;
-    float projectileSpeed = 400.0;
+    // World control variables
+    GameSettings settings = InitializeGameSettings();
 
-    float frameSpeed = 0.15f;
     int guarda = 0;
-    Music music = LoadMusicStream("musica_jogo.wav");
+
+    // Efeitos sonoros: arquivo se existir, senao um efeito gerado em InitializeAudio
+    const char *sfxFiles[SFX_COUNT] = {"sfx_tiro.wav", "sfx_moeda.wav", "sfx_acerto.wav", "sfx_dano.wav"};
+    int sfxAssets[SFX_COUNT];
+    for (int i = 0; i < SFX_COUNT; i++) {
+        sfxAssets[i] = FileExists(sfxFiles[i]) ? AcquireAsset(&assets, sfxFiles[i], ASSET_WAVE) : -1;
+    }
     // Load map
-    int rows, cols;
-    char map[MAX_HEIGHT][MAX_WIDTH];
-    LoadMap("map.txt", map, &rows, &cols);
-    if (rows == 0 || cols == 0) {
+    // map.bin (gerado pelo alvo MapCompiler) abre sem ler o mapa inteiro; so vale se for mais novo que o map.txt
+    const char *mapFile = "map.txt";
+    if (FileExists("map.bin") && (!FileExists("map.txt") || GetFileModTime("map.bin") >= GetFileModTime("map.txt"))) {
+        mapFile = "map.bin";
+    }
+    TileMap map;
+    if (!LoadMap(mapFile, &map)) {
         CloseWindow();
         return 1;
     }
 
     // Initialize player
     Player player = InitializePlayer();
-    if (!FindPlayerSpawnPoint(map, rows, cols, &player)) {
+    if (!FindPlayerSpawnPoint(&map, &player)) {
+        CloseWindow();
+        return 1;
+    }
+
+    // Load textures: o que a thread ainda nao terminou e esperado aqui e enviado para a GPU
+    if (!WaitForAssets(&assets)) {
+        UnloadAssetManager(&assets);
+        CloseWindow();
+        return 1;
+    }
+    BackgroundLayer backgroundLayers[MAX_BACKGROUND_LAYERS];
+    int backgroundLayerCount = 0;
+    AddBackgroundLayer(backgroundLayers, &backgroundLayerCount, GetAssetTexture(&assets, backgroundAsset), 1.0f, BLUE);
+
+    // As imagens dos sprites so servem para montar o atlas; devolvidas logo depois
+    Image spriteImages[SPRITE_COUNT];
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        spriteImages[i] = spriteFiles[i] ? GetAssetImage(&assets, spriteAssets[i]) : GenImageColor(4, 4, WHITE);
+    }
+    TextureAtlas atlas;
+    SpriteBatch batch;
+    bool atlasLoaded = LoadTextureAtlas(&atlas, spriteImages) && InitializeSpriteBatch(&batch, &atlas);
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        if (spriteFiles[i]) ReleaseAsset(&assets, spriteAssets[i]);
+        else UnloadImage(spriteImages[i]);
+    }
+    if (!atlasLoaded) {
+        UnloadAssetManager(&assets);
+        CloseWindow();
+        return 1;
+    }
+    PrintAssetStats(&assets);
+
+    // Musica e efeitos numa thread propria, que toca mesmo com o jogo preso numa tela
+    Wave sfxWaves[SFX_COUNT];
+    for (int i = 0; i < SFX_COUNT; i++) {
+        sfxWaves[i] = GetAssetWave(&assets, sfxAssets[i]);
+    }
+    AudioSystem audio;
+    bool audioLoaded = InitializeAudio(&audio, "musica_jogo.wav", sfxWaves, MUSIC_BUFFER_FRAMES, SFX_BUFFER_FRAMES);
+    for (int i = 0; i < SFX_COUNT; i++) {
+        ReleaseAsset(&assets, sfxAssets[i]);
+    }
+    if (!audioLoaded) {
+        UnloadAssetManager(&assets);
         CloseWindow();
         return 1;
     }
 
-    // Load textures
-    Texture2D background = LoadTexture("background.png");
-    Texture2D blockTexture = LoadTexture("tile1.png");
-    Texture2D obstacleTexture = LoadTexture("spike.png");
-    Texture2D gateTexture = LoadTexture("gate.png");
-    Texture2D enemiesTexture = LoadTexture("enemies.png");
-    Texture2D heartTexture = LoadTexture("heart.png");
-    Texture2D initializeTexture = LoadTexture("inf_man.png");
+    // Terreno estatico desenhado em pedacos conforme aparece na tela
+    TerrainCache terrain;
+    InitializeTerrainCache(&terrain, map.rows, map.cols);
 
-    Texture2D infmanTex;
     Rectangle frameRec;
     int frameWidth;
 
-    Texture2D enemyTex;
     Rectangle enemyFrameRec;
     int enemyFrameWidth;
 
-    InitializePlayerTextureAndAnimation(&infmanTex, &frameRec, &frameWidth, &enemyTex, &enemyFrameRec, &enemyFrameWidth);
+    InitializePlayerTextureAndAnimation(&atlas, &frameRec, &frameWidth, &enemyFrameRec, &enemyFrameWidth);
 
     Camera2D camera = InitializeCamera(&player);
-    float frameTimer = 0.0f;
     unsigned currentFrame = 0;
 
-    Coin coins[MAX_WIDTH];
-    int coinCount = InitializeCoins(map, rows, cols, coins, BLOCK_SIZE);
+    Coin *coins = malloc((map.coinCount + 1) * sizeof(Coin));
+    if (!coins) {
+        printf("Erro ao alocar as moedas!\n");
+        CloseWindow();
+        return 1;
+    }
+    int coinCount = InitializeCoins(&map, coins, BLOCK_SIZE);
+
+    int enemyCapacity = (map.enemyCount > MAX_ENEMIES) ? map.enemyCount : MAX_ENEMIES;
+    EnemyStore enemies;
+    if (!InitializeEnemyStore(&enemies, enemyCapacity, BLOCK_SIZE, BLOCK_SIZE)) {
+        CloseWindow();
+        return 1;
+    }
+    InitializeEnemies(&map, &enemies, BLOCK_SIZE, settings.enemySpeedX, settings.enemyOffset);
+
+    // Quadros de animacao do jogador e dos inimigos, calculados uma vez por frame antes do desenho
+    AnimationSystem animation;
+    if (!InitializeAnimationSystem(&animation, enemyCapacity)) {
+        CloseWindow();
+        return 1;
+    }
+
+    ProjectilePool projectiles;
+    if (!InitializeProjectilePool(&projectiles, MAX_PROJECTILES)) {
+        CloseWindow();
+        return 1;
+    }
+
+    SpatialHash hash;
+    if (!InitializeSpatialHash(&hash, enemyCapacity + coinCount + MAX_PROJECTILES)) {
+        CloseWindow();
+        return 1;
+    }
+
+    // Estado inicial da fase, para recomecar, e o do quicksave
+    WorldSnapshot levelStart;
+    WorldSnapshot quicksave;
+    if (!InitializeWorldSnapshot(&levelStart, enemyCapacity, map.coinCount, MAX_PROJECTILES) ||
+            !InitializeWorldSnapshot(&quicksave, enemyCapacity, map.coinCount, MAX_PROJECTILES)) {
+        CloseWindow();
+        return 1;
+    }
+    CaptureWorldSnapshot(&levelStart, &player, &enemies, coins, coinCount, &projectiles);
+
+    // Historico dos ultimos REWIND_SECONDS segundos (R segurado ou obstaculo)
+    RewindBuffer rewind;
+    if (!InitializeRewindBuffer(&rewind, enemyCapacity, map.coinCount, MAX_PROJECTILES)) {
+        CloseWindow();
+        return 1;
+    }
+
+    // Arquivos (placar, quicksave, CSV do profiler) sao lidos e gravados numa thread a parte
+    IoQueue io;
+    InitializeIoQueue(&io, true);
+
+    // Placar: arquivo compactado mais o log das pontuacoes novas, lido pela thread de arquivos. Ate terminar
+    // o placar fica vazio e a tela do placar mostra que esta carregando
+    Leaderboard leaderboard;
+    if (!QueueLeaderboardLoad(&io, &leaderboard, LEADERBOARD_FILE, LEADERBOARD_LOG)) {
+        UnloadIoQueue(&io);
+        CloseWindow();
+        return 1;
+    }
+
+    // Replay: -g grava as entradas da sessao desde o comeco da fase, -r reproduz uma gravacao
+    InputReplay replay;
+    InitializeReplay(&replay);
+    if (recordFile) {
+        BeginReplayRecording(&replay, 0);
+    }
+    if (replayFile) {
+        if (!LoadReplay(&replay, &map, replayFile)) {
+            CloseWindow();
+            return 1;
+        }
+        if (replay.extraEnemies != 0) {
+            printf("Gravacao %s tem inimigos extras; so roda no modo sem janela\n", replayFile);
+            CloseWindow();
+            return 1;
+        }
+    }
 
-    Enemy enemies[MAX_WIDTH];
-    int enemyCount = InitializeEnemies(map, rows, cols, enemies, BLOCK_SIZE, enemySpeedX, enemySpeedY, enemyOffset);
+    // Fases do tick (movimento, hash espacial, alvos dos projeteis) divididas entre os nucleos
+    JobSystem jobs;
+    InitializeJobSystem(&jobs, 0);
 
-    Projectile projectiles[MAX_PROJECTILES];
-    InitializeProjectiles(projectiles);
+    FixedClock clock = {0};
+    PlayerInput input = {0};
 
     SetTargetFPS(60);
 
     while (!WindowShouldClose()) {
-        UpdateMusicStream(music);
-        SetMusicVolume(music,0.5);
+        if (!audio.threaded) UpdateAudio(&audio);
         float dt = GetFrameTime();
+
+        // Leituras terminadas fora do jogo (placar). No jogo quem retira e o BeginGame, por causa do quickload
+        if (guarda != 1) {
+            IoRequest done;
+            while (PollIoCompletion(&io, &done)) {
+                FinishIoRequest(&done, &leaderboard);
+            }
+        }
+
         switch (guarda) {
             case 0:
-            guarda = Menu();
+            guarda = Menu(GetAssetTexture(&assets, logoAsset));
             break;
             case 1:
-                BeginGame(&player, infmanTex, frameRec, &frameTimer, &currentFrame, camera, frameSpeed,
-                                        gravity, playerSpeed, jumpForce, enemySpeedX, enemySpeedY, enemyOffset,
-                                        projectileWidth, projectileHeight, projectileSpeed, map, rows, cols,
-                                        coins, &coinCount, enemies, enemyCount, projectiles, background,
-                                        blockTexture, obstacleTexture, gateTexture, enemiesTexture, heartTexture,
-                                        frameWidth, &guarda, enemyTex, enemyFrameRec);
+                BeginGame(&player, frameRec, &animation, &currentFrame, camera,
+                                        &settings, &map,
+                                        coins, &coinCount, &enemies, &projectiles, backgroundLayers, backgroundLayerCount,
+                                        frameWidth, &guarda, enemyFrameRec, &hash, &terrain, &batch, &clock, &input,
+                                        &levelStart, &quicksave, &rewind, &replay, &leaderboard, &io, &audio, &jobs);
 
                 break;
             case 2: {
-                    FILE *arq = fopen("top_scores.bin", "rb");
-                    if (!arq) {
-                        CriaTop5Jogadores();  // Cria o arquivo caso no exista
-                    }
-                    else {
-                        DesenhaTop5(&guarda);// Exibe o leaderboard
-                        if(IsKeyPressed(KEY_ENTER)) {
-                            guarda = 0;
-                        } else {
-                            guarda = 2;
-                        }
+                    DesenhaTop5(&leaderboard);// Exibe o leaderboard
+                    if(IsKeyPressed(KEY_ENTER)) {
+                        guarda = 0;
+                    } else {
+                        guarda = 2;
                     }
                     break;
                 }
             case 3: {
-                StopMusicStream(music);
+                UnloadJobSystem(&jobs);
+                UnloadIoQueue(&io);     // Espera as gravacoes que ainda estao na fila
+                printf("Mapa: %lu pedacos lidos, %lu na hora com o pedido ainda na thread de arquivos\n", map.chunkLoads, map.chunkStalls);
+                UnloadLeaderboard(&leaderboard);
+                if (recordFile) SaveReplay(&replay, &map, recordFile);
+                if (replayFile) PrintReplayResult(&replay);
+                UnloadReplay(&replay);
+                UnloadRewindBuffer(&rewind);
+                UnloadWorldSnapshot(&quicksave);
+                UnloadWorldSnapshot(&levelStart);
+                UnloadSpatialHash(&hash);
+                UnloadProjectilePool(&projectiles);
+                UnloadAnimationSystem(&animation);
+                UnloadEnemyStore(&enemies);
+                UnloadTerrainCache(&terrain);
+                UnloadSpriteBatch(&batch);
+                UnloadTextureAtlas(&atlas);
+                ReleaseAsset(&assets, logoAsset);
+                ReleaseAsset(&assets, backgroundAsset);
+                UnloadAssetManager(&assets);
+                free(coins);
+                UnloadMap(&map);
+                UnloadAudio(&audio);
                 CloseAudioDevice();
                 CloseWindow();
                 return 0;
             }
         }
     }
+
+    // Janela fechada sem passar pela saida do menu: a gravacao nao pode se perder
+    UnloadAudio(&audio);
+    UnloadJobSystem(&jobs);
+    UnloadIoQueue(&io);
+    UnloadLeaderboard(&leaderboard);
+    if (recordFile) SaveReplay(&replay, &map, recordFile);
+    if (replayFile) PrintReplayResult(&replay);
     return 0;
 }
+#endif